@@ -1,7 +1,147 @@
 #include <gtk/gtk.h>
+#include <glib/gstdio.h>
+#include <glib-unix.h>
+#include <math.h>
+#include <signal.h>
 #include <sqlite3.h>
 #include <time.h>
 
+// Prepared statements of one connection, keyed by their SQL text. Each
+// statement is prepared on first use, handed out again after
+// sqlite3_reset/clear_bindings, and finalized by stmt_cache_clear.
+typedef struct {
+    sqlite3 *db;
+    GHashTable *stmts;          // SQL text -> sqlite3_stmt
+    guint hits;
+    guint misses;
+} StmtCache;
+
+typedef struct _DbWorker DbWorker;
+
+// A lookup table of names keyed by small integer ids, loaded from the
+// categories or payment_types table. Expenses store the ids; names are
+// only looked up for display and input.
+typedef struct {
+    const char *table;
+    GPtrArray *names;           // Indexed by id; NULL where no entry has that id
+} Dictionary;
+
+// How every connection is tuned at open, which archives it reads, and how
+// the database is backed up; see storage_profile_load for where the
+// settings come from
+typedef struct {
+    gchar *database_file;       // Database every connection opens
+    gchar *journal_mode;        // PRAGMA journal_mode
+    gchar *synchronous;         // PRAGMA synchronous
+    gchar *temp_store;          // PRAGMA temp_store
+    gint cache_kib;             // Page cache per connection
+    gint mmap_mib;              // Memory-mapped I/O window, 0 to disable
+    gint busy_timeout_ms;       // How long to wait for another connection's lock
+    gint columnar_cache;        // Keep ExpenseColumns for the analytics, 0 to disable
+    gchar *backup_dir;          // Where backups are written
+    gint backup_interval_min;   // Age of the newest backup that starts another, 0 to disable
+    gint backup_keep;           // Backups kept, oldest removed first; 0 keeps all
+    gchar *archive_dir;         // Where the archives of closed years are kept
+    gint archive_keep_years;    // Years kept in the database, this one included; 0 never archives
+    GArray *archive_years;      // gint, ascending: each archive's first year; see find_archives
+} StorageProfile;
+
+// In-memory copy of the expense columns the analytics aggregate, one
+// contiguous array per column in ascending id order. Deleted rows stay
+// as tombstones with category id 0 and 0 cents until enough pile up to
+// compact. Dictionary ids are 16 bits wide here; a ledger with larger
+// ids runs its analytics through SQL instead.
+typedef struct {
+    GArray *ids;                // gint
+    GArray *cents;              // gint64, the amount in cents
+    GArray *days;               // gint32, the day column; G_MININT32 for invalid dates
+    GArray *category_ids;       // guint16
+    GArray *payment_type_ids;   // guint16
+    guint16 max_category_id;
+    guint16 max_payment_type_id;
+    guint n_deleted;
+} ExpenseColumns;
+
+// Rows an analytics kernel aggregates: days first_day to last_day and,
+// unless category_id is 0, a single category
+typedef struct {
+    gint32 first_day;
+    gint32 last_day;
+    guint16 category_id;
+} ColumnFilter;
+
+// Spend per day as running totals, so the total of any run of days is one
+// subtraction: entry i of prefix is the spend, in cents, of every day
+// before first_day + i. Built on the DB worker from day_totals.
+typedef struct {
+    gint32 first_day;
+    GArray *prefix;             // gint64, one entry per day from first_day, plus one
+} DaySeries;
+
+// A description entered before: how many expenses use it, and with which
+// categories and payment types
+typedef struct {
+    gchar *key;                 // Case-folded description, the sort key
+    gchar *description;
+    gint count;                 // Expenses with this description
+    GArray *category_counts;    // gint, expenses by category id
+    GArray *payment_type_counts; // gint, expenses by payment type id
+} DescriptionEntry;
+
+// The distinct descriptions of the database's expenses, which complete
+// the description entry without a query. Sorted by key, so the entries
+// starting with some text are a range one binary search finds. Built on
+// the DB worker at startup and kept up to date by the form.
+typedef struct {
+    GPtrArray *entries;         // DescriptionEntry, by key and then description
+} DescriptionIndex;
+
+// Bucket sizes of the trend chart, in the order of its combo box
+enum {
+    TREND_BY_DAY,
+    TREND_BY_WEEK,
+    TREND_BY_MONTH
+};
+
+// A chart rendered once per allocation size and data change, so that
+// exposes, moves and hover repaints only blit it
+typedef struct {
+    cairo_surface_t *surface;   // NULL until drawn, or after invalidation
+    int width;
+    int height;
+    int scale;
+    guint hits;
+    guint misses;
+} ChartCache;
+
+// Latency statistics of one call site: a SQL statement, reported by the
+// SQLite profile trace, or a timed UI handler
+typedef struct {
+    const char *name;
+    guint64 count;
+    gint64 total_ns;
+    gint64 max_ns;
+    guint buckets[];            // Latency histogram, see STATS_N_BUCKETS
+} CallStats;
+
+// Orders of the expense list, picked by clicking a column header. Ties
+// break on date and then id in the same direction, so each order is a
+// scan of an index on (column, date), whose entries end in the id.
+// Categories and payment types sort by id, the order their combos list.
+enum {
+    EXPENSE_SORT_DATE,
+    EXPENSE_SORT_DESCRIPTION,
+    EXPENSE_SORT_AMOUNT,
+    EXPENSE_SORT_PAYMENT_TYPE,
+    EXPENSE_SORT_CATEGORY
+};
+
+// A list order; all zero is the default, newest first
+typedef struct {
+    gint column;                // EXPENSE_SORT_*
+    gboolean ascending;
+} ExpenseOrder;
+
 // Global widgets we'll need to access
 typedef struct {
     GtkWidget *window;
@@ -15,12 +155,27 @@ typedef struct {
     GtkWidget *category_chart;
     GtkWidget *payment_chart;
     sqlite3 *db;
+    StmtCache stmts;             // Prepared statements on db
+    StorageProfile storage;      // Applied to every connection, fixed after startup
+    DbWorker *worker;            // Runs the read queries off the main loop
     GtkWidget *filter_combo;     // Filter dropdown
     GtkWidget *search_entry;     // Search bar
     GtkWidget *export_button;
+    GtkWidget *export_view_check;      // Export only the filtered view
+    GtkWidget *export_progress;
+    GtkWidget *export_cancel_button;
+    struct _ExportJob *export_job;     // Export in progress, NULL when idle
+    GtkWidget *import_button;
+    GtkWidget *import_progress;
+    struct _ImportJob *import_job;     // Import in progress, NULL when idle
+    GtkWidget *backup_button;
+    GtkWidget *backup_progress;
+    struct _BackupJob *backup_job;     // Backup in progress, NULL when idle
+    gint64 last_backup;          // Real time of the newest backup, 0 for none
+    guint backup_timer;          // Checks whether a scheduled backup is due
     GtkWidget *edit_button;  
     GtkWidget *delete_button;  // Export button
-    GtkListStore *expense_store; // For storing filtered results
+    struct _ExpenseModel *expense_model; // Lazy view over the filtered rows
     GtkWidget *pagination_box;
     GtkWidget *prev_button;
     GtkWidget *next_button;
@@ -34,60 +189,483 @@ typedef struct {
     GtkTreeSelection *selection;
     gint selected_expense_id;
     GtkTreeIter selected_iter;
+    gboolean list_pending;       // A list reload is queued on the DB worker
+    Dictionary categories;
+    Dictionary payment_types;
+    gint filter_category_id;     // Active category filter, 0 for all
+    ExpenseOrder order;          // Sort order of the expense list
+    GtkTreeViewColumn *sorted_column; // Header showing the sort indicator
+    gchar *filter_fts_query;     // Active FTS5 search query, NULL for none
+    gchar *filter_from_date;     // Active date range, inclusive; NULL for an open end
+    gchar *filter_to_date;
+    GtkWidget *date_expander;    // Date range filter, labelled with the active range
+    GtkWidget *from_check;
+    GtkWidget *from_calendar;
+    GtkWidget *to_check;
+    GtkWidget *to_calendar;
+    GArray *category_totals;     // Chart data from the DB worker, by category id
+    GArray *payment_totals;      // Chart data from the DB worker, by payment type id
+    ChartCache category_cache;
+    ChartCache payment_cache;
+    GtkWidget *stats_view;       // Diagnostics panel text
+    guint stats_source;          // Refreshes the panel while it is expanded
+    GtkWidget *trend_chart;
+    DaySeries *trend_series;     // From the DB worker, NULL until the first load
+    int trend_unit;              // TREND_BY_DAY, _WEEK or _MONTH
+    gint32 trend_first_day;      // Window the trend chart shows, inclusive
+    gint32 trend_last_day;
+    gboolean trend_dragging;     // Panning with the first button held
+    double trend_drag_x;
+    gint32 trend_drag_first_day;
+    ExpenseColumns *columns;     // Analytics columns, NULL until loaded or when disabled
+    GArray *column_changes;      // Expense ids written on db since the columns were requested
+    DescriptionIndex *descriptions; // Completes the description entry, NULL until loaded
+    GtkListStore *description_suggestions; // The completion's model, owned by it
 } AppData;
 
-// Color definitions for pie charts
+// A request for the DB worker. run executes on the worker thread against
+// the worker's own connection; done then executes on the GTK main loop,
+// unless a newer request of the same kind has superseded this one.
+typedef struct _DbJob DbJob;
+typedef void (*DbJobRun)(DbWorker *worker, DbJob *job);
+typedef void (*DbJobDone)(AppData *app, DbJob *job);
+
+struct _DbJob {
+    int kind;
+    guint generation;
+    DbJobRun run;
+    DbJobDone done;
+    gpointer data;
+    GDestroyNotify free_data;
+    AppData *app;
+    DbWorker *worker;
+};
+
+// Kinds of request where only the newest one matters: a newer request of
+// the same kind makes any older one still queued or in flight stale, and
+// stale requests are neither run nor delivered
+enum {
+    DB_JOB_LIST,
+    DB_JOB_BUDGET,
+    DB_JOB_CHARTS,
+    DB_JOB_COLUMNS,
+    DB_JOB_TREND,
+    DB_JOB_DESCRIPTIONS,
+    DB_N_LATEST_KINDS
+};
+
+// Kind for requests that must all run, such as exports and row fetches
+#define DB_JOB_EVERY DB_N_LATEST_KINDS
+
+// Virtual machine steps between checks of whether the running request has
+// been superseded, which aborts it
+#define DB_WORKER_PROGRESS_OPS 1000
+
+struct _DbWorker {
+    GThread *thread;
+    GAsyncQueue *queue;
+    sqlite3 *db;
+    StmtCache stmts;
+    gint generations[DB_N_LATEST_KINDS];
+    DbJob *running;             // Request being run, for the progress handler
+};
+
+// Default database file shared by the UI connection and the DB worker
+#define DATABASE_FILE "expenses.db"
+
+// Storage profile defaults. WAL lets the DB worker, exports and imports
+// read while the UI connection writes, and with synchronous=NORMAL a
+// commit appends to the log without an fsync.
+#define STORAGE_JOURNAL_MODE "wal"
+#define STORAGE_SYNCHRONOUS "normal"
+#define STORAGE_TEMP_STORE "memory"
+#define STORAGE_CACHE_KIB (32 * 1024)
+#define STORAGE_MMAP_MIB 256
+#define STORAGE_BUSY_TIMEOUT_MS 5000
+#define STORAGE_COLUMNAR_CACHE 0
+#define STORAGE_BACKUP_DIR "backups"
+#define STORAGE_BACKUP_INTERVAL_MIN (24 * 60)
+#define STORAGE_BACKUP_KEEP 7
+#define STORAGE_ARCHIVE_DIR "archives"
+#define STORAGE_ARCHIVE_KEEP_YEARS 0
+
+// Optional storage profile overrides, read from the [storage] group;
+// EXPENSES_CONFIG names another file
+#define STORAGE_CONFIG_FILE "expenses.ini"
+
+// Call site latency histogram: bucket i counts latencies from 2^(i/4) to
+// 2^((i+1)/4) microseconds, the last one everything past about a minute
+#define STATS_BUCKETS_PER_OCTAVE 4
+#define STATS_N_BUCKETS 104
+
+// How often the expanded diagnostics panel is refreshed
+#define STATS_REFRESH_MS 1000
+
+// The analytics kernels filter COLUMN_LANES rows per vector operation,
+// which keeps the narrowest column's comparisons within a 16-byte SIMD
+// register, and the group-by filters COLUMN_CHUNK_ROWS rows at a time
+// into a buffer that stays in L1. COLUMN_VECTORS is defined where the
+// compiler has GCC's generic vector extensions; elsewhere the kernels
+// run their scalar loop only.
+#define COLUMN_LANES 4
+#define COLUMN_CHUNK_ROWS 256
+#if defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 9)
+#define COLUMN_VECTORS 1
+#endif
+
+// Compact the analytics columns once this fraction of rows are tombstones
+#define COLUMN_MAX_DELETED_FRACTION 4
+
+// GDate's Julian day of 1970-01-01, day 0 of the day column
+#define DAY_EPOCH_JULIAN 719163
+
+// Trend chart: the window it opens on, in days up to today, and the
+// shortest and longest windows zooming reaches. The window stays within
+// years 2 to 9998, so bucket arithmetic never leaves GDate's range.
+#define TREND_INITIAL_DAYS 182
+#define TREND_MIN_DAYS 14
+#define TREND_MAX_DAYS (50 * 365)
+#define TREND_EARLIEST_DAY (-718797)
+#define TREND_LATEST_DAY 2932531
+
+// Window scale per scroll step, and buckets in the moving average
+#define TREND_ZOOM_STEP 1.25
+#define TREND_AVERAGE_BUCKETS 4
+
+// Space around the trend plot for the axis labels
+#define TREND_MARGIN_LEFT 70
+#define TREND_MARGIN_RIGHT 10
+#define TREND_MARGIN_TOP 10
+#define TREND_MARGIN_BOTTOM 25
+
+// Keyset position in the list order: the sort column's value, then date
+// and id. A block of rows starts with the first row strictly after its
+// key; the first block has date NULL.
+typedef struct {
+    gchar *text;                // Sort value of a description order
+    double number;              // Sort value of an amount, payment type or category order
+    gchar *date;
+    gint id;
+} SeekKey;
+
+// One row of the expense list
+typedef struct {
+    gint id;
+    gchar *description;
+    double amount;
+    gint payment_type_id;
+    gchar *date;
+    gint category_id;
+} ExpenseRow;
+
+// Columns of the expense table model
+enum {
+    EXPENSE_COL_ID,
+    EXPENSE_COL_DESCRIPTION,
+    EXPENSE_COL_AMOUNT,
+    EXPENSE_COL_PAYMENT_TYPE,
+    EXPENSE_COL_DATE,
+    EXPENSE_COL_CATEGORY,
+    EXPENSE_N_COLUMNS
+};
+
+// Lazy, SQLite-backed GtkTreeModel for the expense table. Rows are fetched
+// on demand a block at a time and at most EXPENSE_MAX_BLOCKS blocks are
+// kept, least recently used evicted first. Blocks start EXPENSE_BLOCK_ROWS
+// rows long and grow or shrink as rows are added and deleted.
+#define EXPENSE_TYPE_MODEL (expense_model_get_type())
+G_DECLARE_FINAL_TYPE(ExpenseModel, expense_model, EXPENSE, MODEL, GObject)
+
+#define EXPENSE_BLOCK_ROWS 256
+#define EXPENSE_MAX_BLOCKS 32
+
+// A block of fetched rows
+typedef struct _RowBlock RowBlock;
+
+// The filter of an expense list and where its row blocks start. Built on
+// the DB worker; once a model owns it, only the main thread touches it.
+typedef struct {
+    ExpenseOrder order;         // Row order when browsing; search results are ranked
+    gint category_id;           // Category filter, 0 for all
+    gchar *from_date;           // Date range, inclusive; NULL for an open end
+    gchar *to_date;
+    gchar *fts_query;           // FTS5 search, NULL when browsing
+    const GArray *archives;     // Archived years, from the storage profile; NULL for none
+    int n_rows;
+    GArray *block_keys;         // SeekKey where each block starts (browsing only)
+    GArray *block_starts;       // Row index of the first row of each block
+    RowBlock *first_block;      // Search results read with the count, until a model takes them
+} ExpenseIndex;
+
+static ExpenseModel *expense_model_new(DbWorker *worker, StmtCache *stmts, const Dictionary *categories,
+                                       const Dictionary *payment_types, ExpenseIndex *index);
+static int expense_model_get_n_rows(ExpenseModel *model);
+static void expense_model_retire(ExpenseModel *model);
+static gboolean expense_model_insert(ExpenseModel *model, const ExpenseRow *row);
+static gboolean expense_model_remove(ExpenseModel *model, const ExpenseRow *row);
+static gboolean expense_model_update(ExpenseModel *model, const ExpenseRow *old, const ExpenseRow *row);
+static ExpenseIndex *expense_index_new(const GArray *archives, const ExpenseOrder *order, gint category_id,
+                                       const gchar *from_date, const gchar *to_date, const gchar *fts_query);
+static void expense_index_free(gpointer data);
+static void build_expense_index(StmtCache *stmts, ExpenseIndex *index);
+static void expense_row_clear(ExpenseRow *row);
+static void append_order_by(GString *sql, const ExpenseOrder *order);
+
+// Color definitions for pie charts, by dictionary id starting at 1. Ids
+// past the end of a palette, which users added, get generated colors.
 typedef struct {
     double r, g, b;
-    const char *label;
 } ChartColor;
 
 static const ChartColor CATEGORY_COLORS[] = {
-    {0.2, 0.6, 0.9, "Food"},         // Blue
-    {0.9, 0.2, 0.2, "Transport"},    // Red
-    {0.2, 0.8, 0.2, "Entertainment"},// Green
-    {0.9, 0.6, 0.2, "Bills"},        // Orange
-    {0.6, 0.2, 0.9, "Others"}        // Purple
+    {0.2, 0.6, 0.9},  // Food: blue
+    {0.9, 0.2, 0.2},  // Transport: red
+    {0.2, 0.8, 0.2},  // Entertainment: green
+    {0.9, 0.6, 0.2},  // Bills: orange
+    {0.6, 0.2, 0.9}   // Others: purple
 };
 
 static const ChartColor PAYMENT_COLORS[] = {
-    {0.2, 0.7, 0.2, "Cash"},         // Green
-    {0.9, 0.3, 0.3, "Credit Card"},  // Red
-    {0.3, 0.5, 0.9, "Debit Card"},   // Blue
-    {0.9, 0.6, 0.2, "UPI"}           // Orange
+    {0.2, 0.7, 0.2},  // Cash: green
+    {0.9, 0.3, 0.3},  // Credit Card: red
+    {0.3, 0.5, 0.9},  // Debit Card: blue
+    {0.9, 0.6, 0.2}   // UPI: orange
+};
+
+// The built-in dictionary entries, with the ids of the palette colors
+#define SQL_SEED_CATEGORIES \
+    "INSERT OR IGNORE INTO categories (id, name) VALUES " \
+    "(1, 'Food'), (2, 'Transport'), (3, 'Entertainment'), (4, 'Bills'), (5, 'Others');"
+#define SQL_SEED_PAYMENT_TYPES \
+    "INSERT OR IGNORE INTO payment_types (id, name) VALUES " \
+    "(1, 'Cash'), (2, 'Credit Card'), (3, 'Debit Card'), (4, 'UPI');"
+
+// Maximum number of ranked matches a description search shows. They fit
+// one row block, which build_expense_index reads as it ranks them.
+#define SEARCH_RESULT_LIMIT 200
+G_STATIC_ASSERT(SEARCH_RESULT_LIMIT <= EXPENSE_BLOCK_ROWS);
+
+// Suggestions the description entry's completion shows at most
+#define DESCRIPTION_SUGGESTIONS 8
+
+// Newest matches a search from the list ranks, which bounds its cost
+// however many expenses match a short prefix
+#define SEARCH_RANK_WINDOW 2000
+
+// CSV export target, written under EXPORT_FILE ".part" until complete
+#define EXPORT_FILE "expenses.csv"
+
+// stdio buffer for the export file
+#define EXPORT_BUFFER_SIZE (1 << 20)
+
+// Rows between the exporter's checks for cancellation and progress updates
+#define EXPORT_CHECK_ROWS 4096
+
+// Rows the importer inserts per transaction
+#define IMPORT_BATCH_ROWS 50000
+
+// Rejected rows the import summary lists individually
+#define IMPORT_MAX_REPORTED_ERRORS 20
+
+// Pages a backup copies per main loop idle callback; at the default 4 KiB
+// page size a step is a 1 MiB copy, short enough not to hold up the UI
+#define BACKUP_STEP_PAGES 256
+
+// How often a backup paused for an import or another connection's lock
+// tries again, and how often the schedule checks whether a backup is due
+#define BACKUP_WAIT_MS 500
+#define BACKUP_CHECK_SECONDS 60
+
+// Archives a connection attaches at most, one below SQLite's default
+// limit on attached databases since VACUUM attaches one of its own, and
+// the closed years each archive holds: together ninety of them
+#define ARCHIVE_MAX_ATTACHED 9
+#define ARCHIVE_SPAN_YEARS 10
+
+// Benchmark defaults: ledger file, its size, runs per hot path, and how
+// many days back the synthetic expenses reach
+#define BENCHMARK_FILE "benchmark.db"
+#define BENCHMARK_ROWS 100000
+#define BENCHMARK_ITERATIONS 5
+#define BENCHMARK_SPAN_DAYS (3 * 365)
+
+#define SQL_IMPORT_EXPENSE "INSERT INTO expenses (amount, description, category_id, payment_type_id, date) VALUES (?, ?, ?, ?, ?)"
+
+// Rows shown per page of the expense table
+#define PAGE_SIZE 100
+
+// Statements run on every add, edit, delete, budget update and chart draw.
+// They are prepared once at startup; see stmt_cache_warm.
+#define SQL_INSERT_EXPENSE "INSERT INTO expenses (amount, description, category_id, payment_type_id, date) VALUES (?, ?, ?, ?, date('now', 'localtime'))"
+#define SQL_UPDATE_EXPENSE "UPDATE expenses SET amount = ?, description = ?, category_id = ?, payment_type_id = ?, date = ? WHERE id = ?"
+#define SQL_DELETE_EXPENSE "DELETE FROM expenses WHERE id = ?"
+#define SQL_SELECT_EXPENSE_ROW "SELECT description, amount, payment_type_id, date, category_id FROM expenses WHERE id = ?"
+#define SQL_SELECT_BUDGET "SELECT amount FROM budget WHERE month = ?"
+#define SQL_BUDGET_EXISTS "SELECT id FROM budget WHERE month = ?"
+#define SQL_INSERT_BUDGET "INSERT INTO budget (amount, month) VALUES (?, ?)"
+#define SQL_MONTH_SPEND "SELECT SUM(total) FROM month_totals WHERE month = ?"
+#define SQL_CATEGORY_TOTALS "SELECT category_id, total FROM category_totals"
+#define SQL_PAYMENT_TOTALS "SELECT payment_type_id, total FROM payment_totals"
+#define SQL_MONTH_TOTALS "SELECT month, SUM(total), SUM(n) FROM month_totals GROUP BY month ORDER BY month"
+#define SQL_MONTH_CATEGORY_TOTALS \
+    "SELECT category_id, SUM(total) FROM month_totals WHERE month = ? GROUP BY category_id"
+#define SQL_MONTH_PAYMENT_TOTALS \
+    "SELECT payment_type_id, SUM(total) FROM month_totals WHERE month = ? GROUP BY payment_type_id"
+#define SQL_DAY_TOTALS "SELECT day, total FROM day_totals ORDER BY day"
+#define SQL_SELECT_COLUMNS "SELECT id, amount, day, category_id, payment_type_id FROM ledger ORDER BY id"
+#define SQL_SELECT_EXPENSE_COLUMNS "SELECT amount, day, category_id, payment_type_id FROM expenses WHERE id = ?"
+#define SQL_DESCRIPTION_USAGE \
+    "SELECT description, category_id, payment_type_id, COUNT(*), MAX(id) FROM expenses " \
+    "WHERE description <> '' GROUP BY description, category_id, payment_type_id"
+#define SQL_SELECT_EXPENSES_AFTER "SELECT description, category_id, payment_type_id FROM expenses WHERE id > ?"
+
+// Prepared at startup on the UI connection
+static const char *const HOT_STATEMENTS[] = {
+    SQL_INSERT_EXPENSE,
+    SQL_UPDATE_EXPENSE,
+    SQL_DELETE_EXPENSE,
+    SQL_SELECT_EXPENSE_ROW,
+    SQL_SELECT_BUDGET,
+    SQL_BUDGET_EXISTS,
+    SQL_INSERT_BUDGET
+};
+
+// Prepared at startup on the DB worker connection
+static const char *const WORKER_STATEMENTS[] = {
+    SQL_MONTH_SPEND,
+    SQL_CATEGORY_TOTALS,
+    SQL_PAYMENT_TOTALS,
+    SQL_DAY_TOTALS
 };
 
 // Function declarations
 static void init_database(sqlite3 *db);
+static gboolean database_is_current(sqlite3 *db);
+static gboolean table_exists(sqlite3 *db, const char *name);
+static gboolean column_exists(sqlite3 *db, const char *table, const char *column);
+static gboolean is_valid_date(const char *text);
+static void init_totals(sqlite3 *db);
+static void migrate_to_dictionaries(sqlite3 *db);
+static void dictionary_load(Dictionary *dictionary, sqlite3 *db, const char *table);
+static const char *dictionary_name(const Dictionary *dictionary, gint id);
+static gint dictionary_lookup(const Dictionary *dictionary, const char *name);
+static gint dictionary_add(Dictionary *dictionary, sqlite3 *db, const char *name);
+static void dictionary_fill_combo(const Dictionary *dictionary, GtkWidget *combo);
+static void dictionary_set_active(const Dictionary *dictionary, GtkWidget *combo, gint id);
+static void dictionary_clear(Dictionary *dictionary);
+static void chart_color(const ChartColor *palette, int n_palette, gint id, double *r, double *g, double *b);
+static ExpenseColumns *expense_columns_load(StmtCache *stmts);
+static void expense_columns_free(ExpenseColumns *columns);
+static double expense_columns_sum(const ExpenseColumns *columns, const ColumnFilter *filter);
+static void expense_columns_group(const ExpenseColumns *columns, const ColumnFilter *filter,
+                                  gboolean by_payment_type, GArray *totals);
+static gboolean month_day_range(const char *month, gint32 *first_day, gint32 *last_day);
+static gint32 date_to_day(const GDate *date);
+static gint32 date_string_to_day(const gchar *text, gint32 fallback);
+static void day_to_date(gint32 day, GDate *date);
+static void load_expense_columns(AppData *app);
+static gboolean sync_expense_columns(AppData *app);
+static void load_descriptions(AppData *app);
+static void description_index_free(DescriptionIndex *index);
+static void stmt_cache_init(StmtCache *cache, sqlite3 *db);
+static void stmt_cache_warm(StmtCache *cache, const char *const *sqls, gsize n_sqls);
+static sqlite3_stmt *stmt_cache_get(StmtCache *cache, const char *sql);
+static void stmt_cache_clear(StmtCache *cache);
+static void storage_profile_load(StorageProfile *profile);
+static void storage_profile_report(sqlite3 *db);
+static void storage_profile_clear(StorageProfile *profile);
+static sqlite3 *open_connection(const StorageProfile *profile);
+static gboolean find_archives(StorageProfile *profile);
+static gboolean attach_archives(sqlite3 *db, const StorageProfile *profile);
+static int archive_closed_years(sqlite3 *db, StorageProfile *profile);
+static void stats_record(const char *site, gint64 elapsed_ns);
+static void stats_record_since(const char *site, gint64 start_us);
+static GString *stats_report(void);
+static void stats_dump(void);
+static gboolean on_stats_signal(gpointer data);
+static DbWorker *db_worker_new(const StorageProfile *profile);
+static void db_worker_submit(DbWorker *worker, AppData *app, int kind, DbJobRun run,
+                             DbJobDone done, gpointer data, GDestroyNotify free_data);
+static void db_worker_free(DbWorker *worker);
 static void add_expense(GtkButton *button, AppData *app);
 static void update_charts(AppData *app);
+static void update_chart_totals(AppData *app);
 static void export_to_excel(GtkButton *button, AppData *app);
+static void cancel_export(GtkButton *button, AppData *app);
+static void export_wait(AppData *app);
+static void import_csv(GtkButton *button, AppData *app);
+static void import_wait(AppData *app);
+static void backup_now(GtkButton *button, AppData *app);
+static gboolean backup_tick(gpointer data);
+static gint64 newest_backup_time(const StorageProfile *profile);
+static void backup_wait(AppData *app);
 static void set_monthly_budget(GtkButton *button, AppData *app);
 static void update_expense_table(AppData *app);
 static void init_filter_section(AppData *app, GtkWidget *main_box);
 static void filter_changed(GtkComboBox *combo, AppData *app);
+static void add_date_filter(AppData *app, GtkWidget *main_box);
+static void date_filter_changed(GtkWidget *widget, AppData *app);
 static void search_changed(GtkSearchEntry *entry, AppData *app);
 static void update_expense_list(AppData *app, const gchar *category, const gchar *search_text);
 static void init_expense_table(AppData *app, GtkWidget *main_box);
+static void sort_column_clicked(GtkTreeViewColumn *column, AppData *app);
 static void prev_page(GtkButton *button, AppData *app);
 static void next_page(GtkButton *button, AppData *app);
+static void init_pagination_section(AppData *app, GtkWidget *main_box);
+static void refresh_expense_view(AppData *app);
+static void expense_added(AppData *app, gint id);
+static void expense_edited(AppData *app, const ExpenseRow *old);
+static void expense_deleted(AppData *app, const ExpenseRow *old);
+static void update_page_label(AppData *app);
+static void update_page_count(AppData *app);
 static void init_budget_section(AppData *app, GtkWidget *main_box);
 static void load_current_budget(AppData *app);
 static void update_budget_progress(AppData *app);
 static void init_analytics_section(AppData *app, GtkWidget *main_box);
+static void init_trend_chart(AppData *app, GtkWidget *main_box);
+static void init_diagnostics_section(AppData *app, GtkWidget *main_box);
 static gboolean draw_category_chart(GtkWidget *widget, cairo_t *cr, AppData *app);
 static gboolean draw_payment_chart(GtkWidget *widget, cairo_t *cr, AppData *app);
+static gboolean draw_trend_chart(GtkWidget *widget, cairo_t *cr, AppData *app);
+static void update_trend_series(AppData *app);
+static void day_series_free(DaySeries *series);
+static void chart_cache_invalidate(ChartCache *cache);
 static void init_form_section(AppData *app, GtkWidget *main_box);
+static void add_category(GtkButton *button, AppData *app);
+static void add_payment_type(GtkButton *button, AppData *app);
 static void show_edit_dialog(AppData *app, gint id, GtkTreeIter iter);
 static void edit_expense(GtkButton *button, AppData *app);
 static void delete_expense(GtkButton *button, AppData *app);
 static void reset_selection(AppData *app);
 static void on_expense_selected(GtkTreeSelection *selection, AppData *app);
+static int run_benchmark(int argc, char *argv[]);
+static int run_report(int argc, char *argv[]);
+static int run_archive(int argc, char *argv[]);
+
+// Subcommands run without a display and never initialize GTK
+static const struct {
+    const char *name;
+    int (*run)(int argc, char *argv[]);
+} SUBCOMMANDS[] = {
+    {"benchmark", run_benchmark},
+    {"months", run_report},
+    {"categories", run_report},
+    {"payments", run_report},
+    {"budget", run_report},
+    {"list", run_report},
+    {"archive", run_archive}
+};
 
 int main(int argc, char *argv[]) {
+    for (gsize i = 0; argc > 1 && i < G_N_ELEMENTS(SUBCOMMANDS); i++) {
+        if (strcmp(argv[1], SUBCOMMANDS[i].name) == 0) {
+            return SUBCOMMANDS[i].run(argc - 1, argv + 1);
+        }
+    }
+
     gtk_init(&argc, &argv);
     
-    AppData app;
+    AppData app = {0};
     
     // Create main window
     app.window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
@@ -101,12 +679,38 @@ int main(int argc, char *argv[]) {
     gtk_container_add(GTK_CONTAINER(app.window), main_box);
 
     // Initialize database
-    if (sqlite3_open("expenses.db", &app.db) != SQLITE_OK) {
-        g_print("Cannot open database: %s\n", sqlite3_errmsg(app.db));
+    storage_profile_load(&app.storage);
+    app.db = find_archives(&app.storage) ? open_connection(&app.storage) : NULL;
+    if (app.db == NULL) {
         return 1;
     }
+    storage_profile_report(app.db);
     init_database(app.db);
 
+    // Closed years move out before any other connection opens, so that
+    // every one of them attaches the new archives
+    if (app.storage.archive_keep_years > 0) {
+        archive_closed_years(app.db, &app.storage);
+    }
+    stmt_cache_init(&app.stmts, app.db);
+    stmt_cache_warm(&app.stmts, HOT_STATEMENTS, G_N_ELEMENTS(HOT_STATEMENTS));
+
+    dictionary_load(&app.categories, app.db, "categories");
+    dictionary_load(&app.payment_types, app.db, "payment_types");
+    app.category_totals = g_array_new(FALSE, TRUE, sizeof(double));
+    app.payment_totals = g_array_new(FALSE, TRUE, sizeof(double));
+
+    // Start the DB worker once the schema exists
+    app.worker = db_worker_new(&app.storage);
+    if (app.worker == NULL) {
+        return 1;
+    }
+    app.column_changes = g_array_new(FALSE, FALSE, sizeof(gint));
+    if (app.storage.columnar_cache) {
+        load_expense_columns(&app);
+    }
+    load_descriptions(&app);
+
     // Initialize all sections in order
     init_form_section(&app, main_box);           // Your existing form section
     init_filter_section(&app, main_box);         // Filter and search section
@@ -118,12 +722,15 @@ int main(int argc, char *argv[]) {
 
     // Initialize the expense table and add it to the scrolled window
     init_expense_table(&app, scrolled_window); // Pass the scrolled window
+    init_pagination_section(&app, main_box);     // Prev/next page controls
 
     init_budget_section(&app, main_box);         // Budget section
     init_analytics_section(&app, main_box);      // Pie charts
+    init_diagnostics_section(&app, main_box);    // Call site statistics
 
     // Connect signals
     g_signal_connect(app.window, "destroy", G_CALLBACK(gtk_main_quit), NULL);
+    g_unix_signal_add(SIGUSR1, on_stats_signal, NULL);
     
     // Show all widgets
     gtk_widget_show_all(app.window);
@@ -132,46 +739,178 @@ int main(int argc, char *argv[]) {
     update_expense_list(&app, "All", "");
     update_budget_progress(&app);
     update_charts(&app);
+
+    // Scheduled backups; the first starts at once if the newest is too old
+    if (app.storage.backup_interval_min > 0) {
+        app.last_backup = newest_backup_time(&app.storage);
+        backup_tick(&app);
+        app.backup_timer = g_timeout_add_seconds(BACKUP_CHECK_SECONDS, backup_tick, &app);
+    }
     
     gtk_main();
     
     // Cleanup
+    if (app.stats_source != 0) {
+        g_source_remove(app.stats_source);
+    }
+    if (app.backup_timer != 0) {
+        g_source_remove(app.backup_timer);
+    }
+    g_free(app.filter_fts_query);
+    g_free(app.filter_from_date);
+    g_free(app.filter_to_date);
+    export_wait(&app);
+    import_wait(&app);
+    backup_wait(&app);
+    db_worker_free(app.worker);
+    if (app.columns != NULL) {
+        expense_columns_free(app.columns);
+    }
+    g_array_free(app.column_changes, TRUE);
+    description_index_free(app.descriptions);
+    if (app.trend_series != NULL) {
+        day_series_free(app.trend_series);
+    }
+    chart_cache_invalidate(&app.category_cache);
+    chart_cache_invalidate(&app.payment_cache);
+    g_array_free(app.category_totals, TRUE);
+    g_array_free(app.payment_totals, TRUE);
+    g_object_unref(app.expense_model);
+    g_print("Statement cache: %u hits, %u misses, %u statements\n",
+            app.stmts.hits, app.stmts.misses, g_hash_table_size(app.stmts.stmts));
+    stats_dump();
+    stmt_cache_clear(&app.stmts);
     sqlite3_close(app.db);
+    storage_profile_clear(&app.storage);
+    dictionary_clear(&app.categories);
+    dictionary_clear(&app.payment_types);
     
     return 0;
 }
 
 // Function to initialize the expense table
 static void init_expense_table(AppData *app, GtkWidget *scrolled_window) {
-    app->expense_store = gtk_list_store_new(4, G_TYPE_INT, G_TYPE_STRING, G_TYPE_DOUBLE, G_TYPE_STRING); // ID, Description, Amount, Payment Type
+    // Start with an empty model; update_expense_list installs the real one
+    app->expense_model = expense_model_new(app->worker, &app->stmts, &app->categories,
+                                           &app->payment_types, expense_index_new(NULL, NULL, 0, NULL, NULL, NULL));
 
-    app->expense_table = gtk_tree_view_new_with_model(GTK_TREE_MODEL(app->expense_store));
+    app->expense_table = gtk_tree_view_new_with_model(GTK_TREE_MODEL(app->expense_model));
     GtkCellRenderer *renderer = gtk_cell_renderer_text_new();
 
     // Add columns
-    gtk_tree_view_insert_column_with_attributes(GTK_TREE_VIEW(app->expense_table), -1, "ID", renderer, "text", 0, NULL);
-    gtk_tree_view_insert_column_with_attributes(GTK_TREE_VIEW(app->expense_table), -1, "Description", renderer, "text", 1, NULL);
-    gtk_tree_view_insert_column_with_attributes(GTK_TREE_VIEW(app->expense_table), -1, "Amount", renderer, "text", 2, NULL);
-    gtk_tree_view_insert_column_with_attributes(GTK_TREE_VIEW(app->expense_table), -1, "Payment Type", renderer, "text", 3, NULL);
+    gtk_tree_view_insert_column_with_attributes(GTK_TREE_VIEW(app->expense_table), -1, "ID", renderer, "text", EXPENSE_COL_ID, NULL);
+    gtk_tree_view_insert_column_with_attributes(GTK_TREE_VIEW(app->expense_table), -1, "Description", renderer, "text", EXPENSE_COL_DESCRIPTION, NULL);
+    gtk_tree_view_insert_column_with_attributes(GTK_TREE_VIEW(app->expense_table), -1, "Amount", renderer, "text", EXPENSE_COL_AMOUNT, NULL);
+    gtk_tree_view_insert_column_with_attributes(GTK_TREE_VIEW(app->expense_table), -1, "Category", renderer, "text", EXPENSE_COL_CATEGORY, NULL);
+    gtk_tree_view_insert_column_with_attributes(GTK_TREE_VIEW(app->expense_table), -1, "Payment Type", renderer, "text", EXPENSE_COL_PAYMENT_TYPE, NULL);
+    gtk_tree_view_insert_column_with_attributes(GTK_TREE_VIEW(app->expense_table), -1, "Date", renderer, "text", EXPENSE_COL_DATE, NULL);
+
+    // Fixed-size columns let the view compute row heights without asking
+    // the model for every row, so only the visible rows are ever fetched.
+    // Clicking a header other than ID sorts the list through SQL; the
+    // model is not a GtkTreeSortable, which would sort rows in memory.
+    const int column_widths[] = {60, 300, 100, 140, 140, 120};
+    const gint column_sorts[] = {-1, EXPENSE_SORT_DESCRIPTION, EXPENSE_SORT_AMOUNT,
+                                 EXPENSE_SORT_CATEGORY, EXPENSE_SORT_PAYMENT_TYPE, EXPENSE_SORT_DATE};
+    for (int i = 0; i < 6; i++) {
+        GtkTreeViewColumn *column = gtk_tree_view_get_column(GTK_TREE_VIEW(app->expense_table), i);
+        gtk_tree_view_column_set_sizing(column, GTK_TREE_VIEW_COLUMN_FIXED);
+        gtk_tree_view_column_set_fixed_width(column, column_widths[i]);
+        gtk_tree_view_column_set_resizable(column, TRUE);
+        if (column_sorts[i] >= 0) {
+            g_object_set_data(G_OBJECT(column), "sort-column", GINT_TO_POINTER(column_sorts[i]));
+            gtk_tree_view_column_set_clickable(column, TRUE);
+            g_signal_connect(column, "clicked", G_CALLBACK(sort_column_clicked), app);
+        }
+        if (column_sorts[i] == app->order.column) {
+            app->sorted_column = column;
+            gtk_tree_view_column_set_sort_indicator(column, TRUE);
+            gtk_tree_view_column_set_sort_order(column, GTK_SORT_DESCENDING);
+        }
+    }
+    gtk_tree_view_set_fixed_height_mode(GTK_TREE_VIEW(app->expense_table), TRUE);
+
+    // Track the selected row for the edit and delete buttons
+    app->selected_expense_id = -1;
+    app->selection = gtk_tree_view_get_selection(GTK_TREE_VIEW(app->expense_table));
+    g_signal_connect(app->selection, "changed", G_CALLBACK(on_expense_selected), app);
+
+    // Keep the page label in step with scrolling
+    GtkAdjustment *vadjustment = gtk_scrolled_window_get_vadjustment(GTK_SCROLLED_WINDOW(scrolled_window));
+    g_signal_connect_swapped(vadjustment, "value-changed", G_CALLBACK(update_page_label), app);
 
     // Add the tree view to the scrolled window
     gtk_container_add(GTK_CONTAINER(scrolled_window), app->expense_table);
 }
 
+// Dates are stored as YYYY-MM-DD text and, derived from that, as a day
+// number (days since 1970-01-01) that compares and indexes as an integer.
+// Text that is not a date gets a NULL day.
+#define EXPENSES_DAY_COLUMN \
+    "day INTEGER GENERATED ALWAYS AS (CAST(julianday(date) - 2440587.5 AS INTEGER)) VIRTUAL"
+
+#define EXPENSES_COLUMNS \
+    "id INTEGER PRIMARY KEY AUTOINCREMENT," \
+    "amount REAL NOT NULL," \
+    "description TEXT," \
+    "category_id INTEGER NOT NULL REFERENCES categories(id)," \
+    "payment_type_id INTEGER NOT NULL REFERENCES payment_types(id)," \
+    "date TEXT NOT NULL," \
+    EXPENSES_DAY_COLUMN
+
+// An archive's copy of expenses. Its rows keep their ids, which the
+// database's AUTOINCREMENT never hands out again, so ids stay unique
+// across the partitions.
+#define ARCHIVE_COLUMNS \
+    "id INTEGER PRIMARY KEY," \
+    "amount REAL NOT NULL," \
+    "description TEXT," \
+    "category_id INTEGER NOT NULL," \
+    "payment_type_id INTEGER NOT NULL," \
+    "date TEXT NOT NULL," \
+    EXPENSES_DAY_COLUMN
+
+// Columns every partition has, in the order the ledger view lists them
+#define LEDGER_COLUMNS "id, amount, description, category_id, payment_type_id, date, day"
+
+// Rebuilds expenses with dictionary ids in place of the category and
+// payment type names, keeping every row's id so the full-text index stays
+// valid. Names not in the dictionaries yet are added to them. Dropping the
+// old table drops its indexes and triggers, and the summary tables are
+// dropped too since they were keyed by name; init_database and
+// init_totals then recreate them all.
+static void migrate_to_dictionaries(sqlite3 *db) {
+    char *err_msg = 0;
+    const char *sql_migrate =
+        "BEGIN;"
+        "INSERT OR IGNORE INTO categories (name) SELECT DISTINCT category FROM expenses;"
+        "INSERT OR IGNORE INTO payment_types (name) SELECT DISTINCT payment_type FROM expenses;"
+        "CREATE TABLE expenses_new (" EXPENSES_COLUMNS ");"
+        "INSERT INTO expenses_new (id, amount, description, category_id, payment_type_id, date) "
+        "SELECT e.id, e.amount, e.description, c.id, p.id, e.date FROM expenses e "
+        "JOIN categories c ON c.name = e.category "
+        "JOIN payment_types p ON p.name = e.payment_type;"
+        "DROP TABLE expenses;"
+        "ALTER TABLE expenses_new RENAME TO expenses;"
+        "DROP TABLE IF EXISTS category_totals;"
+        "DROP TABLE IF EXISTS payment_totals;"
+        "DROP TABLE IF EXISTS month_totals;"
+        "COMMIT;";
+
+    if (sqlite3_exec(db, sql_migrate, 0, 0, &err_msg) != SQLITE_OK) {
+        g_print("SQL error: %s\n", err_msg);
+        sqlite3_free(err_msg);
+        sqlite3_exec(db, "ROLLBACK", 0, 0, NULL);
+    }
+}
+
 // Add this function to initialize the database tables
 static void init_database(sqlite3 *db) {
     char *err_msg = 0;
     
     // Create expenses table
     const char *sql_expenses = 
-        "CREATE TABLE IF NOT EXISTS expenses ("
-        "id INTEGER PRIMARY KEY AUTOINCREMENT,"
-        "amount REAL NOT NULL,"
-        "description TEXT,"
-        "category TEXT NOT NULL,"
-        "payment_type TEXT NOT NULL,"
-        "date TEXT NOT NULL"
-        ");";
+        "CREATE TABLE IF NOT EXISTS expenses (" EXPENSES_COLUMNS ");";
     
     // Create budget table
     const char *sql_budget = 
@@ -181,866 +920,6333 @@ static void init_database(sqlite3 *db) {
         "month TEXT NOT NULL UNIQUE"
         ");";
     
+    // Create the category and payment type dictionaries
+    const char *sql_dictionaries =
+        "CREATE TABLE IF NOT EXISTS categories ("
+        "id INTEGER PRIMARY KEY,"
+        "name TEXT NOT NULL UNIQUE"
+        ");"
+        "CREATE TABLE IF NOT EXISTS payment_types ("
+        "id INTEGER PRIMARY KEY,"
+        "name TEXT NOT NULL UNIQUE"
+        ");"
+        SQL_SEED_CATEGORIES
+        SQL_SEED_PAYMENT_TYPES;
+
+    if (sqlite3_exec(db, sql_dictionaries, 0, 0, &err_msg) != SQLITE_OK) {
+        g_print("SQL error: %s\n", err_msg);
+        sqlite3_free(err_msg);
+    }
+
     if (sqlite3_exec(db, sql_expenses, 0, 0, &err_msg) != SQLITE_OK) {
         g_print("SQL error: %s\n", err_msg);
         sqlite3_free(err_msg);
     }
+
+    // Databases from before the dictionaries store names in every row
+    if (column_exists(db, "expenses", "category")) {
+        migrate_to_dictionaries(db);
+    }
     
     if (sqlite3_exec(db, sql_budget, 0, 0, &err_msg) != SQLITE_OK) {
         g_print("SQL error: %s\n", err_msg);
         sqlite3_free(err_msg);
     }
-}
 
-// Add this function to initialize the form section
-static void init_form_section(AppData *app, GtkWidget *main_box) {
-    GtkWidget *form_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
-    
-    // Amount entry
-    app->amount_entry = gtk_entry_new();
-    gtk_entry_set_placeholder_text(GTK_ENTRY(app->amount_entry), "Amount");
-    
-    // Description entry
-    app->description_entry = gtk_entry_new();
-    gtk_entry_set_placeholder_text(GTK_ENTRY(app->description_entry), "Description");
-    
-    // Category dropdown
-    app->category_combo = gtk_combo_box_text_new();
-    const char *categories[] = {"Food", "Transport", "Entertainment", "Bills", "Others"};
-    for (int i = 0; i < 5; i++) {
-        gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(app->category_combo), categories[i]);
-    }
-    
-    // Payment type dropdown
-    app->payment_type_combo = gtk_combo_box_text_new();
-    const char *payment_types[] = {"Cash", "Credit Card", "Debit Card", "UPI"};
-    for (int i = 0; i < 4; i++) {
-        gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(app->payment_type_combo), payment_types[i]);
+    // Databases created before the day column get it added; being a
+    // generated column it needs no backfill
+    if (!column_exists(db, "expenses", "day")) {
+        if (sqlite3_exec(db, "ALTER TABLE expenses ADD COLUMN " EXPENSES_DAY_COLUMN,
+                         0, 0, &err_msg) != SQLITE_OK) {
+            g_print("SQL error: %s\n", err_msg);
+            sqlite3_free(err_msg);
+        }
     }
-    
-    // Add expense button
-    GtkWidget *add_button = gtk_button_new_with_label("Add Expense");
-    GtkStyleContext *context = gtk_widget_get_style_context(add_button);
-    gtk_style_context_add_class(context, "suggested-action");
-    
-    // Pack form elements
-    gtk_box_pack_start(GTK_BOX(form_box), app->amount_entry, TRUE, TRUE, 5);
-    gtk_box_pack_start(GTK_BOX(form_box), app->description_entry, TRUE, TRUE, 5);
-    gtk_box_pack_start(GTK_BOX(form_box), app->category_combo, TRUE, TRUE, 5);
-    gtk_box_pack_start(GTK_BOX(form_box), app->payment_type_combo, TRUE, TRUE, 5);
-    gtk_box_pack_start(GTK_BOX(form_box), add_button, FALSE, FALSE, 5);
-    
-    // Connect add button signal
-    g_signal_connect(add_button, "clicked", G_CALLBACK(add_expense), app);
-    
-    // Add form box to main box
-    gtk_box_pack_start(GTK_BOX(main_box), form_box, FALSE, FALSE, 5);
-}
 
-static void add_expense(GtkButton *button, AppData *app) {
-    const gchar *amount_str = gtk_entry_get_text(GTK_ENTRY(app->amount_entry));
-    const gchar *description = gtk_entry_get_text(GTK_ENTRY(app->description_entry));
-    const gchar *category = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(app->category_combo));
-    const gchar *payment_type = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(app->payment_type_combo));
+    // Indexes backing the filtered expense list: the category index also
+    // returns rows already in date order. Each header sort has an index on
+    // (column, date), and one on (category_id, column, date) for the same
+    // sort within a category; category order shares the category index.
+    // Day ranges, such as a month, are range scans on idx_expenses_day.
+    const char *sql_indexes =
+        "CREATE INDEX IF NOT EXISTS idx_expenses_date ON expenses(date);"
+        "CREATE INDEX IF NOT EXISTS idx_expenses_category ON expenses(category_id, date);"
+        "CREATE INDEX IF NOT EXISTS idx_expenses_amount ON expenses(amount, date);"
+        "CREATE INDEX IF NOT EXISTS idx_expenses_description ON expenses(description, date);"
+        "CREATE INDEX IF NOT EXISTS idx_expenses_payment_type ON expenses(payment_type_id, date);"
+        "CREATE INDEX IF NOT EXISTS idx_expenses_category_amount ON expenses(category_id, amount, date);"
+        "CREATE INDEX IF NOT EXISTS idx_expenses_category_description "
+        "ON expenses(category_id, description, date);"
+        "CREATE INDEX IF NOT EXISTS idx_expenses_category_payment_type "
+        "ON expenses(category_id, payment_type_id, date);"
+        "CREATE INDEX IF NOT EXISTS idx_expenses_day ON expenses(day);";
 
-    // Validate input
-    if (strlen(amount_str) == 0 || category == NULL || payment_type == NULL) {
-        GtkWidget *dialog = gtk_message_dialog_new(GTK_WINDOW(app->window),
-            GTK_DIALOG_DESTROY_WITH_PARENT,
-            GTK_MESSAGE_ERROR,
-            GTK_BUTTONS_CLOSE,
-            "Please fill in all required fields (Amount, Category, Payment Type)");
-        gtk_dialog_run(GTK_DIALOG(dialog));
-        gtk_widget_destroy(dialog);
-        return;
+    if (sqlite3_exec(db, sql_indexes, 0, 0, &err_msg) != SQLITE_OK) {
+        g_print("SQL error: %s\n", err_msg);
+        sqlite3_free(err_msg);
     }
 
-    // Add to database
-    sqlite3_stmt *stmt;
-    const char *sql = "INSERT INTO expenses (amount, description, category, payment_type) VALUES (?, ?, ?, ?)";
-    
-    if (sqlite3_prepare_v2(app->db, sql, -1, &stmt, NULL) == SQLITE_OK) {
-        sqlite3_bind_double(stmt, 1, atof(amount_str));
-        sqlite3_bind_text(stmt, 2, description, -1, SQLITE_STATIC);
-        sqlite3_bind_text(stmt, 3, category, -1, SQLITE_STATIC);
-        sqlite3_bind_text(stmt, 4, payment_type, -1, SQLITE_STATIC);
-        
-        if (sqlite3_step(stmt) == SQLITE_DONE) {
-            // Successfully added the expense
-            gtk_entry_set_text(GTK_ENTRY(app->amount_entry), "");
-            gtk_entry_set_text(GTK_ENTRY(app->description_entry), "");
-            gtk_combo_box_set_active(GTK_COMBO_BOX(app->category_combo), -1);
-            gtk_combo_box_set_active(GTK_COMBO_BOX(app->payment_type_combo), -1);
+    // The keyset seeks of a description sort skip rows whose description
+    // is NULL, so any such old rows get an empty one. Every write path
+    // stores a description; on the index this is a single seek.
+    if (sqlite3_exec(db, "UPDATE expenses SET description = '' WHERE description IS NULL",
+                     0, 0, &err_msg) != SQLITE_OK) {
+        g_print("SQL error: %s\n", err_msg);
+        sqlite3_free(err_msg);
+    }
 
-            // Update the expense table and charts immediately
-            update_expense_list(app, "All", ""); // Refresh the expense list
-            update_budget_progress(app); // Update budget progress
-            update_charts(app); // Update charts
+    // Full-text index over descriptions. It is an external-content table, so
+    // it stores only the index and reads the text back from expenses; the
+    // triggers keep it in step with every insert, update and delete.
+    gboolean fts_is_new = !table_exists(db, "expenses_fts");
+    const char *sql_fts =
+        "CREATE VIRTUAL TABLE IF NOT EXISTS expenses_fts USING fts5("
+        "description, content='expenses', content_rowid='id', prefix='2 3');"
+        "CREATE TRIGGER IF NOT EXISTS expenses_fts_ai AFTER INSERT ON expenses BEGIN "
+        "INSERT INTO expenses_fts(rowid, description) VALUES (new.id, new.description); "
+        "END;"
+        "CREATE TRIGGER IF NOT EXISTS expenses_fts_ad AFTER DELETE ON expenses BEGIN "
+        "INSERT INTO expenses_fts(expenses_fts, rowid, description) VALUES ('delete', old.id, old.description); "
+        "END;"
+        "CREATE TRIGGER IF NOT EXISTS expenses_fts_au AFTER UPDATE OF description ON expenses BEGIN "
+        "INSERT INTO expenses_fts(expenses_fts, rowid, description) VALUES ('delete', old.id, old.description); "
+        "INSERT INTO expenses_fts(rowid, description) VALUES (new.id, new.description); "
+        "END;";
 
-            // Show success message
-            GtkWidget *success_dialog = gtk_message_dialog_new(GTK_WINDOW(app->window),
-                GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
-                GTK_MESSAGE_INFO,
-                GTK_BUTTONS_OK,
-                "Expense added successfully!");
-            gtk_dialog_run(GTK_DIALOG(success_dialog));
-            gtk_widget_destroy(success_dialog);
+    if (sqlite3_exec(db, sql_fts, 0, 0, &err_msg) != SQLITE_OK) {
+        g_print("SQL error: %s\n", err_msg);
+        sqlite3_free(err_msg);
+    } else if (fts_is_new) {
+        // Index the rows that were recorded before the FTS table existed
+        if (sqlite3_exec(db, "INSERT INTO expenses_fts(expenses_fts) VALUES('rebuild')",
+                         0, 0, &err_msg) != SQLITE_OK) {
+            g_print("SQL error: %s\n", err_msg);
+            sqlite3_free(err_msg);
         }
-        sqlite3_finalize(stmt);
     }
+
+    init_totals(db);
 }
-static void init_filter_section(AppData *app, GtkWidget *main_box) {
-    // Create horizontal box for filter section
-    GtkWidget *filter_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
-    
-    // Create filter combo box
-    app->filter_combo = gtk_combo_box_text_new();
-    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(app->filter_combo), "All");
-    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(app->filter_combo), "Food");
-    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(app->filter_combo), "Transport");
-    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(app->filter_combo), "Entertainment");
-    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(app->filter_combo), "Bills");
-    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(app->filter_combo), "Others");
-    gtk_combo_box_set_active(GTK_COMBO_BOX(app->filter_combo), 0);
 
-    // Create search entry
-    app->search_entry = gtk_search_entry_new();
-    gtk_entry_set_placeholder_text(GTK_ENTRY(app->search_entry), "Search expenses...");
+// Whether init_database has nothing left to add, so that a reader such as
+// the report can use the file without upgrading it
+static gboolean database_is_current(sqlite3 *db) {
+    return table_exists(db, "expenses") &&
+           !column_exists(db, "expenses", "category") &&
+           column_exists(db, "expenses", "day") &&
+           table_exists(db, "budget") &&
+           table_exists(db, "expenses_fts") &&
+           table_exists(db, "category_totals") &&
+           table_exists(db, "payment_totals") &&
+           table_exists(db, "month_totals") &&
+           table_exists(db, "day_totals");
+}
 
-    // Create export button with green background
-    app->export_button = gtk_button_new_with_label("Export to Excel");
-    GtkStyleContext *context = gtk_widget_get_style_context(app->export_button);
-    gtk_style_context_add_class(context, "suggested-action");
-    
-    // Add CSS for the export button
-    GtkCssProvider *provider = gtk_css_provider_new();
-    gtk_css_provider_load_from_data(provider,
-        ".suggested-action { background: #28a745; color: white; }"
-        ".suggested-action:hover { background: #218838; }", -1, NULL);
-    gtk_style_context_add_provider(context,
-        GTK_STYLE_PROVIDER(provider),
-        GTK_STYLE_PROVIDER_PRIORITY_APPLICATION);
-    g_object_unref(provider);
+// Statements shared by the aggregate triggers that add a row (r is new or
+// old) to, or take it out of, each summary table. A summary row goes once
+// its count drops to zero, so the tables only ever hold live groups.
+#define TOTALS_MONTH(r) "ifnull(strftime('%Y-%m', " r ".date), '')"
+#define TOTALS_ADD(r) \
+    "INSERT INTO category_totals (category_id, total, n) VALUES (" r ".category_id, " r ".amount, 1) " \
+    "ON CONFLICT(category_id) DO UPDATE SET total = total + excluded.total, n = n + 1; " \
+    "INSERT INTO payment_totals (payment_type_id, total, n) VALUES (" r ".payment_type_id, " r ".amount, 1) " \
+    "ON CONFLICT(payment_type_id) DO UPDATE SET total = total + excluded.total, n = n + 1; " \
+    "INSERT INTO month_totals (month, category_id, payment_type_id, total, n) " \
+    "VALUES (" TOTALS_MONTH(r) ", " r ".category_id, " r ".payment_type_id, " r ".amount, 1) " \
+    "ON CONFLICT(month, category_id, payment_type_id) DO UPDATE SET total = total + excluded.total, n = n + 1; " \
+    "INSERT INTO day_totals (day, total, n) SELECT " r ".day, " r ".amount, 1 WHERE " r ".day IS NOT NULL " \
+    "ON CONFLICT(day) DO UPDATE SET total = total + excluded.total, n = n + 1; "
+#define TOTALS_REMOVE(r) \
+    "UPDATE category_totals SET total = total - " r ".amount, n = n - 1 WHERE category_id = " r ".category_id; " \
+    "DELETE FROM category_totals WHERE category_id = " r ".category_id AND n = 0; " \
+    "UPDATE payment_totals SET total = total - " r ".amount, n = n - 1 WHERE payment_type_id = " r ".payment_type_id; " \
+    "DELETE FROM payment_totals WHERE payment_type_id = " r ".payment_type_id AND n = 0; " \
+    "UPDATE month_totals SET total = total - " r ".amount, n = n - 1 " \
+    "WHERE month = " TOTALS_MONTH(r) " AND category_id = " r ".category_id AND payment_type_id = " r ".payment_type_id; " \
+    "DELETE FROM month_totals " \
+    "WHERE month = " TOTALS_MONTH(r) " AND category_id = " r ".category_id AND payment_type_id = " r ".payment_type_id AND n = 0; " \
+    "UPDATE day_totals SET total = total - " r ".amount, n = n - 1 WHERE day = " r ".day; " \
+    "DELETE FROM day_totals WHERE day = " r ".day AND n = 0; "
 
-    // Pack widgets into filter box
-    gtk_box_pack_start(GTK_BOX(filter_box), app->filter_combo, FALSE, FALSE, 5);
-    gtk_box_pack_start(GTK_BOX(filter_box), app->search_entry, TRUE, TRUE, 5);
-    gtk_box_pack_end(GTK_BOX(filter_box), app->export_button, FALSE, FALSE, 5);
+// Takes deleted rows out of the summary tables. The totals cover the
+// archives too, so archive_year drops it while moving rows out.
+#define SQL_TOTALS_DELETE_TRIGGER \
+    "CREATE TRIGGER IF NOT EXISTS expenses_totals_ad AFTER DELETE ON expenses BEGIN " \
+    TOTALS_REMOVE("old") \
+    "END;"
 
-    // Add filter box to main box
-    gtk_box_pack_start(GTK_BOX(main_box), filter_box, FALSE, FALSE, 5);
+// Summary tables behind the charts and the budget bar. Triggers keep them
+// in step with expenses, so reading a total is a lookup of a few rows
+// rather than a scan of the whole ledger. day_totals leaves out rows whose
+// date is not a date.
+static void init_totals(sqlite3 *db) {
+    char *err_msg = 0;
+    gboolean totals_are_new = !table_exists(db, "month_totals");
+    gboolean day_totals_are_new = !table_exists(db, "day_totals");
 
-    // Connect signals
-    g_signal_connect(app->filter_combo, "changed", G_CALLBACK(filter_changed), app);
-    g_signal_connect(app->search_entry, "search-changed", G_CALLBACK(search_changed), app);
-    g_signal_connect(app->export_button, "clicked", G_CALLBACK(export_to_excel), app);
-}
+    // Triggers from before day_totals existed are recreated to maintain it
+    const char *sql_drop_triggers =
+        "DROP TRIGGER IF EXISTS expenses_totals_ai;"
+        "DROP TRIGGER IF EXISTS expenses_totals_ad;"
+        "DROP TRIGGER IF EXISTS expenses_totals_au;";
 
-static void filter_changed(GtkComboBox *combo, AppData *app) {
-    const gchar *selected_category = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(combo));
-    const gchar *search_text = gtk_entry_get_text(GTK_ENTRY(app->search_entry));
-    update_expense_list(app, selected_category, search_text);
-}
+    const char *sql_totals =
+        "CREATE TABLE IF NOT EXISTS category_totals ("
+        "category_id INTEGER PRIMARY KEY,"
+        "total REAL NOT NULL,"
+        "n INTEGER NOT NULL"
+        ");"
+        "CREATE TABLE IF NOT EXISTS payment_totals ("
+        "payment_type_id INTEGER PRIMARY KEY,"
+        "total REAL NOT NULL,"
+        "n INTEGER NOT NULL"
+        ");"
+        "CREATE TABLE IF NOT EXISTS month_totals ("
+        "month TEXT NOT NULL,"
+        "category_id INTEGER NOT NULL,"
+        "payment_type_id INTEGER NOT NULL,"
+        "total REAL NOT NULL,"
+        "n INTEGER NOT NULL,"
+        "PRIMARY KEY (month, category_id, payment_type_id)"
+        ") WITHOUT ROWID;"
+        "CREATE TABLE IF NOT EXISTS day_totals ("
+        "day INTEGER PRIMARY KEY,"
+        "total REAL NOT NULL,"
+        "n INTEGER NOT NULL"
+        ");"
+        "CREATE TRIGGER IF NOT EXISTS expenses_totals_ai AFTER INSERT ON expenses BEGIN "
+        TOTALS_ADD("new")
+        "END;"
+        SQL_TOTALS_DELETE_TRIGGER
+        "CREATE TRIGGER IF NOT EXISTS expenses_totals_au "
+        "AFTER UPDATE OF amount, category_id, payment_type_id, date ON expenses BEGIN "
+        TOTALS_REMOVE("old")
+        TOTALS_ADD("new")
+        "END;";
 
-static void search_changed(GtkSearchEntry *entry, AppData *app) {
-    const gchar *search_text = gtk_entry_get_text(GTK_ENTRY(entry));
-    const gchar *selected_category = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(app->filter_combo));
-    update_expense_list(app, selected_category, search_text);
+    // Summarise the rows recorded before the tables existed
+    const char *sql_backfill =
+        "INSERT INTO category_totals (category_id, total, n) "
+        "SELECT category_id, SUM(amount), COUNT(*) FROM expenses GROUP BY category_id;"
+        "INSERT INTO payment_totals (payment_type_id, total, n) "
+        "SELECT payment_type_id, SUM(amount), COUNT(*) FROM expenses GROUP BY payment_type_id;"
+        "INSERT INTO month_totals (month, category_id, payment_type_id, total, n) "
+        "SELECT " TOTALS_MONTH("expenses") ", category_id, payment_type_id, SUM(amount), COUNT(*) "
+        "FROM expenses GROUP BY 1, 2, 3;";
+    const char *sql_backfill_days =
+        "INSERT INTO day_totals (day, total, n) "
+        "SELECT day, SUM(amount), COUNT(*) FROM expenses WHERE day IS NOT NULL GROUP BY day;";
+
+    // Tables, triggers and backfill commit together or not at all
+    if (sqlite3_exec(db, "BEGIN", 0, 0, &err_msg) != SQLITE_OK ||
+        (day_totals_are_new && sqlite3_exec(db, sql_drop_triggers, 0, 0, &err_msg) != SQLITE_OK) ||
+        sqlite3_exec(db, sql_totals, 0, 0, &err_msg) != SQLITE_OK ||
+        (totals_are_new && sqlite3_exec(db, sql_backfill, 0, 0, &err_msg) != SQLITE_OK) ||
+        (day_totals_are_new && sqlite3_exec(db, sql_backfill_days, 0, 0, &err_msg) != SQLITE_OK) ||
+        sqlite3_exec(db, "COMMIT", 0, 0, &err_msg) != SQLITE_OK) {
+        g_print("SQL error: %s\n", err_msg);
+        sqlite3_free(err_msg);
+        sqlite3_exec(db, "ROLLBACK", 0, 0, NULL);
+    }
 }
 
+// Uses table_xinfo, which unlike table_info also lists generated columns
+static gboolean column_exists(sqlite3 *db, const char *table, const char *column) {
+    sqlite3_stmt *stmt;
+    gboolean exists = FALSE;
+    const char *sql = "SELECT 1 FROM pragma_table_xinfo(?) WHERE name = ?";
 
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) == SQLITE_OK) {
+        sqlite3_bind_text(stmt, 1, table, -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 2, column, -1, SQLITE_STATIC);
+        exists = sqlite3_step(stmt) == SQLITE_ROW;
+        sqlite3_finalize(stmt);
+    }
+    return exists;
+}
+
+// Accepts only real calendar dates written as YYYY-MM-DD, the form the
+// date ordering and the day column rely on
+static gboolean is_valid_date(const char *text) {
+    static const char form[] = "dddd-dd-dd";
+
+    if (strlen(text) != strlen(form)) {
+        return FALSE;
+    }
+    for (gsize i = 0; form[i] != '\0'; i++) {
+        if (form[i] == 'd' ? !g_ascii_isdigit(text[i]) : text[i] != form[i]) {
+            return FALSE;
+        }
+    }
+    return g_date_valid_dmy((GDateDay)atoi(text + 8), (GDateMonth)atoi(text + 5), (GDateYear)atoi(text));
+}
+
+static gboolean table_exists(sqlite3 *db, const char *name) {
+    sqlite3_stmt *stmt;
+    gboolean exists = FALSE;
+    const char *sql = "SELECT 1 FROM sqlite_master WHERE type IN ('table', 'view') AND name = ?";
 
-    static void update_expense_list(AppData *app, const gchar *category, const gchar *search_text) {
-    // Clear the existing entries
-    gtk_list_store_clear(app->expense_store);
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) == SQLITE_OK) {
+        sqlite3_bind_text(stmt, 1, name, -1, SQLITE_STATIC);
+        exists = sqlite3_step(stmt) == SQLITE_ROW;
+        sqlite3_finalize(stmt);
+    }
+    return exists;
+}
 
-    // Fetch expenses from the database
+static void dictionary_load(Dictionary *dictionary, sqlite3 *db, const char *table) {
     sqlite3_stmt *stmt;
-    const char *sql = "SELECT id, description, amount, payment_type, date FROM expenses"; // Include date in the query
+    gchar *sql = g_strdup_printf("SELECT id, name FROM %s ORDER BY id", table);
 
-    if (sqlite3_prepare_v2(app->db, sql, -1, &stmt, NULL) == SQLITE_OK) {
+    dictionary->table = table;
+    dictionary->names = g_ptr_array_new_with_free_func(g_free);
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) == SQLITE_OK) {
         while (sqlite3_step(stmt) == SQLITE_ROW) {
-            int id = sqlite3_column_int(stmt, 0);
-            const char *description = (const char *)sqlite3_column_text(stmt, 1);
-            double amount = sqlite3_column_double(stmt, 2);
-            const char *payment_type = (const char *)sqlite3_column_text(stmt, 3);
-            const char *date = (const char *)sqlite3_column_text(stmt, 4); // Get the date
-
-            // Add the row to the list store
-            gtk_list_store_append(app->expense_store, &app->selected_iter);
-            gtk_list_store_set(app->expense_store, &app->selected_iter,
-                               0, id,
-                               1, description,
-                               2, amount,
-                               3, payment_type,
-                               4, date, // Set the date directly
-                               -1);
+            gint id = sqlite3_column_int(stmt, 0);
+            if (id >= (gint)dictionary->names->len) {
+                g_ptr_array_set_size(dictionary->names, id + 1);
+            }
+            g_ptr_array_index(dictionary->names, id) = g_strdup((const char *)sqlite3_column_text(stmt, 1));
         }
         sqlite3_finalize(stmt);
+    } else {
+        g_print("SQL error: %s\n", sqlite3_errmsg(db));
     }
+    g_free(sql);
 }
 
-static void export_to_excel(GtkButton *button, AppData *app) {
-    FILE *fp = fopen("expenses.csv", "w");
-    if (!fp) {
-        GtkWidget *dialog = gtk_message_dialog_new(GTK_WINDOW(app->window),
-            GTK_DIALOG_DESTROY_WITH_PARENT,
-            GTK_MESSAGE_ERROR,
-            GTK_BUTTONS_CLOSE,
-            "Failed to create export file");
-        gtk_dialog_run(GTK_DIALOG(dialog));
-        gtk_widget_destroy(dialog);
-        return;
+// Returns the name of id, or NULL if there is no such entry
+static const char *dictionary_name(const Dictionary *dictionary, gint id) {
+    return id > 0 && id < (gint)dictionary->names->len ? g_ptr_array_index(dictionary->names, id) : NULL;
+}
+
+// Returns the id of name, or 0 if there is no such entry. Used for user
+// input only; the dictionaries hold a handful of entries.
+static gint dictionary_lookup(const Dictionary *dictionary, const char *name) {
+    for (guint id = 1; name != NULL && id < dictionary->names->len; id++) {
+        if (g_strcmp0(g_ptr_array_index(dictionary->names, id), name) == 0) {
+            return id;
+        }
     }
+    return 0;
+}
 
-    // Write CSV header
-    fprintf(fp, "Amount,Description,Category,Payment Type,Date\n");
+// Adds a user-defined entry and returns its id, or the id it already has.
+// Returns 0 on error.
+static gint dictionary_add(Dictionary *dictionary, sqlite3 *db, const char *name) {
+    gint id = dictionary_lookup(dictionary, name);
+    if (id > 0) {
+        return id;
+    }
 
-    // Query all expenses
     sqlite3_stmt *stmt;
-    const char *sql = "SELECT * FROM expenses ORDER BY date DESC";
-    
-    if (sqlite3_prepare_v2(app->db, sql, -1, &stmt, NULL) == SQLITE_OK) {
-        while (sqlite3_step(stmt) == SQLITE_ROW) {
-            fprintf(fp, "%s,%s,%s,%s,%s\n",
-                sqlite3_column_text(stmt, 1),  // amount
-                sqlite3_column_text(stmt, 2),  // description
-                sqlite3_column_text(stmt, 3),  // category
-                sqlite3_column_text(stmt, 4),  // payment_type
-                sqlite3_column_text(stmt, 5)); // date
+    gchar *sql = g_strdup_printf("INSERT INTO %s (name) VALUES (?)", dictionary->table);
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) == SQLITE_OK) {
+        sqlite3_bind_text(stmt, 1, name, -1, SQLITE_STATIC);
+        if (sqlite3_step(stmt) == SQLITE_DONE) {
+            id = (gint)sqlite3_last_insert_rowid(db);
+            if (id >= (gint)dictionary->names->len) {
+                g_ptr_array_set_size(dictionary->names, id + 1);
+            }
+            g_ptr_array_index(dictionary->names, id) = g_strdup(name);
+        } else {
+            g_print("SQL error: %s\n", sqlite3_errmsg(db));
         }
         sqlite3_finalize(stmt);
     }
-
-    fclose(fp);
-
-    GtkWidget *dialog = gtk_message_dialog_new(GTK_WINDOW(app->window),
-        GTK_DIALOG_DESTROY_WITH_PARENT,
-        GTK_MESSAGE_INFO,
-        GTK_BUTTONS_CLOSE,
-        "Expenses exported successfully to expenses.csv");
-    gtk_dialog_run(GTK_DIALOG(dialog));
-    gtk_widget_destroy(dialog);
+    g_free(sql);
+    return id;
 }
 
-static void init_budget_section(AppData *app, GtkWidget *main_box) {
-    // Create horizontal box for budget section
-    GtkWidget *budget_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
-    
-    // Create label
-    GtkWidget *budget_label = gtk_label_new("Set Monthly Budget:");
-    
-    // Create budget entry
-    app->budget_entry = gtk_entry_new();
-    gtk_entry_set_placeholder_text(GTK_ENTRY(app->budget_entry), "Enter monthly budget");
-    
-    // Create save budget button with blue background
-    app->budget_button = gtk_button_new_with_label("Save Budget");
-    GtkStyleContext *context = gtk_widget_get_style_context(app->budget_button);
-    gtk_style_context_add_class(context, "suggested-action");
-    
-    // Add CSS for the button
-    GtkCssProvider *provider = gtk_css_provider_new();
-    gtk_css_provider_load_from_data(provider,
-        ".suggested-action { background: #007bff; color: white; }"
-        ".suggested-action:hover { background: #0056b3; }", -1, NULL);
-    gtk_style_context_add_provider(context,
-        GTK_STYLE_PROVIDER(provider),
-        GTK_STYLE_PROVIDER_PRIORITY_APPLICATION);
-    g_object_unref(provider);
+// Appends every entry's name to a GtkComboBoxText, in id order
+static void dictionary_fill_combo(const Dictionary *dictionary, GtkWidget *combo) {
+    for (guint id = 1; id < dictionary->names->len; id++) {
+        const char *name = g_ptr_array_index(dictionary->names, id);
+        if (name != NULL) {
+            gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(combo), name);
+        }
+    }
+}
 
-    // Create progress bar
-    app->progress_bar = gtk_progress_bar_new();
-    gtk_progress_bar_set_show_text(GTK_PROGRESS_BAR(app->progress_bar), TRUE);
-    
-    // Pack widgets
-    gtk_box_pack_start(GTK_BOX(budget_box), budget_label, FALSE, FALSE, 5);
-    gtk_box_pack_start(GTK_BOX(budget_box), app->budget_entry, TRUE, TRUE, 5);
-    gtk_box_pack_start(GTK_BOX(budget_box), app->budget_button, FALSE, FALSE, 5);
-    
-    // Add budget box and progress bar to main box
-    gtk_box_pack_start(GTK_BOX(main_box), budget_box, FALSE, FALSE, 5);
-    gtk_box_pack_start(GTK_BOX(main_box), app->progress_bar, FALSE, FALSE, 5);
+// Selects id in a combo filled by dictionary_fill_combo
+static void dictionary_set_active(const Dictionary *dictionary, GtkWidget *combo, gint id) {
+    gint position = 0;
+    for (gint i = 1; i < id && i < (gint)dictionary->names->len; i++) {
+        if (g_ptr_array_index(dictionary->names, i) != NULL) {
+            position++;
+        }
+    }
+    gtk_combo_box_set_active(GTK_COMBO_BOX(combo), dictionary_name(dictionary, id) != NULL ? position : -1);
+}
 
-    // Connect signals
-    g_signal_connect(app->budget_button, "clicked", G_CALLBACK(set_monthly_budget), app);
+static void dictionary_clear(Dictionary *dictionary) {
+    g_ptr_array_free(dictionary->names, TRUE);
+    dictionary->names = NULL;
+}
 
-    // Load existing budget if any
-    load_current_budget(app);
-    update_budget_progress(app);
+static void finalize_stmt(gpointer stmt) {
+    sqlite3_finalize(stmt);
 }
 
-static void load_current_budget(AppData *app) {
-    time_t t = time(NULL);
-    struct tm *tm = localtime(&t);
-    char month[8];
-    strftime(month, sizeof(month), "%Y-%m", tm);
+static void stmt_cache_init(StmtCache *cache, sqlite3 *db) {
+    cache->db = db;
+    cache->stmts = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, finalize_stmt);
+    cache->hits = 0;
+    cache->misses = 0;
+}
 
-    sqlite3_stmt *stmt;
-    const char *sql = "SELECT amount FROM budget WHERE month = ?";
-    
-    if (sqlite3_prepare_v2(app->db, sql, -1, &stmt, NULL) == SQLITE_OK) {
-        sqlite3_bind_text(stmt, 1, month, -1, SQLITE_STATIC);
-        
-        if (sqlite3_step(stmt) == SQLITE_ROW) {
-            app->monthly_budget = sqlite3_column_double(stmt, 0);
-            char budget_text[32];
-            g_snprintf(budget_text, sizeof(budget_text), "%.2f", app->monthly_budget);
-            gtk_entry_set_text(GTK_ENTRY(app->budget_entry), budget_text);
+// Prepares the statements every session runs so that none of them is
+// parsed and planned the first time a chart draws or a row is saved
+static void stmt_cache_warm(StmtCache *cache, const char *const *sqls, gsize n_sqls) {
+    for (gsize i = 0; i < n_sqls; i++) {
+        if (stmt_cache_get(cache, sqls[i]) == NULL) {
+            g_print("SQL error: %s\n", sqlite3_errmsg(cache->db));
         }
-        
-        sqlite3_finalize(stmt);
     }
+    // Warming is not a hot-path miss
+    cache->misses = 0;
 }
 
-static void set_monthly_budget(GtkButton *button, AppData *app) {
-    const char *budget_text = gtk_entry_get_text(GTK_ENTRY(app->budget_entry));
-    double new_budget = atof(budget_text);
-    
-    if (new_budget <= 0) {
-        GtkWidget *dialog = gtk_message_dialog_new(GTK_WINDOW(app->window),
-            GTK_DIALOG_DESTROY_WITH_PARENT,
-            GTK_MESSAGE_ERROR,
-            GTK_BUTTONS_CLOSE,
-            "Please enter a valid budget amount greater than 0");
-        gtk_dialog_run(GTK_DIALOG(dialog));
-        gtk_widget_destroy(dialog);
-        return;
+// Returns the cached statement for sql, reset and with its bindings
+// cleared, or prepares and caches it on first use. Callers must
+// sqlite3_reset the statement when done instead of finalizing it, so that
+// it releases its read transaction. Returns NULL if sql fails to prepare.
+static sqlite3_stmt *stmt_cache_get(StmtCache *cache, const char *sql) {
+    sqlite3_stmt *stmt = g_hash_table_lookup(cache->stmts, sql);
+
+    if (stmt != NULL) {
+        cache->hits++;
+        sqlite3_reset(stmt);
+        sqlite3_clear_bindings(stmt);
+        return stmt;
     }
 
-    // Get current month
-    time_t t = time(NULL);
-    struct tm *tm = localtime(&t);
-    char month[8];
-    strftime(month, sizeof(month), "%Y-%m", tm);
+    cache->misses++;
+    g_debug("Preparing statement: %s", sql);
+    if (sqlite3_prepare_v3(cache->db, sql, -1, SQLITE_PREPARE_PERSISTENT, &stmt, NULL) != SQLITE_OK) {
+        return NULL;
+    }
+    g_hash_table_insert(cache->stmts, g_strdup(sql), stmt);
+    return stmt;
+}
 
-    // Check if budget already exists for this month
-    sqlite3_stmt *check_stmt;
-    const char *check_sql = "SELECT id FROM budget WHERE month = ?";
-    int budget_exists = 0;
-    
-    if (sqlite3_prepare_v2(app->db, check_sql, -1, &check_stmt, NULL) == SQLITE_OK) {
-        sqlite3_bind_text(check_stmt, 1, month, -1, SQLITE_STATIC);
-        if (sqlite3_step(check_stmt) == SQLITE_ROW) {
-            budget_exists = 1;
+static void stmt_cache_clear(StmtCache *cache) {
+    g_hash_table_destroy(cache->stmts);
+    cache->stmts = NULL;
+}
+
+static const char *const JOURNAL_MODES[] = {"delete", "truncate", "persist", "memory", "wal", "off", NULL};
+static const char *const SYNCHRONOUS_MODES[] = {"off", "normal", "full", "extra", NULL};
+static const char *const TEMP_STORES[] = {"default", "file", "memory", NULL};
+
+// Takes value for a PRAGMA setting only if it is one of choices, since it
+// is spliced into the PRAGMA text
+static void storage_set_choice(gchar **setting, const char *name, const char *value,
+                               const char *const *choices) {
+    for (int i = 0; choices[i] != NULL; i++) {
+        if (g_ascii_strcasecmp(value, choices[i]) == 0) {
+            g_free(*setting);
+            *setting = g_strdup(choices[i]);
+            return;
         }
-        sqlite3_finalize(check_stmt);
     }
+    g_print("Ignoring storage setting %s=%s\n", name, value);
+}
 
-    if (budget_exists) {
-        GtkWidget *dialog = gtk_message_dialog_new(GTK_WINDOW(app->window),
-            GTK_DIALOG_DESTROY_WITH_PARENT,
-            GTK_MESSAGE_ERROR,
-            GTK_BUTTONS_CLOSE,
-            "Budget for this month has already been set");
-        gtk_dialog_run(GTK_DIALOG(dialog));
-        gtk_widget_destroy(dialog);
+static void storage_set_int(gint *setting, const char *name, const char *value) {
+    char *end;
+    gint64 number = g_ascii_strtoll(value, &end, 10);
+
+    if (end == value || *end != '\0' || number < 0 || number > G_MAXINT) {
+        g_print("Ignoring storage setting %s=%s\n", name, value);
         return;
     }
+    *setting = (gint)number;
+}
 
-    // Save new budget
-    sqlite3_stmt *stmt;
-    const char *sql = "INSERT INTO budget (amount, month) VALUES (?, ?)";
-    
-    if (sqlite3_prepare_v2(app->db, sql, -1, &stmt, NULL) == SQLITE_OK) {
-        sqlite3_bind_double(stmt, 1, new_budget);
-        sqlite3_bind_text(stmt, 2, month, -1, SQLITE_STATIC);
-        
-        if (sqlite3_step(stmt) == SQLITE_DONE) {
-            app->monthly_budget = new_budget;
-            update_budget_progress(app);
-            
-            GtkWidget *dialog = gtk_message_dialog_new(GTK_WINDOW(app->window),
-                GTK_DIALOG_DESTROY_WITH_PARENT,
-                GTK_MESSAGE_INFO,
-                GTK_BUTTONS_CLOSE,
-                "Monthly budget set successfully!");
-            gtk_dialog_run(GTK_DIALOG(dialog));
-            gtk_widget_destroy(dialog);
-        }
-        
-        sqlite3_finalize(stmt);
+// Applies one setting, named as in the config file
+static void storage_set(StorageProfile *profile, const char *name, const char *value) {
+    if (strcmp(name, "database") == 0) {
+        g_free(profile->database_file);
+        profile->database_file = g_strdup(value);
+    } else if (strcmp(name, "journal_mode") == 0) {
+        storage_set_choice(&profile->journal_mode, name, value, JOURNAL_MODES);
+    } else if (strcmp(name, "synchronous") == 0) {
+        storage_set_choice(&profile->synchronous, name, value, SYNCHRONOUS_MODES);
+    } else if (strcmp(name, "temp_store") == 0) {
+        storage_set_choice(&profile->temp_store, name, value, TEMP_STORES);
+    } else if (strcmp(name, "cache_kib") == 0) {
+        storage_set_int(&profile->cache_kib, name, value);
+    } else if (strcmp(name, "mmap_mib") == 0) {
+        storage_set_int(&profile->mmap_mib, name, value);
+    } else if (strcmp(name, "busy_timeout_ms") == 0) {
+        storage_set_int(&profile->busy_timeout_ms, name, value);
+    } else if (strcmp(name, "columnar_cache") == 0) {
+        storage_set_int(&profile->columnar_cache, name, value);
+    } else if (strcmp(name, "backup_dir") == 0) {
+        g_free(profile->backup_dir);
+        profile->backup_dir = g_strdup(value);
+    } else if (strcmp(name, "backup_interval_min") == 0) {
+        storage_set_int(&profile->backup_interval_min, name, value);
+    } else if (strcmp(name, "backup_keep") == 0) {
+        storage_set_int(&profile->backup_keep, name, value);
+    } else if (strcmp(name, "archive_dir") == 0) {
+        g_free(profile->archive_dir);
+        profile->archive_dir = g_strdup(value);
+    } else if (strcmp(name, "archive_keep_years") == 0) {
+        storage_set_int(&profile->archive_keep_years, name, value);
     }
 }
 
-static void update_budget_progress(AppData *app) {
-    // Get current month's expenses
-    time_t t = time(NULL);
-    struct tm *tm = localtime(&t);
-    char month[8];
-    strftime(month, sizeof(month), "%Y-%m", tm);
+// Builds the storage profile from DATABASE_FILE and the STORAGE_* defaults, then the
+// [storage] group of the config file, then EXPENSES_<SETTING> environment
+// variables (e.g. EXPENSES_JOURNAL_MODE=delete), later sources winning
+static void storage_profile_load(StorageProfile *profile) {
+    static const char *const names[] = {
+        "database", "journal_mode", "synchronous", "temp_store", "cache_kib", "mmap_mib", "busy_timeout_ms",
+        "columnar_cache", "backup_dir", "backup_interval_min", "backup_keep", "archive_dir", "archive_keep_years"
+    };
 
-    sqlite3_stmt *stmt;
-    const char *sql = "SELECT SUM(amount) FROM expenses WHERE strftime('%Y-%m', date) = ?";
-    
-    if (sqlite3_prepare_v2(app->db, sql, -1, &stmt, NULL) == SQLITE_OK) {
-        sqlite3_bind_text(stmt, 1, month, -1, SQLITE_STATIC);
-        
-        if (sqlite3_step(stmt) == SQLITE_ROW) {
-            app->current_spend = sqlite3_column_double(stmt, 0);
-            
-            if (app->monthly_budget > 0) {
-                double fraction = app->current_spend / app->monthly_budget;
-                gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(app->progress_bar), 
-                    fraction > 1.0 ? 1.0 : fraction);
-                
-                char progress_text[64];
-                g_snprintf(progress_text, sizeof(progress_text), 
-                    "%.2f / %.2f (%.1f%%)", 
-                    app->current_spend, 
-                    app->monthly_budget,
-                    fraction * 100);
-                gtk_progress_bar_set_text(GTK_PROGRESS_BAR(app->progress_bar), progress_text);
+    profile->database_file = g_strdup(DATABASE_FILE);
+    profile->journal_mode = g_strdup(STORAGE_JOURNAL_MODE);
+    profile->synchronous = g_strdup(STORAGE_SYNCHRONOUS);
+    profile->temp_store = g_strdup(STORAGE_TEMP_STORE);
+    profile->cache_kib = STORAGE_CACHE_KIB;
+    profile->mmap_mib = STORAGE_MMAP_MIB;
+    profile->busy_timeout_ms = STORAGE_BUSY_TIMEOUT_MS;
+    profile->columnar_cache = STORAGE_COLUMNAR_CACHE;
+    profile->backup_dir = g_strdup(STORAGE_BACKUP_DIR);
+    profile->backup_interval_min = STORAGE_BACKUP_INTERVAL_MIN;
+    profile->backup_keep = STORAGE_BACKUP_KEEP;
+    profile->archive_dir = g_strdup(STORAGE_ARCHIVE_DIR);
+    profile->archive_keep_years = STORAGE_ARCHIVE_KEEP_YEARS;
+    profile->archive_years = g_array_new(FALSE, FALSE, sizeof(gint));
+
+    const char *config_file = g_getenv("EXPENSES_CONFIG");
+    GKeyFile *key_file = g_key_file_new();
+    if (g_key_file_load_from_file(key_file, config_file != NULL ? config_file : STORAGE_CONFIG_FILE,
+                                  G_KEY_FILE_NONE, NULL)) {
+        for (gsize i = 0; i < G_N_ELEMENTS(names); i++) {
+            gchar *value = g_key_file_get_string(key_file, "storage", names[i], NULL);
+            if (value != NULL) {
+                storage_set(profile, names[i], g_strstrip(value));
+                g_free(value);
             }
         }
-        
-        sqlite3_finalize(stmt);
+    }
+    g_key_file_free(key_file);
+
+    for (gsize i = 0; i < G_N_ELEMENTS(names); i++) {
+        gchar *variable = g_ascii_strup(names[i], -1);
+        gchar *env_name = g_strconcat("EXPENSES_", variable, NULL);
+        const char *value = g_getenv(env_name);
+        if (value != NULL) {
+            storage_set(profile, names[i], value);
+        }
+        g_free(env_name);
+        g_free(variable);
     }
 }
 
-static void init_analytics_section(AppData *app, GtkWidget *main_box) {
-    // Create horizontal box for charts
-    GtkWidget *charts_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 20);
-    gtk_widget_set_margin_top(charts_box, 10);
-    gtk_widget_set_margin_bottom(charts_box, 10);
-    
-    // Create frames for each chart
-    GtkWidget *category_frame = gtk_frame_new("Spending by Category");
-    GtkWidget *payment_frame = gtk_frame_new("Spending by Payment Mode");
-    
-    // Set frame borders and padding
-    gtk_frame_set_shadow_type(GTK_FRAME(category_frame), GTK_SHADOW_ETCHED_IN);
-    gtk_frame_set_shadow_type(GTK_FRAME(payment_frame), GTK_SHADOW_ETCHED_IN);
-    gtk_widget_set_margin_start(category_frame, 10);
-    gtk_widget_set_margin_end(category_frame, 10);
-    gtk_widget_set_margin_start(payment_frame, 10);
-    gtk_widget_set_margin_end(payment_frame, 10);
+static void storage_profile_clear(StorageProfile *profile) {
+    g_free(profile->database_file);
+    g_free(profile->journal_mode);
+    g_free(profile->synchronous);
+    g_free(profile->temp_store);
+    g_free(profile->backup_dir);
+    g_free(profile->archive_dir);
+    g_array_free(profile->archive_years, TRUE);
+}
 
-    // Create drawing areas for charts
-    app->category_chart = gtk_drawing_area_new();
-    app->payment_chart = gtk_drawing_area_new();
-    gtk_widget_set_size_request(app->category_chart, 300, 300);
-    gtk_widget_set_size_request(app->payment_chart, 300, 300);
+// Prints the settings a connection actually runs with, which can differ
+// from the profile (e.g. WAL is refused on some file systems)
+static void storage_profile_report(sqlite3 *db) {
+    static const char *const pragmas[] = {
+        "journal_mode", "synchronous", "cache_size", "mmap_size", "temp_store", "busy_timeout"
+    };
+    GString *report = g_string_new("Storage:");
 
-    // Add drawing areas to frames
-    gtk_container_add(GTK_CONTAINER(category_frame), app->category_chart);
-    gtk_container_add(GTK_CONTAINER(payment_frame), app->payment_chart);
+    for (gsize i = 0; i < G_N_ELEMENTS(pragmas); i++) {
+        sqlite3_stmt *stmt;
+        gchar *sql = g_strconcat("PRAGMA ", pragmas[i], NULL);
 
-    // Pack frames into charts box
-    gtk_box_pack_start(GTK_BOX(charts_box), category_frame, TRUE, TRUE, 0);
-    gtk_box_pack_start(GTK_BOX(charts_box), payment_frame, TRUE, TRUE, 0);
+        if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) == SQLITE_OK) {
+            if (sqlite3_step(stmt) == SQLITE_ROW) {
+                g_string_append_printf(report, " %s=%s", pragmas[i],
+                                       (const char *)sqlite3_column_text(stmt, 0));
+            }
+            sqlite3_finalize(stmt);
+        }
+        g_free(sql);
+    }
 
-    // Add charts box to main box
-    gtk_box_pack_start(GTK_BOX(main_box), charts_box, FALSE, FALSE, 0);
+    g_print("%s\n", report->str);
+    g_string_free(report, TRUE);
+}
 
-    // Connect drawing signals
-    g_signal_connect(app->category_chart, "draw", G_CALLBACK(draw_category_chart), app);
-    g_signal_connect(app->payment_chart, "draw", G_CALLBACK(draw_payment_chart), app);
+// Call site statistics. Every connection reports into the one table, from
+// whichever thread it runs on, so it is shared and locked.
+static GMutex stats_lock;
+static GHashTable *stats_sites;  // Site name -> CallStats
+
+static void stats_record(const char *site, gint64 elapsed_ns) {
+    double us = MAX(elapsed_ns / 1000.0, 1.0);
+    int bucket = MIN((int)(log2(us) * STATS_BUCKETS_PER_OCTAVE), STATS_N_BUCKETS - 1);
+
+    g_mutex_lock(&stats_lock);
+    if (stats_sites == NULL) {
+        stats_sites = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, g_free);
+    }
+    CallStats *stats = g_hash_table_lookup(stats_sites, site);
+    if (stats == NULL) {
+        stats = g_malloc0(sizeof(CallStats) + STATS_N_BUCKETS * sizeof(guint));
+        stats->name = g_intern_string(site);
+        g_hash_table_insert(stats_sites, (gpointer)stats->name, stats);
+    }
+    stats->count++;
+    stats->total_ns += elapsed_ns;
+    stats->max_ns = MAX(stats->max_ns, elapsed_ns);
+    stats->buckets[bucket]++;
+    g_mutex_unlock(&stats_lock);
 }
 
-static gboolean draw_category_chart(GtkWidget *widget, cairo_t *cr, AppData *app) {
-    GtkAllocation allocation;
-    gtk_widget_get_allocation(widget, &allocation);
-    
-    int width = allocation.width;
-    int height = allocation.height;
-    int size = MIN(width, height);
-    double radius = size * 0.35;
-    double center_x = width / 2;
-    double center_y = height / 2;
+// Times a UI handler from a g_get_monotonic_time() reading
+static void stats_record_since(const char *site, gint64 start_us) {
+    stats_record(site, (g_get_monotonic_time() - start_us) * 1000);
+}
 
-    // Get category totals
-    double category_totals[5] = {0};
-    double total = 0;
-    
-    sqlite3_stmt *stmt;
-    const char *sql = "SELECT category, SUM(amount) FROM expenses GROUP BY category";
-    
-    if (sqlite3_prepare_v2(app->db, sql, -1, &stmt, NULL) == SQLITE_OK) {
-        while (sqlite3_step(stmt) == SQLITE_ROW) {
-            const char *category = (const char *)sqlite3_column_text(stmt, 0);
-            double amount = sqlite3_column_double(stmt, 1);
-            
-            for (int i = 0; i < 5; i++) {
-                if (strcmp(category, CATEGORY_COLORS[i].label) == 0) {
-                    category_totals[i] = amount;
-                    total += amount;
-                    break;
-                }
-            }
+// Called by SQLite as each statement starts and finishes, and as the
+// connection closes. started maps the connection's running statements to
+// when they started: the run time SQLite passes with the profile event is
+// only precise to the millisecond. Statements FTS5 runs internally report
+// no start; their time is part of the statement that ran them.
+static int stats_trace(unsigned type, void *started, void *stmt, void *x) {
+    if (type == SQLITE_TRACE_STMT) {
+        // A trigger starting inside the statement is not a new run
+        if (!g_str_has_prefix(x, "--")) {
+            gint64 *start = g_new(gint64, 1);
+            *start = g_get_monotonic_time();
+            g_hash_table_insert(started, stmt, start);
         }
-        sqlite3_finalize(stmt);
+    } else if (type == SQLITE_TRACE_PROFILE) {
+        const char *sql = sqlite3_sql(stmt);
+        gint64 *start = g_hash_table_lookup(started, stmt);
+        if (start != NULL && sql != NULL) {
+            stats_record(sql, (g_get_monotonic_time() - *start) * 1000);
+        }
+        g_hash_table_remove(started, stmt);
+    } else if (type == SQLITE_TRACE_CLOSE) {
+        g_hash_table_destroy(started);
     }
+    return 0;
+}
 
-    // Draw pie chart
-    double start_angle = -G_PI / 2;
-    double legend_y = 20;
+// Latency below which a share q of the calls completed, read off the
+// histogram as the upper bound of its bucket, in milliseconds
+static double stats_percentile(const CallStats *stats, double q) {
+    guint64 rank = (guint64)ceil(q * stats->count);
+    guint64 seen = 0;
 
-    for (int i = 0; i < 5; i++) {
-        if (category_totals[i] > 0) {
-            double slice = 2 * G_PI * category_totals[i] / total;
-            
-            // Draw slice
-            cairo_move_to(cr, center_x, center_y);
-            cairo_arc(cr, center_x, center_y, radius, 
-                     start_angle, start_angle + slice);
+    for (int i = 0; i < STATS_N_BUCKETS; i++) {
+        seen += stats->buckets[i];
+        if (seen >= rank) {
+            double bound_ms = pow(2, (double)(i + 1) / STATS_BUCKETS_PER_OCTAVE) / 1000;
+            return MIN(bound_ms, stats->max_ns / 1e6);
+        }
+    }
+    return stats->max_ns / 1e6;
+}
+
+static int compare_stats_total(gconstpointer a, gconstpointer b) {
+    const CallStats *x = *(CallStats *const *)a, *y = *(CallStats *const *)b;
+    return x->total_ns < y->total_ns ? 1 : x->total_ns > y->total_ns ? -1 : 0;
+}
+
+// Formats every call site, the most total time first
+static GString *stats_report(void) {
+    GString *report = g_string_new(NULL);
+    g_string_append_printf(report, "%10s %12s %10s %10s %10s  %s\n",
+                           "Calls", "Total ms", "p50 ms", "p99 ms", "Max ms", "Site");
+
+    g_mutex_lock(&stats_lock);
+    if (stats_sites != NULL) {
+        GPtrArray *sites = g_ptr_array_new();
+        GHashTableIter iter;
+        gpointer stats;
+        g_hash_table_iter_init(&iter, stats_sites);
+        while (g_hash_table_iter_next(&iter, NULL, &stats)) {
+            g_ptr_array_add(sites, stats);
+        }
+        g_ptr_array_sort(sites, compare_stats_total);
+        for (guint i = 0; i < sites->len; i++) {
+            const CallStats *stats = g_ptr_array_index(sites, i);
+            g_string_append_printf(report, "%10" G_GUINT64_FORMAT " %12.2f %10.3f %10.3f %10.3f  %s\n",
+                                   stats->count, stats->total_ns / 1e6,
+                                   stats_percentile(stats, 0.5), stats_percentile(stats, 0.99),
+                                   stats->max_ns / 1e6, stats->name);
+        }
+        g_ptr_array_free(sites, TRUE);
+    }
+    g_mutex_unlock(&stats_lock);
+    return report;
+}
+
+static void stats_dump(void) {
+    GString *report = stats_report();
+    g_printerr("%s", report->str);
+    g_string_free(report, TRUE);
+}
+
+// SIGUSR1 dumps the statistics without stopping the app
+static gboolean on_stats_signal(gpointer data) {
+    stats_dump();
+    return G_SOURCE_CONTINUE;
+}
+
+// Opens a connection to the profile's database file, tuned by profile,
+// with the profile's archives attached. Every connection waits for the
+// others' locks rather than failing straight away with SQLITE_BUSY, and
+// reports its statements' run times to the call site statistics.
+static sqlite3 *open_connection(const StorageProfile *profile) {
+    sqlite3 *db;
+    char *err_msg = 0;
+
+    if (sqlite3_open(profile->database_file, &db) != SQLITE_OK) {
+        g_print("Cannot open database: %s\n", sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return NULL;
+    }
+    sqlite3_busy_timeout(db, profile->busy_timeout_ms);
+    sqlite3_trace_v2(db, SQLITE_TRACE_STMT | SQLITE_TRACE_PROFILE | SQLITE_TRACE_CLOSE, stats_trace,
+                     g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free));
+
+    // A negative cache_size is in KiB rather than pages
+    gchar *sql = g_strdup_printf(
+        "PRAGMA journal_mode = %s;"
+        "PRAGMA synchronous = %s;"
+        "PRAGMA temp_store = %s;"
+        "PRAGMA cache_size = -%d;"
+        "PRAGMA mmap_size = %" G_GINT64_FORMAT ";",
+        profile->journal_mode, profile->synchronous, profile->temp_store,
+        profile->cache_kib, (gint64)profile->mmap_mib * 1024 * 1024);
+    if (sqlite3_exec(db, sql, 0, 0, &err_msg) != SQLITE_OK) {
+        g_print("SQL error: %s\n", err_msg);
+        sqlite3_free(err_msg);
+    }
+    g_free(sql);
+    if (!attach_archives(db, profile)) {
+        sqlite3_close(db);
+        return NULL;
+    }
+    return db;
+}
+
+static gboolean db_job_is_stale(DbJob *job) {
+    return job->kind < DB_N_LATEST_KINDS &&
+           job->generation != (guint)g_atomic_int_get(&job->worker->generations[job->kind]);
+}
+
+static void db_job_free(DbJob *job) {
+    if (job->free_data != NULL) {
+        job->free_data(job->data);
+    }
+    g_free(job);
+}
+
+// Runs on the main loop once the worker is done with a job. Every job
+// comes back here, run or not, so its data is always freed on the main
+// thread.
+static gboolean db_job_finish(gpointer data) {
+    DbJob *job = data;
+
+    if (job->done != NULL && !db_job_is_stale(job)) {
+        job->done(job->app, job);
+    }
+    db_job_free(job);
+    return G_SOURCE_REMOVE;
+}
+
+static gpointer db_worker_thread(gpointer data) {
+    DbWorker *worker = data;
+
+    for (;;) {
+        DbJob *job = g_async_queue_pop(worker->queue);
+
+        // A job without a run function asks the worker to stop
+        if (job->run == NULL) {
+            db_job_free(job);
+            break;
+        }
+        if (!db_job_is_stale(job)) {
+            worker->running = job;
+            job->run(worker, job);
+            worker->running = NULL;
+        }
+        g_idle_add(db_job_finish, job);
+    }
+    return NULL;
+}
+
+// Progress handler of the worker's connection. Interrupts the statement
+// of a request once a newer one of its kind is submitted, so a slow search
+// still running when the next keystroke arrives makes way for it at once.
+// The interrupted request is stale, so its partial results are dropped.
+static int db_worker_progress(void *data) {
+    DbWorker *worker = data;
+    return worker->running != NULL && db_job_is_stale(worker->running);
+}
+
+// Starts the DB worker with its own connection, so its queries never wait
+// on the UI connection's statements and the UI never waits on them
+static DbWorker *db_worker_new(const StorageProfile *profile) {
+    sqlite3 *db = open_connection(profile);
+    if (db == NULL) {
+        return NULL;
+    }
+
+    DbWorker *worker = g_new0(DbWorker, 1);
+    worker->db = db;
+    sqlite3_progress_handler(db, DB_WORKER_PROGRESS_OPS, db_worker_progress, worker);
+    stmt_cache_init(&worker->stmts, db);
+    stmt_cache_warm(&worker->stmts, WORKER_STATEMENTS, G_N_ELEMENTS(WORKER_STATEMENTS));
+    worker->queue = g_async_queue_new();
+    worker->thread = g_thread_new("db-worker", db_worker_thread, worker);
+    return worker;
+}
+
+// Queues a request. For the DB_N_LATEST_KINDS kinds this also makes every
+// earlier request of the same kind stale.
+static void db_worker_submit(DbWorker *worker, AppData *app, int kind, DbJobRun run,
+                             DbJobDone done, gpointer data, GDestroyNotify free_data) {
+    DbJob *job = g_new0(DbJob, 1);
+    job->kind = kind;
+    job->run = run;
+    job->done = done;
+    job->data = data;
+    job->free_data = free_data;
+    job->app = app;
+    job->worker = worker;
+    if (kind < DB_N_LATEST_KINDS) {
+        job->generation = (guint)g_atomic_int_add(&worker->generations[kind], 1) + 1;
+    }
+    g_async_queue_push(worker->queue, job);
+}
+
+// Stops the worker after the requests already queued and closes its
+// connection. Results that have not reached the main loop are dropped.
+static void db_worker_free(DbWorker *worker) {
+    DbJob *quit = g_new0(DbJob, 1);
+    g_async_queue_push(worker->queue, quit);
+    g_thread_join(worker->thread);
+    g_async_queue_unref(worker->queue);
+
+    g_print("Worker statement cache: %u hits, %u misses, %u statements\n",
+            worker->stmts.hits, worker->stmts.misses, g_hash_table_size(worker->stmts.stmts));
+    stmt_cache_clear(&worker->stmts);
+    sqlite3_close(worker->db);
+    g_free(worker);
+}
+
+static void description_entry_free(gpointer data) {
+    DescriptionEntry *entry = data;
+    g_free(entry->key);
+    g_free(entry->description);
+    g_array_free(entry->category_counts, TRUE);
+    g_array_free(entry->payment_type_counts, TRUE);
+    g_free(entry);
+}
+
+static DescriptionIndex *description_index_new(void) {
+    DescriptionIndex *index = g_new0(DescriptionIndex, 1);
+    index->entries = g_ptr_array_new_with_free_func(description_entry_free);
+    return index;
+}
+
+static void description_index_free(DescriptionIndex *index) {
+    if (index == NULL) {
+        return;
+    }
+    g_ptr_array_free(index->entries, TRUE);
+    g_free(index);
+}
+
+// Position of the first entry at or after key and description in the
+// index order. Without a description, of the first entry at or after key.
+static guint description_index_lower_bound(const DescriptionIndex *index, const gchar *key,
+                                           const gchar *description) {
+    guint low = 0, high = index->entries->len;
+
+    while (low < high) {
+        guint mid = (low + high) / 2;
+        const DescriptionEntry *entry = g_ptr_array_index(index->entries, mid);
+        int cmp = strcmp(entry->key, key);
+        if (cmp == 0 && description != NULL) {
+            cmp = strcmp(entry->description, description);
+        }
+        if (cmp < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+// Returns the entry of a description, or NULL if there is none
+static DescriptionEntry *description_index_find(const DescriptionIndex *index, const gchar *description) {
+    gchar *key = g_utf8_casefold(description, -1);
+    guint position = description_index_lower_bound(index, key, description);
+    g_free(key);
+
+    if (position < index->entries->len) {
+        DescriptionEntry *entry = g_ptr_array_index(index->entries, position);
+        if (strcmp(entry->description, description) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+// Adds n to the count at id, growing counts to reach it
+static void add_usage(GArray *counts, gint id, gint n) {
+    if (id <= 0) {
+        return;
+    }
+    if (id >= (gint)counts->len) {
+        g_array_set_size(counts, id + 1);
+    }
+    g_array_index(counts, gint, id) += n;
+}
+
+// Counts n more expenses with a description, category and payment type,
+// or n fewer when n is negative. Entries whose count drops to 0 stay in
+// place and are no longer suggested. Does nothing before the index has
+// loaded.
+static void description_index_add(DescriptionIndex *index, const gchar *description, gint category_id,
+                                  gint payment_type_id, gint n) {
+    if (index == NULL || description == NULL || *description == '\0') {
+        return;
+    }
+
+    DescriptionEntry *entry = description_index_find(index, description);
+    if (entry == NULL) {
+        if (n <= 0) {
+            return;
+        }
+        entry = g_new0(DescriptionEntry, 1);
+        entry->key = g_utf8_casefold(description, -1);
+        entry->description = g_strdup(description);
+        entry->category_counts = g_array_new(FALSE, TRUE, sizeof(gint));
+        entry->payment_type_counts = g_array_new(FALSE, TRUE, sizeof(gint));
+        g_ptr_array_insert(index->entries, description_index_lower_bound(index, entry->key, description), entry);
+    }
+    entry->count += n;
+    add_usage(entry->category_counts, category_id, n);
+    add_usage(entry->payment_type_counts, payment_type_id, n);
+}
+
+// The id counted most often, 0 if none is counted
+static gint most_used_id(const GArray *counts) {
+    gint best = 0, best_count = 0;
+    for (guint id = 1; id < counts->len; id++) {
+        if (g_array_index(counts, gint, id) > best_count) {
+            best = id;
+            best_count = g_array_index(counts, gint, id);
+        }
+    }
+    return best;
+}
+
+// Fills suggestions with the entries starting with text, ignoring case,
+// most used first, at most max of them
+static void description_index_complete(const DescriptionIndex *index, const gchar *text,
+                                       GPtrArray *suggestions, guint max) {
+    gchar *prefix = g_utf8_casefold(text, -1);
+
+    for (guint i = description_index_lower_bound(index, prefix, NULL); i < index->entries->len; i++) {
+        DescriptionEntry *entry = g_ptr_array_index(index->entries, i);
+        if (!g_str_has_prefix(entry->key, prefix)) {
+            break;
+        }
+        if (entry->count <= 0) {
+            continue;
+        }
+
+        // Insertion into the few kept so far, which stay sorted by count
+        guint position = suggestions->len;
+        while (position > 0 &&
+               ((DescriptionEntry *)g_ptr_array_index(suggestions, position - 1))->count < entry->count) {
+            position--;
+        }
+        if (position < max) {
+            g_ptr_array_insert(suggestions, position, entry);
+            g_ptr_array_set_size(suggestions, MIN(suggestions->len, max));
+        }
+    }
+    g_free(prefix);
+}
+
+typedef struct {
+    DescriptionIndex *index;
+    gint max_id;                // Newest expense the index counts
+} DescriptionsJob;
+
+static void descriptions_job_free(gpointer data) {
+    DescriptionsJob *load = data;
+    description_index_free(load->index);
+    g_free(load);
+}
+
+// Counts the expenses by description, category and payment type. The
+// database holds the recent years, the ones whose merchants come back.
+static void run_descriptions_job(DbWorker *worker, DbJob *job) {
+    DescriptionsJob *load = job->data;
+    sqlite3_stmt *stmt = stmt_cache_get(&worker->stmts, SQL_DESCRIPTION_USAGE);
+
+    load->index = description_index_new();
+    if (stmt != NULL) {
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            description_index_add(load->index, (const char *)sqlite3_column_text(stmt, 0),
+                                  sqlite3_column_int(stmt, 1), sqlite3_column_int(stmt, 2),
+                                  sqlite3_column_int(stmt, 3));
+            load->max_id = MAX(load->max_id, sqlite3_column_int(stmt, 4));
+        }
+        sqlite3_reset(stmt);
+    }
+}
+
+// Installs the index, after counting the expenses added since the worker
+// read the table. Edits and deletes made meanwhile are not counted; the
+// counts only rank the suggestions.
+static void descriptions_job_done(AppData *app, DbJob *job) {
+    DescriptionsJob *load = job->data;
+    sqlite3_stmt *stmt = stmt_cache_get(&app->stmts, SQL_SELECT_EXPENSES_AFTER);
+
+    if (stmt != NULL) {
+        sqlite3_bind_int(stmt, 1, load->max_id);
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            description_index_add(load->index, (const char *)sqlite3_column_text(stmt, 0),
+                                  sqlite3_column_int(stmt, 1), sqlite3_column_int(stmt, 2), 1);
+        }
+        sqlite3_reset(stmt);
+    }
+    description_index_free(app->descriptions);
+    app->descriptions = load->index;
+    load->index = NULL;
+    g_print("Description completion: %u descriptions\n", app->descriptions->entries->len);
+}
+
+// (Re)builds the description index on the DB worker. Until it arrives the
+// description entry suggests nothing, or what the previous index held.
+static void load_descriptions(AppData *app) {
+    db_worker_submit(app->worker, app, DB_JOB_DESCRIPTIONS, run_descriptions_job, descriptions_job_done,
+                     g_new0(DescriptionsJob, 1), descriptions_job_free);
+}
+
+// Refills the completion's suggestions for the description typed so far.
+// Connected ahead of the completion's own handler, which then shows them.
+static void description_changed(GtkEditable *editable, AppData *app) {
+    gint64 timer = g_get_monotonic_time();
+    const gchar *text = gtk_entry_get_text(GTK_ENTRY(editable));
+
+    gtk_list_store_clear(app->description_suggestions);
+    if (app->descriptions != NULL && *text != '\0') {
+        GPtrArray *suggestions = g_ptr_array_new();
+        description_index_complete(app->descriptions, text, suggestions, DESCRIPTION_SUGGESTIONS);
+        for (guint i = 0; i < suggestions->len; i++) {
+            const DescriptionEntry *entry = g_ptr_array_index(suggestions, i);
+            gtk_list_store_insert_with_values(app->description_suggestions, NULL, -1,
+                                              0, entry->description, -1);
+        }
+        g_ptr_array_free(suggestions, TRUE);
+    }
+    stats_record_since("description_changed", timer);
+}
+
+// The suggestions are already the matches, ignoring case
+static gboolean match_any_suggestion(GtkEntryCompletion *completion, const gchar *key, GtkTreeIter *iter,
+                                     gpointer data) {
+    return TRUE;
+}
+
+// Prefills the category and payment type used most often with a picked
+// description, where the form has none chosen yet. Returns FALSE so the
+// completion still puts the description in the entry.
+static gboolean description_selected(GtkEntryCompletion *completion, GtkTreeModel *model, GtkTreeIter *iter,
+                                     AppData *app) {
+    gchar *description = NULL;
+    gtk_tree_model_get(model, iter, 0, &description, -1);
+
+    const DescriptionEntry *entry = app->descriptions != NULL && description != NULL
+        ? description_index_find(app->descriptions, description) : NULL;
+    if (entry != NULL) {
+        if (gtk_combo_box_get_active(GTK_COMBO_BOX(app->category_combo)) < 0) {
+            dictionary_set_active(&app->categories, app->category_combo, most_used_id(entry->category_counts));
+        }
+        if (gtk_combo_box_get_active(GTK_COMBO_BOX(app->payment_type_combo)) < 0) {
+            dictionary_set_active(&app->payment_types, app->payment_type_combo,
+                                  most_used_id(entry->payment_type_counts));
+        }
+    }
+    g_free(description);
+    return FALSE;
+}
+
+// Add this function to initialize the form section
+static void init_form_section(AppData *app, GtkWidget *main_box) {
+    GtkWidget *form_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
+    
+    // Amount entry
+    app->amount_entry = gtk_entry_new();
+    gtk_entry_set_placeholder_text(GTK_ENTRY(app->amount_entry), "Amount");
+    
+    // Description entry, completed from the descriptions entered before
+    app->description_entry = gtk_entry_new();
+    gtk_entry_set_placeholder_text(GTK_ENTRY(app->description_entry), "Description");
+    app->description_suggestions = gtk_list_store_new(1, G_TYPE_STRING);
+    GtkEntryCompletion *completion = gtk_entry_completion_new();
+    gtk_entry_completion_set_model(completion, GTK_TREE_MODEL(app->description_suggestions));
+    g_object_unref(app->description_suggestions);
+    gtk_entry_completion_set_text_column(completion, 0);
+    gtk_entry_completion_set_match_func(completion, match_any_suggestion, NULL, NULL);
+    g_signal_connect(app->description_entry, "changed", G_CALLBACK(description_changed), app);
+    gtk_entry_set_completion(GTK_ENTRY(app->description_entry), completion);
+    g_signal_connect(completion, "match-selected", G_CALLBACK(description_selected), app);
+    g_object_unref(completion);
+    
+    // Category dropdown, with a button for adding categories
+    app->category_combo = gtk_combo_box_text_new();
+    dictionary_fill_combo(&app->categories, app->category_combo);
+    GtkWidget *new_category_button = gtk_button_new_with_label("+");
+    gtk_widget_set_tooltip_text(new_category_button, "New category");
+    
+    // Payment type dropdown, with a button for adding payment types
+    app->payment_type_combo = gtk_combo_box_text_new();
+    dictionary_fill_combo(&app->payment_types, app->payment_type_combo);
+    GtkWidget *new_payment_type_button = gtk_button_new_with_label("+");
+    gtk_widget_set_tooltip_text(new_payment_type_button, "New payment type");
+    
+    // Add expense button
+    GtkWidget *add_button = gtk_button_new_with_label("Add Expense");
+    GtkStyleContext *context = gtk_widget_get_style_context(add_button);
+    gtk_style_context_add_class(context, "suggested-action");
+    
+    // Pack form elements
+    gtk_box_pack_start(GTK_BOX(form_box), app->amount_entry, TRUE, TRUE, 5);
+    gtk_box_pack_start(GTK_BOX(form_box), app->description_entry, TRUE, TRUE, 5);
+    gtk_box_pack_start(GTK_BOX(form_box), app->category_combo, TRUE, TRUE, 5);
+    gtk_box_pack_start(GTK_BOX(form_box), new_category_button, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(form_box), app->payment_type_combo, TRUE, TRUE, 5);
+    gtk_box_pack_start(GTK_BOX(form_box), new_payment_type_button, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(form_box), add_button, FALSE, FALSE, 5);
+    
+    // Connect add button signal
+    g_signal_connect(add_button, "clicked", G_CALLBACK(add_expense), app);
+    g_signal_connect(new_category_button, "clicked", G_CALLBACK(add_category), app);
+    g_signal_connect(new_payment_type_button, "clicked", G_CALLBACK(add_payment_type), app);
+    
+    // Add form box to main box
+    gtk_box_pack_start(GTK_BOX(main_box), form_box, FALSE, FALSE, 5);
+}
+
+static void add_expense(GtkButton *button, AppData *app) {
+    const gchar *amount_str = gtk_entry_get_text(GTK_ENTRY(app->amount_entry));
+    const gchar *description = gtk_entry_get_text(GTK_ENTRY(app->description_entry));
+    gchar *category = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(app->category_combo));
+    gchar *payment_type = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(app->payment_type_combo));
+    gint category_id = dictionary_lookup(&app->categories, category);
+    gint payment_type_id = dictionary_lookup(&app->payment_types, payment_type);
+    g_free(category);
+    g_free(payment_type);
+
+    // Validate input
+    if (strlen(amount_str) == 0 || category_id == 0 || payment_type_id == 0) {
+        GtkWidget *dialog = gtk_message_dialog_new(GTK_WINDOW(app->window),
+            GTK_DIALOG_DESTROY_WITH_PARENT,
+            GTK_MESSAGE_ERROR,
+            GTK_BUTTONS_CLOSE,
+            "Please fill in all required fields (Amount, Category, Payment Type)");
+        gtk_dialog_run(GTK_DIALOG(dialog));
+        gtk_widget_destroy(dialog);
+        return;
+    }
+
+    // Add to database
+    sqlite3_stmt *stmt = stmt_cache_get(&app->stmts, SQL_INSERT_EXPENSE);
+    
+    if (stmt != NULL) {
+        sqlite3_bind_double(stmt, 1, atof(amount_str));
+        sqlite3_bind_text(stmt, 2, description, -1, SQLITE_STATIC);
+        sqlite3_bind_int(stmt, 3, category_id);
+        sqlite3_bind_int(stmt, 4, payment_type_id);
+        int rc = sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+        
+        if (rc == SQLITE_DONE) {
+            // Successfully added the expense
+            description_index_add(app->descriptions, description, category_id, payment_type_id, 1);
+            gtk_entry_set_text(GTK_ENTRY(app->amount_entry), "");
+            gtk_entry_set_text(GTK_ENTRY(app->description_entry), "");
+            gtk_combo_box_set_active(GTK_COMBO_BOX(app->category_combo), -1);
+            gtk_combo_box_set_active(GTK_COMBO_BOX(app->payment_type_combo), -1);
+
+            // Update the expense table and charts immediately
+            expense_added(app, (gint)sqlite3_last_insert_rowid(app->db));
+            update_budget_progress(app); // Update budget progress
+            update_charts(app); // Update charts
+
+            // Show success message
+            GtkWidget *success_dialog = gtk_message_dialog_new(GTK_WINDOW(app->window),
+                GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
+                GTK_MESSAGE_INFO,
+                GTK_BUTTONS_OK,
+                "Expense added successfully!");
+            gtk_dialog_run(GTK_DIALOG(success_dialog));
+            gtk_widget_destroy(success_dialog);
+        }
+    }
+}
+// Asks for the name of a new dictionary entry. Returns it, stripped, or
+// NULL if the dialog was cancelled or left empty.
+static gchar *ask_entry_name(AppData *app, const char *title) {
+    GtkWidget *dialog = gtk_dialog_new_with_buttons(title,
+        GTK_WINDOW(app->window),
+        GTK_DIALOG_MODAL,
+        "Add", GTK_RESPONSE_ACCEPT,
+        "Cancel", GTK_RESPONSE_CANCEL,
+        NULL);
+    GtkWidget *content_area = gtk_dialog_get_content_area(GTK_DIALOG(dialog));
+    GtkWidget *entry = gtk_entry_new();
+    gtk_container_set_border_width(GTK_CONTAINER(content_area), 10);
+    gtk_container_add(GTK_CONTAINER(content_area), entry);
+    gtk_widget_show_all(dialog);
+
+    gchar *name = NULL;
+    if (gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_ACCEPT) {
+        name = g_strstrip(g_strdup(gtk_entry_get_text(GTK_ENTRY(entry))));
+        if (*name == '\0') {
+            g_free(name);
+            name = NULL;
+        }
+    }
+    gtk_widget_destroy(dialog);
+    return name;
+}
+
+static void add_category(GtkButton *button, AppData *app) {
+    gchar *name = ask_entry_name(app, "New Category");
+    if (name == NULL) {
+        return;
+    }
+
+    gboolean is_new = dictionary_lookup(&app->categories, name) == 0;
+    gint id = dictionary_add(&app->categories, app->db, name);
+    if (id > 0 && is_new) {
+        gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(app->category_combo), name);
+        gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(app->filter_combo), name);
+    }
+    if (id > 0) {
+        dictionary_set_active(&app->categories, app->category_combo, id);
+    }
+    g_free(name);
+}
+
+static void add_payment_type(GtkButton *button, AppData *app) {
+    gchar *name = ask_entry_name(app, "New Payment Type");
+    if (name == NULL) {
+        return;
+    }
+
+    gboolean is_new = dictionary_lookup(&app->payment_types, name) == 0;
+    gint id = dictionary_add(&app->payment_types, app->db, name);
+    if (id > 0 && is_new) {
+        gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(app->payment_type_combo), name);
+    }
+    if (id > 0) {
+        dictionary_set_active(&app->payment_types, app->payment_type_combo, id);
+    }
+    g_free(name);
+}
+
+static void init_filter_section(AppData *app, GtkWidget *main_box) {
+    // Create horizontal box for filter section
+    GtkWidget *filter_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
+    
+    // Create filter combo box
+    app->filter_combo = gtk_combo_box_text_new();
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(app->filter_combo), "All");
+    dictionary_fill_combo(&app->categories, app->filter_combo);
+    gtk_combo_box_set_active(GTK_COMBO_BOX(app->filter_combo), 0);
+
+    // Create search entry
+    app->search_entry = gtk_search_entry_new();
+    gtk_entry_set_placeholder_text(GTK_ENTRY(app->search_entry), "Search expenses...");
+
+    // Create export button with green background
+    app->export_button = gtk_button_new_with_label("Export to Excel");
+    GtkStyleContext *context = gtk_widget_get_style_context(app->export_button);
+    gtk_style_context_add_class(context, "suggested-action");
+    
+    // Add CSS for the export button
+    GtkCssProvider *provider = gtk_css_provider_new();
+    gtk_css_provider_load_from_data(provider,
+        ".suggested-action { background: #28a745; color: white; }"
+        ".suggested-action:hover { background: #218838; }", -1, NULL);
+    gtk_style_context_add_provider(context,
+        GTK_STYLE_PROVIDER(provider),
+        GTK_STYLE_PROVIDER_PRIORITY_APPLICATION);
+    g_object_unref(provider);
+
+    // Export scope and progress; the bar and cancel button show while an
+    // export runs
+    app->export_view_check = gtk_check_button_new_with_label("Current view only");
+    app->export_progress = gtk_progress_bar_new();
+    gtk_progress_bar_set_show_text(GTK_PROGRESS_BAR(app->export_progress), TRUE);
+    gtk_widget_set_no_show_all(app->export_progress, TRUE);
+    app->export_cancel_button = gtk_button_new_with_label("Cancel");
+    gtk_widget_set_no_show_all(app->export_cancel_button, TRUE);
+
+    // Import button; its progress bar shows while an import runs
+    app->import_button = gtk_button_new_with_label("Import CSV");
+    app->import_progress = gtk_progress_bar_new();
+    gtk_progress_bar_set_show_text(GTK_PROGRESS_BAR(app->import_progress), TRUE);
+    gtk_widget_set_no_show_all(app->import_progress, TRUE);
+
+    // Backup button; its progress bar shows while a backup runs
+    app->backup_button = gtk_button_new_with_label("Backup Now");
+    app->backup_progress = gtk_progress_bar_new();
+    gtk_progress_bar_set_show_text(GTK_PROGRESS_BAR(app->backup_progress), TRUE);
+    gtk_widget_set_no_show_all(app->backup_progress, TRUE);
+
+    // Create edit and delete buttons, enabled once a row is selected
+    app->edit_button = gtk_button_new_with_label("Edit");
+    app->delete_button = gtk_button_new_with_label("Delete");
+    gtk_widget_set_sensitive(app->edit_button, FALSE);
+    gtk_widget_set_sensitive(app->delete_button, FALSE);
+
+    // Pack widgets into filter box
+    gtk_box_pack_start(GTK_BOX(filter_box), app->filter_combo, FALSE, FALSE, 5);
+    gtk_box_pack_start(GTK_BOX(filter_box), app->search_entry, TRUE, TRUE, 5);
+    gtk_box_pack_end(GTK_BOX(filter_box), app->export_cancel_button, FALSE, FALSE, 5);
+    gtk_box_pack_end(GTK_BOX(filter_box), app->export_progress, FALSE, FALSE, 5);
+    gtk_box_pack_end(GTK_BOX(filter_box), app->export_button, FALSE, FALSE, 5);
+    gtk_box_pack_end(GTK_BOX(filter_box), app->export_view_check, FALSE, FALSE, 5);
+    gtk_box_pack_end(GTK_BOX(filter_box), app->import_progress, FALSE, FALSE, 5);
+    gtk_box_pack_end(GTK_BOX(filter_box), app->import_button, FALSE, FALSE, 5);
+    gtk_box_pack_end(GTK_BOX(filter_box), app->backup_progress, FALSE, FALSE, 5);
+    gtk_box_pack_end(GTK_BOX(filter_box), app->backup_button, FALSE, FALSE, 5);
+    gtk_box_pack_end(GTK_BOX(filter_box), app->delete_button, FALSE, FALSE, 5);
+    gtk_box_pack_end(GTK_BOX(filter_box), app->edit_button, FALSE, FALSE, 5);
+
+    // Add filter box to main box, with the date range below it
+    gtk_box_pack_start(GTK_BOX(main_box), filter_box, FALSE, FALSE, 5);
+    add_date_filter(app, main_box);
+
+    // Connect signals
+    g_signal_connect(app->filter_combo, "changed", G_CALLBACK(filter_changed), app);
+    g_signal_connect(app->search_entry, "search-changed", G_CALLBACK(search_changed), app);
+    g_signal_connect(app->export_button, "clicked", G_CALLBACK(export_to_excel), app);
+    g_signal_connect(app->export_cancel_button, "clicked", G_CALLBACK(cancel_export), app);
+    g_signal_connect(app->import_button, "clicked", G_CALLBACK(import_csv), app);
+    g_signal_connect(app->backup_button, "clicked", G_CALLBACK(backup_now), app);
+    g_signal_connect(app->edit_button, "clicked", G_CALLBACK(edit_expense), app);
+    g_signal_connect(app->delete_button, "clicked", G_CALLBACK(delete_expense), app);
+}
+
+static void filter_changed(GtkComboBox *combo, AppData *app) {
+    gchar *selected_category = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(combo));
+    const gchar *search_text = gtk_entry_get_text(GTK_ENTRY(app->search_entry));
+    update_expense_list(app, selected_category, search_text);
+    g_free(selected_category);
+}
+
+// GtkSearchEntry emits search-changed only once typing pauses, so a word
+// typed quickly runs one search. One still running on the DB worker when
+// the next arrives is interrupted (see db_worker_progress).
+static void search_changed(GtkSearchEntry *entry, AppData *app) {
+    const gchar *search_text = gtk_entry_get_text(GTK_ENTRY(entry));
+    gchar *selected_category = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(app->filter_combo));
+    update_expense_list(app, selected_category, search_text);
+    g_free(selected_category);
+}
+
+// Turns the search text into an FTS5 query: every word becomes a quoted
+// prefix term ("star"* matches Starbucks), and the terms are ANDed together.
+// Quoting keeps punctuation the user typed from being read as FTS syntax.
+// Returns NULL when the text holds no searchable word.
+static gchar *make_fts_query(const gchar *text) {
+    GString *query = g_string_new(NULL);
+    const gchar *p = text;
+
+    while (*p) {
+        // Bytes >= 0x80 belong to UTF-8 letters, which unicode61 indexes
+        while (*p && !g_ascii_isalnum(*p) && (guchar)*p < 0x80) {
+            p++;
+        }
+        const gchar *start = p;
+        while (*p && (g_ascii_isalnum(*p) || (guchar)*p >= 0x80)) {
+            p++;
+        }
+        if (p > start) {
+            if (query->len > 0) {
+                g_string_append_c(query, ' ');
+            }
+            g_string_append_c(query, '"');
+            g_string_append_len(query, start, p - start);
+            g_string_append(query, "\"*");
+        }
+    }
+
+    if (query->len == 0) {
+        g_string_free(query, TRUE);
+        return NULL;
+    }
+    return g_string_free(query, FALSE);
+}
+
+// Appends a term on column for each bound of a date range that is set,
+// each preceded by glue, which becomes " AND " once a term is written.
+// Dates are ISO strings, so the bounds compare as text and let SQLite
+// seek a date index to the first day and stop after the last.
+static void append_date_range(GString *sql, const char **glue, const char *column,
+                              const gchar *from_date, const gchar *to_date) {
+    if (from_date != NULL) {
+        g_string_append_printf(sql, "%s%s >= ?", *glue, column);
+        *glue = " AND ";
+    }
+    if (to_date != NULL) {
+        g_string_append_printf(sql, "%s%s <= ?", *glue, column);
+        *glue = " AND ";
+    }
+}
+
+// Binds the bounds append_date_range wrote, starting at *param
+static void bind_date_range(sqlite3_stmt *stmt, int *param, const gchar *from_date, const gchar *to_date) {
+    if (from_date != NULL) {
+        sqlite3_bind_text(stmt, (*param)++, from_date, -1, SQLITE_STATIC);
+    }
+    if (to_date != NULL) {
+        sqlite3_bind_text(stmt, (*param)++, to_date, -1, SQLITE_STATIC);
+    }
+}
+
+// Whether the archive starting at year can hold rows dated from_date to
+// to_date. Dates start with the year, so the years of the bounds are enough.
+static gboolean archive_overlaps(gint year, const gchar *from_date, const gchar *to_date) {
+    return (from_date == NULL || atoi(from_date) < year + ARCHIVE_SPAN_YEARS) &&
+           (to_date == NULL || atoi(to_date) >= year);
+}
+
+// Appends the FROM item of the rows dated from_date to to_date: the
+// expenses table, and with it each archive whose years overlap the range.
+// Every query includes the expenses table, since rows imported or edited
+// into an archived year since it was archived stay there. SQLite
+// flattens the UNION ALL into the query, so each partition is searched on
+// its own indexes and ordered results are merged rather than sorted.
+static void append_partitions(GString *sql, const GArray *archives, const gchar *from_date,
+                              const gchar *to_date) {
+    GString *arms = g_string_new("(SELECT " LEDGER_COLUMNS " FROM main.expenses");
+    guint n_overlaps = 0;
+
+    for (guint i = 0; archives != NULL && i < archives->len; i++) {
+        gint year = g_array_index(archives, gint, i);
+        if (archive_overlaps(year, from_date, to_date)) {
+            g_string_append_printf(arms, " UNION ALL SELECT " LEDGER_COLUMNS " FROM archive_%d.expenses", year);
+            n_overlaps++;
+        }
+    }
+    g_string_append_c(arms, ')');
+
+    if (n_overlaps == 0) {
+        g_string_append(sql, "expenses");
+    } else if (n_overlaps == archives->len) {
+        g_string_append(sql, "ledger");
+    } else {
+        g_string_append(sql, arms->str);
+    }
+    g_string_free(arms, TRUE);
+}
+
+// The same for a search: the matches of the FTS5 query in parameter 1
+// from each partition's own full-text index, with their rank. Each index
+// ranks by its own statistics, so equally good matches from different
+// years can rank slightly apart. The id is the index's rowid, which lets
+// FTS5 hand out the matches newest first without sorting them.
+#define SEARCH_PARTITION \
+    "SELECT expenses_fts.rowid AS id, e.amount, e.description, e.category_id, e.payment_type_id, e.date, " \
+    "expenses_fts.rank AS rank FROM %s.expenses_fts JOIN %s.expenses e ON e.id = expenses_fts.rowid " \
+    "WHERE expenses_fts MATCH ?1"
+
+static void append_search_partitions(GString *sql, const GArray *archives, const gchar *from_date,
+                                     const gchar *to_date) {
+    g_string_append_c(sql, '(');
+    g_string_append_printf(sql, SEARCH_PARTITION, "main", "main");
+    for (guint i = 0; archives != NULL && i < archives->len; i++) {
+        gint year = g_array_index(archives, gint, i);
+        if (archive_overlaps(year, from_date, to_date)) {
+            gchar *schema = g_strdup_printf("archive_%d", year);
+            g_string_append(sql, " UNION ALL ");
+            g_string_append_printf(sql, SEARCH_PARTITION, schema, schema);
+            g_free(schema);
+        }
+    }
+    g_string_append_c(sql, ')');
+}
+
+// Appends the FROM item of a search's matches in a category (0 for all)
+// and date range, with their rank. A window above 0 keeps only that many
+// of the newest matches: reading them stops there however many expenses
+// match, and ordering by rank then sorts at most window rows.
+static void append_search_matches(GString *sql, const GArray *archives, gint category_id,
+                                  const gchar *from_date, const gchar *to_date, int window) {
+    g_string_append(sql, "(SELECT e.id, e.description, e.amount, e.payment_type_id, e.date, "
+                         "e.category_id, e.rank FROM ");
+    append_search_partitions(sql, archives, from_date, to_date);
+    g_string_append(sql, " e");
+    const char *glue = " WHERE ";
+    if (category_id > 0) {
+        g_string_append(sql, " WHERE e.category_id = ?");
+        glue = " AND ";
+    }
+    append_date_range(sql, &glue, "e.date", from_date, to_date);
+    if (window > 0) {
+        g_string_append(sql, " ORDER BY e.id DESC LIMIT ?");
+    }
+    g_string_append(sql, ") e");
+}
+
+// Binds the parameters append_search_matches wrote, starting at *param
+static void bind_search_matches(sqlite3_stmt *stmt, int *param, const gchar *fts_query, gint category_id,
+                                const gchar *from_date, const gchar *to_date, int window) {
+    sqlite3_bind_text(stmt, (*param)++, fts_query, -1, SQLITE_STATIC);
+    if (category_id > 0) {
+        sqlite3_bind_int(stmt, (*param)++, category_id);
+    }
+    bind_date_range(stmt, param, from_date, to_date);
+    if (window > 0) {
+        sqlite3_bind_int(stmt, (*param)++, window);
+    }
+}
+
+static void update_expense_list(AppData *app, const gchar *category, const gchar *search_text) {
+    // Remember the filter so edits and deletes can rebuild the same view;
+    // "All" is not in the dictionary and maps to 0
+    g_free(app->filter_fts_query);
+    app->filter_category_id = dictionary_lookup(&app->categories, category);
+    app->filter_fts_query = search_text != NULL ? make_fts_query(search_text) : NULL;
+
+    refresh_expense_view(app);
+    update_chart_totals(app);
+}
+
+static void run_list_job(DbWorker *worker, DbJob *job) {
+    build_expense_index(&worker->stmts, job->data);
+}
+
+// Swapping models is cheaper than emitting a row-deleted/row-inserted
+// signal for every row, and leaves the view at the first page
+static void list_job_done(AppData *app, DbJob *job) {
+    gint64 timer = g_get_monotonic_time();
+    ExpenseModel *model = expense_model_new(app->worker, &app->stmts, &app->categories,
+                                            &app->payment_types, job->data);
+    job->data = NULL; // Now owned by the model
+    app->list_pending = FALSE;
+
+    gtk_tree_view_set_model(GTK_TREE_VIEW(app->expense_table), GTK_TREE_MODEL(model));
+    expense_model_retire(app->expense_model);
+    g_object_unref(app->expense_model);
+    app->expense_model = model;
+
+    app->current_page = 0;
+    reset_selection(app);
+    update_page_count(app);
+    stats_record_since("list_job_done", timer);
+}
+
+// Replaces the table's model with a fresh lazy view of the active filter.
+// The DB worker counts the rows and locates the row blocks; a newer filter
+// change supersedes one still in flight.
+static void refresh_expense_view(AppData *app) {
+    ExpenseIndex *index = expense_index_new(app->storage.archive_years, &app->order, app->filter_category_id,
+                                            app->filter_from_date, app->filter_to_date, app->filter_fts_query);
+    app->list_pending = TRUE;
+    db_worker_submit(app->worker, app, DB_JOB_LIST, run_list_job, list_job_done,
+                     index, expense_index_free);
+}
+
+static void update_page_count(AppData *app) {
+    int n_rows = expense_model_get_n_rows(app->expense_model);
+    app->total_pages = MAX(1, (n_rows + PAGE_SIZE - 1) / PAGE_SIZE);
+    update_page_label(app);
+}
+
+// Sorts the list by a clicked header, or reverses the sort if it is the
+// current one. Dates and amounts start largest first, the others from the
+// top of their order.
+static void sort_column_clicked(GtkTreeViewColumn *column, AppData *app) {
+    gint sort = GPOINTER_TO_INT(g_object_get_data(G_OBJECT(column), "sort-column"));
+
+    if (column == app->sorted_column) {
+        app->order.ascending = !app->order.ascending;
+    } else {
+        gtk_tree_view_column_set_sort_indicator(app->sorted_column, FALSE);
+        app->sorted_column = column;
+        app->order.column = sort;
+        app->order.ascending = sort != EXPENSE_SORT_DATE && sort != EXPENSE_SORT_AMOUNT;
+    }
+    gtk_tree_view_column_set_sort_indicator(column, TRUE);
+    gtk_tree_view_column_set_sort_order(column, app->order.ascending ? GTK_SORT_ASCENDING : GTK_SORT_DESCENDING);
+    refresh_expense_view(app);
+}
+
+// Single-row deltas apply only to a model showing the current database.
+// Search results are ranked and capped, so they are cheaper to rerun, and
+// a reload already queued may have read the table before the change.
+static gboolean can_apply_delta(AppData *app) {
+    return !app->list_pending && app->filter_fts_query == NULL;
+}
+
+// Reads the row with row->id, which places it in any list order.
+// Returns FALSE if it is gone.
+static gboolean load_expense_row(AppData *app, ExpenseRow *row) {
+    sqlite3_stmt *stmt = stmt_cache_get(&app->stmts, SQL_SELECT_EXPENSE_ROW);
+    gboolean found = FALSE;
+
+    if (stmt != NULL) {
+        sqlite3_bind_int(stmt, 1, row->id);
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            row->description = g_strdup((const char *)sqlite3_column_text(stmt, 0));
+            row->amount = sqlite3_column_double(stmt, 1);
+            row->payment_type_id = sqlite3_column_int(stmt, 2);
+            row->date = g_strdup((const char *)sqlite3_column_text(stmt, 3));
+            row->category_id = sqlite3_column_int(stmt, 4);
+            found = TRUE;
+        }
+        sqlite3_reset(stmt);
+    }
+    return found;
+}
+
+// Shows a newly inserted row in place, keeping the filter and scroll
+// position, instead of reloading the list
+static void expense_added(AppData *app, gint id) {
+    ExpenseRow row = {.id = id};
+
+    if (!can_apply_delta(app) || !load_expense_row(app, &row) ||
+        !expense_model_insert(app->expense_model, &row)) {
+        refresh_expense_view(app);
+    }
+    update_page_count(app);
+    expense_row_clear(&row);
+}
+
+// Redraws an edited row in place, or moves it if its place in the list
+// changed. old holds the row's values before the edit.
+static void expense_edited(AppData *app, const ExpenseRow *old) {
+    ExpenseRow row = {.id = old->id};
+    gboolean applied = FALSE;
+
+    if (can_apply_delta(app) && old->date != NULL && old->category_id > 0 &&
+        load_expense_row(app, &row)) {
+        applied = expense_model_update(app->expense_model, old, &row);
+    }
+    if (!applied) {
+        refresh_expense_view(app);
+    }
+    update_page_count(app);
+    expense_row_clear(&row);
+}
+
+// Drops a deleted row from the list; old holds its values before the delete
+static void expense_deleted(AppData *app, const ExpenseRow *old) {
+    if (!can_apply_delta(app) || old->date == NULL || old->category_id <= 0 ||
+        !expense_model_remove(app->expense_model, old)) {
+        refresh_expense_view(app);
+    }
+    update_page_count(app);
+}
+
+// The table scrolls through the whole filtered set; a page is the
+// PAGE_SIZE rows starting at the top visible row, and the page buttons
+// jump the view by that much.
+static void update_page_label(AppData *app) {
+    GtkTreePath *first = NULL;
+    if (gtk_tree_view_get_visible_range(GTK_TREE_VIEW(app->expense_table), &first, NULL)) {
+        app->current_page = gtk_tree_path_get_indices(first)[0] / PAGE_SIZE;
+        gtk_tree_path_free(first);
+    }
+
+    char page_text[64];
+    g_snprintf(page_text, sizeof(page_text), "Page %d of %d (%d expenses)",
+               app->current_page + 1, app->total_pages,
+               expense_model_get_n_rows(app->expense_model));
+    gtk_label_set_text(GTK_LABEL(app->page_label), page_text);
+    gtk_widget_set_sensitive(app->prev_button, app->current_page > 0);
+    gtk_widget_set_sensitive(app->next_button, app->current_page + 1 < app->total_pages);
+}
+
+static void scroll_to_page(AppData *app, int page) {
+    GtkTreePath *path = gtk_tree_path_new_from_indices(page * PAGE_SIZE, -1);
+    gtk_tree_view_scroll_to_cell(GTK_TREE_VIEW(app->expense_table), path, NULL, TRUE, 0.0, 0.0);
+    gtk_tree_path_free(path);
+    app->current_page = page;
+    update_page_label(app);
+}
+
+static void init_pagination_section(AppData *app, GtkWidget *main_box) {
+    app->pagination_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
+
+    app->prev_button = gtk_button_new_with_label("Previous");
+    app->next_button = gtk_button_new_with_label("Next");
+    app->page_label = gtk_label_new("Page 1 of 1");
+
+    gtk_box_pack_start(GTK_BOX(app->pagination_box), app->prev_button, FALSE, FALSE, 5);
+    gtk_box_pack_start(GTK_BOX(app->pagination_box), app->page_label, TRUE, TRUE, 5);
+    gtk_box_pack_end(GTK_BOX(app->pagination_box), app->next_button, FALSE, FALSE, 5);
+
+    gtk_box_pack_start(GTK_BOX(main_box), app->pagination_box, FALSE, FALSE, 5);
+
+    app->current_page = 0;
+    app->total_pages = 1;
+
+    g_signal_connect(app->prev_button, "clicked", G_CALLBACK(prev_page), app);
+    g_signal_connect(app->next_button, "clicked", G_CALLBACK(next_page), app);
+}
+
+static void prev_page(GtkButton *button, AppData *app) {
+    if (app->current_page > 0) {
+        scroll_to_page(app, app->current_page - 1);
+    }
+}
+
+static void next_page(GtkButton *button, AppData *app) {
+    if (app->current_page + 1 < app->total_pages) {
+        scroll_to_page(app, app->current_page + 1);
+    }
+}
+
+// A CSV export running on its own thread and connection, so that a long
+// export neither blocks the UI nor holds up the DB worker's queries
+typedef struct _ExportJob {
+    AppData *app;
+    GThread *thread;
+    gint category_id;           // Filter of the exported view, 0 for all
+    gchar *from_date;           // Date range of the exported view, NULL for an open end
+    gchar *to_date;
+    gchar *fts_query;           // Search of the exported view, NULL for none
+    ExpenseOrder order;         // Order of the exported view; all zero is date order
+    const GArray *archives;     // Archived years, from the storage profile
+    gint total;                 // Rows expected, 0 until known (atomic)
+    gint rows;                  // Rows written so far (atomic)
+    gint cancelled;             // Set from the main loop to stop early (atomic)
+    gboolean failed;
+    guint progress_source;
+    guint finished_source;      // export_finished, queued by the thread as it ends
+} ExportJob;
+
+// Writes one field, quoted as RFC 4180 requires when it holds a comma,
+// quote or line break, with embedded quotes doubled
+static void write_csv_field(FILE *fp, const char *text) {
+    if (text == NULL) {
+        return;
+    }
+    if (strpbrk(text, ",\"\r\n") == NULL) {
+        fputs(text, fp);
+        return;
+    }
+
+    putc('"', fp);
+    for (const char *quote; (quote = strchr(text, '"')) != NULL; text = quote + 1) {
+        fwrite(text, 1, quote - text + 1, fp);
+        putc('"', fp);
+    }
+    fputs(text, fp);
+    putc('"', fp);
+}
+
+// Builds the export query: everything in date order, or the rows of the
+// filtered view in the view's own order. The dictionaries turn the ids
+// back into names; looking them up per row rather than joining them keeps
+// the partitions of the ledger mergeable in date order, which needs the
+// date and id among the results. The category and payment type orders
+// sort the merged rows instead, as their ids are not exported.
+#define EXPORT_COLUMNS \
+    "SELECT e.amount, e.description, " \
+    "(SELECT name FROM categories WHERE id = e.category_id), " \
+    "(SELECT name FROM payment_types WHERE id = e.payment_type_id), e.date, e.id FROM "
+
+static gchar *build_export_sql(const ExportJob *export) {
+    GString *sql = g_string_new(EXPORT_COLUMNS);
+
+    // A search exports the matches the list shows
+    if (export->fts_query != NULL) {
+        append_search_matches(sql, export->archives, export->category_id, export->from_date,
+                              export->to_date, SEARCH_RANK_WINDOW);
+        g_string_append_printf(sql, " ORDER BY e.rank LIMIT %d", SEARCH_RESULT_LIMIT);
+        return g_string_free(sql, FALSE);
+    }
+
+    const char *glue = " WHERE ";
+    append_partitions(sql, export->archives, export->from_date, export->to_date);
+    g_string_append(sql, " e");
+    if (export->category_id > 0) {
+        g_string_append(sql, " WHERE e.category_id = ?");
+        glue = " AND ";
+    }
+    append_date_range(sql, &glue, "e.date", export->from_date, export->to_date);
+    append_order_by(sql, &export->order);
+    return g_string_free(sql, FALSE);
+}
+
+// Streams the query result into fp. Returns FALSE on an SQL error.
+static gboolean write_export_rows(ExportJob *export, sqlite3 *db, FILE *fp) {
+    sqlite3_stmt *stmt;
+    gchar *sql = build_export_sql(export);
+    int rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+    g_free(sql);
+
+    if (rc != SQLITE_OK) {
+        g_print("SQL error: %s\n", sqlite3_errmsg(db));
+        return FALSE;
+    }
+
+    int param = 1;
+    if (export->fts_query != NULL) {
+        bind_search_matches(stmt, &param, export->fts_query, export->category_id, export->from_date,
+                            export->to_date, SEARCH_RANK_WINDOW);
+    } else {
+        if (export->category_id > 0) {
+            sqlite3_bind_int(stmt, param++, export->category_id);
+        }
+        bind_date_range(stmt, &param, export->from_date, export->to_date);
+    }
+
+    // Write CSV header
+    fputs("Amount,Description,Category,Payment Type,Date\r\n", fp);
+
+    int rows = 0;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        for (int i = 0; i < 5; i++) {
+            if (i > 0) {
+                putc(',', fp);
+            }
+            write_csv_field(fp, (const char *)sqlite3_column_text(stmt, i));
+        }
+        fputs("\r\n", fp);
+
+        if (++rows % EXPORT_CHECK_ROWS == 0) {
+            g_atomic_int_set(&export->rows, rows);
+            if (g_atomic_int_get(&export->cancelled)) {
+                break;
+            }
+        }
+    }
+    g_atomic_int_set(&export->rows, rows);
+
+    if (rc != SQLITE_ROW && rc != SQLITE_DONE) {
+        g_print("SQL error: %s\n", sqlite3_errmsg(db));
+    }
+    sqlite3_finalize(stmt);
+    return rc == SQLITE_ROW || rc == SQLITE_DONE;
+}
+
+static gboolean export_finished(gpointer data);
+
+// Writes to a temporary file that replaces EXPORT_FILE only once complete,
+// so a cancelled or failed export leaves any earlier export intact
+static gpointer export_thread(gpointer data) {
+    ExportJob *export = data;
+    const char *part_file = EXPORT_FILE ".part";
+    sqlite3 *db = open_connection(&export->app->storage);
+    FILE *fp = db != NULL ? fopen(part_file, "w") : NULL;
+
+    if (fp == NULL) {
+        export->failed = TRUE;
+    } else {
+        setvbuf(fp, NULL, _IOFBF, EXPORT_BUFFER_SIZE);
+
+        // The whole ledger's size is a sum over the category summary rows
+        if (g_atomic_int_get(&export->total) == 0) {
+            sqlite3_stmt *stmt;
+            if (sqlite3_prepare_v2(db, "SELECT SUM(n) FROM category_totals", -1, &stmt, NULL) == SQLITE_OK) {
+                if (sqlite3_step(stmt) == SQLITE_ROW) {
+                    g_atomic_int_set(&export->total, sqlite3_column_int(stmt, 0));
+                }
+                sqlite3_finalize(stmt);
+            }
+        }
+
+        export->failed = !write_export_rows(export, db, fp);
+        export->failed |= fclose(fp) != 0;
+
+        if (export->failed || g_atomic_int_get(&export->cancelled)) {
+            g_remove(part_file);
+        } else if (g_rename(part_file, EXPORT_FILE) != 0) {
+            export->failed = TRUE;
+        }
+    }
+
+    sqlite3_close(db);
+    export->finished_source = g_idle_add(export_finished, export);
+    return NULL;
+}
+
+static gboolean export_progress_tick(gpointer data) {
+    ExportJob *export = data;
+    int total = g_atomic_int_get(&export->total);
+    int rows = g_atomic_int_get(&export->rows);
+    char progress_text[64];
+
+    if (total > 0) {
+        gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(export->app->export_progress),
+            rows < total ? (double)rows / total : 1.0);
+        g_snprintf(progress_text, sizeof(progress_text), "%d / %d rows", rows, total);
+    } else {
+        gtk_progress_bar_pulse(GTK_PROGRESS_BAR(export->app->export_progress));
+        g_snprintf(progress_text, sizeof(progress_text), "%d rows", rows);
+    }
+    gtk_progress_bar_set_text(GTK_PROGRESS_BAR(export->app->export_progress), progress_text);
+    return G_SOURCE_CONTINUE;
+}
+
+// Joins the thread unless export_wait already has
+static void export_job_free(ExportJob *export) {
+    if (export->thread != NULL) {
+        g_thread_join(export->thread);
+    }
+    g_free(export->from_date);
+    g_free(export->to_date);
+    g_free(export->fts_query);
+    g_free(export);
+}
+
+static gboolean export_finished(gpointer data) {
+    ExportJob *export = data;
+    AppData *app = export->app;
+    GtkWidget *dialog;
+
+    g_source_remove(export->progress_source);
+    gtk_widget_hide(app->export_progress);
+    gtk_widget_hide(app->export_cancel_button);
+    gtk_widget_set_sensitive(app->export_button, TRUE);
+    app->export_job = NULL;
+
+    if (export->failed) {
+        dialog = gtk_message_dialog_new(GTK_WINDOW(app->window),
+            GTK_DIALOG_DESTROY_WITH_PARENT,
+            GTK_MESSAGE_ERROR,
+            GTK_BUTTONS_CLOSE,
+            "Failed to write export file");
+    } else if (export->cancelled) {
+        dialog = gtk_message_dialog_new(GTK_WINDOW(app->window),
+            GTK_DIALOG_DESTROY_WITH_PARENT,
+            GTK_MESSAGE_INFO,
+            GTK_BUTTONS_CLOSE,
+            "Export cancelled");
+    } else {
+        dialog = gtk_message_dialog_new(GTK_WINDOW(app->window),
+            GTK_DIALOG_DESTROY_WITH_PARENT,
+            GTK_MESSAGE_INFO,
+            GTK_BUTTONS_CLOSE,
+            "%d expenses exported successfully to " EXPORT_FILE, export->rows);
+    }
+    export_job_free(export);
+    gtk_dialog_run(GTK_DIALOG(dialog));
+    gtk_widget_destroy(dialog);
+    return G_SOURCE_REMOVE;
+}
+
+// Starts a CSV export of every expense, or of the filtered view when
+// "Current view only" is ticked; the button stays disabled until done
+static void export_to_excel(GtkButton *button, AppData *app) {
+    ExportJob *export = g_new0(ExportJob, 1);
+    export->app = app;
+    export->archives = app->storage.archive_years;
+
+    if (gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(app->export_view_check))) {
+        export->category_id = app->filter_category_id;
+        export->from_date = g_strdup(app->filter_from_date);
+        export->to_date = g_strdup(app->filter_to_date);
+        export->fts_query = g_strdup(app->filter_fts_query);
+        export->order = app->order;
+        export->total = expense_model_get_n_rows(app->expense_model);
+    }
+
+    app->export_job = export;
+    gtk_widget_set_sensitive(app->export_button, FALSE);
+    gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(app->export_progress), 0);
+    gtk_progress_bar_set_text(GTK_PROGRESS_BAR(app->export_progress), NULL);
+    gtk_widget_show(app->export_progress);
+    gtk_widget_show(app->export_cancel_button);
+
+    export->progress_source = g_timeout_add(100, export_progress_tick, export);
+    export->thread = g_thread_new("export", export_thread, export);
+}
+
+static void cancel_export(GtkButton *button, AppData *app) {
+    if (app->export_job != NULL) {
+        g_atomic_int_set(&app->export_job->cancelled, TRUE);
+    }
+}
+
+// Stops an export still running at shutdown; its partial file is removed.
+// The main loop has ended, so the export_finished the thread queued
+// never runs: its source and the job are cleaned up here instead.
+static void export_wait(AppData *app) {
+    ExportJob *export = app->export_job;
+    if (export != NULL) {
+        g_atomic_int_set(&export->cancelled, TRUE);
+        g_thread_join(export->thread);
+        export->thread = NULL;
+        g_source_remove(export->progress_source);
+        g_source_remove(export->finished_source);
+        export_job_free(export);
+        app->export_job = NULL;
+    }
+}
+
+// A CSV import running on its own thread and connection. Rows go through
+// one prepared statement in transactions of IMPORT_BATCH_ROWS rows.
+typedef struct _ImportJob {
+    AppData *app;
+    GThread *thread;
+    gchar *filename;
+    gint progress;              // Share of the file read, in 1/1000 (atomic)
+    gint stopping;              // Set at shutdown to stop after the current row (atomic)
+    gboolean failed;            // The file could not be read or a batch not committed
+    int imported;
+    int rejected;
+    GString *errors;            // The first IMPORT_MAX_REPORTED_ERRORS rejections
+    guint progress_source;
+    guint finished_source;      // import_finished, queued by the thread as it ends
+} ImportJob;
+
+// Reads one RFC 4180 record into buf as NUL-terminated fields, storing
+// where each starts in starts. Quoted fields may hold commas, doubled
+// quotes and line breaks. Returns the number of fields, which may exceed
+// max_fields (the rest are dropped), or -1 at end of file.
+static int read_csv_record(FILE *fp, GString *buf, gsize *starts, int max_fields) {
+    int n_fields = 0;
+    gboolean quoted = FALSE;
+    int c = getc(fp);
+
+    if (c == EOF) {
+        return -1;
+    }
+    g_string_truncate(buf, 0);
+    starts[n_fields++] = 0;
+
+    for (; c != EOF; c = getc(fp)) {
+        if (quoted) {
+            if (c != '"') {
+                g_string_append_c(buf, c);
+            } else if ((c = getc(fp)) == '"') {
+                g_string_append_c(buf, '"');
+            } else {
+                quoted = FALSE;
+                ungetc(c, fp);
+            }
+        } else if (c == '"') {
+            quoted = TRUE;
+        } else if (c == ',') {
+            g_string_append_c(buf, '\0');
+            if (n_fields < max_fields) {
+                starts[n_fields] = buf->len;
+            }
+            n_fields++;
+        } else if (c == '\n') {
+            break;
+        } else if (c != '\r') {
+            g_string_append_c(buf, c);
+        }
+    }
+    return n_fields;
+}
+
+// Maps every name of a dictionary table to its id. The import thread reads
+// its own copy so the main loop can keep adding entries meanwhile.
+static GHashTable *load_name_ids(sqlite3 *db, const char *table) {
+    GHashTable *ids = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    gchar *sql = g_strdup_printf("SELECT id, name FROM %s", table);
+    sqlite3_stmt *stmt;
+
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) == SQLITE_OK) {
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            g_hash_table_insert(ids, g_strdup((const char *)sqlite3_column_text(stmt, 1)),
+                                GINT_TO_POINTER(sqlite3_column_int(stmt, 0)));
+        }
+        sqlite3_finalize(stmt);
+    } else {
+        g_print("SQL error: %s\n", sqlite3_errmsg(db));
+    }
+    g_free(sql);
+    return ids;
+}
+
+// Checks one record, in the columns export_to_excel writes, and returns
+// why it cannot be imported or NULL if it can. Resolves the category and
+// payment type names to their ids.
+static const char *validate_import_record(char **fields, int n_fields, GHashTable *category_ids,
+                                          GHashTable *payment_type_ids, double *amount,
+                                          gint *category_id, gint *payment_type_id) {
+    char *end;
+
+    if (n_fields != 5) {
+        return "expected 5 fields (Amount, Description, Category, Payment Type, Date)";
+    }
+    *amount = g_ascii_strtod(fields[0], &end);
+    if (end == fields[0] || *end != '\0' || !isfinite(*amount)) {
+        return "amount is not a number";
+    }
+    if ((*category_id = GPOINTER_TO_INT(g_hash_table_lookup(category_ids, fields[2]))) == 0) {
+        return "unknown category";
+    }
+    if ((*payment_type_id = GPOINTER_TO_INT(g_hash_table_lookup(payment_type_ids, fields[3]))) == 0) {
+        return "unknown payment type";
+    }
+    if (!is_valid_date(fields[4])) {
+        return "date is not YYYY-MM-DD";
+    }
+    return NULL;
+}
+
+static void import_reject(ImportJob *import, int record, const char *reason) {
+    if (import->rejected++ < IMPORT_MAX_REPORTED_ERRORS) {
+        g_string_append_printf(import->errors, "Row %d: %s\n", record, reason);
+    }
+}
+
+// Inserts every valid record of fp. Returns FALSE if a batch failed to
+// commit; the batches before it stay imported.
+static gboolean import_rows(ImportJob *import, sqlite3 *db, FILE *fp, long file_size) {
+    sqlite3_stmt *stmt;
+    GString *buf = g_string_new(NULL);
+    gsize starts[5];
+    char *fields[5];
+    int n_fields;
+    int record = 0;
+    int batch_rows = 0;
+    gboolean ok = TRUE;
+
+    if (sqlite3_prepare_v3(db, SQL_IMPORT_EXPENSE, -1, SQLITE_PREPARE_PERSISTENT, &stmt, NULL) != SQLITE_OK) {
+        g_print("SQL error: %s\n", sqlite3_errmsg(db));
+        g_string_free(buf, TRUE);
+        return FALSE;
+    }
+    GHashTable *category_ids = load_name_ids(db, "categories");
+    GHashTable *payment_type_ids = load_name_ids(db, "payment_types");
+
+    sqlite3_exec(db, "BEGIN", 0, 0, NULL);
+    while (ok && !g_atomic_int_get(&import->stopping) &&
+           (n_fields = read_csv_record(fp, buf, starts, 5)) >= 0) {
+        record++;
+
+        // Skip the header and blank lines
+        if (n_fields == 1 && buf->len == 0) {
+            continue;
+        }
+        for (int i = 0; i < MIN(n_fields, 5); i++) {
+            fields[i] = buf->str + starts[i];
+        }
+        if (record == 1 && strcmp(fields[0], "Amount") == 0) {
+            continue;
+        }
+
+        double amount;
+        gint category_id, payment_type_id;
+        const char *error = validate_import_record(fields, n_fields, category_ids, payment_type_ids,
+                                                   &amount, &category_id, &payment_type_id);
+        if (error != NULL) {
+            import_reject(import, record, error);
+            continue;
+        }
+
+        sqlite3_bind_double(stmt, 1, amount);
+        sqlite3_bind_text(stmt, 2, fields[1], -1, SQLITE_STATIC);
+        sqlite3_bind_int(stmt, 3, category_id);
+        sqlite3_bind_int(stmt, 4, payment_type_id);
+        sqlite3_bind_text(stmt, 5, fields[4], -1, SQLITE_STATIC);
+        int rc = sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+        if (rc != SQLITE_DONE) {
+            import_reject(import, record, sqlite3_errmsg(db));
+            continue;
+        }
+        import->imported++;
+
+        if (++batch_rows == IMPORT_BATCH_ROWS) {
+            ok = sqlite3_exec(db, "COMMIT; BEGIN", 0, 0, NULL) == SQLITE_OK;
+            batch_rows = 0;
+            if (file_size > 0) {
+                g_atomic_int_set(&import->progress, (int)(ftell(fp) * 1000 / file_size));
+            }
+        }
+    }
+
+    if (ok && sqlite3_exec(db, "COMMIT", 0, 0, NULL) != SQLITE_OK) {
+        ok = FALSE;
+    }
+    if (!ok) {
+        g_print("SQL error: %s\n", sqlite3_errmsg(db));
+        sqlite3_exec(db, "ROLLBACK", 0, 0, NULL);
+    }
+
+    sqlite3_finalize(stmt);
+    g_hash_table_destroy(category_ids);
+    g_hash_table_destroy(payment_type_ids);
+    g_string_free(buf, TRUE);
+    return ok;
+}
+
+static gboolean import_finished(gpointer data);
+
+static gpointer import_thread(gpointer data) {
+    ImportJob *import = data;
+    sqlite3 *db = open_connection(&import->app->storage);
+    FILE *fp = db != NULL ? fopen(import->filename, "r") : NULL;
+
+    if (fp == NULL) {
+        import->failed = TRUE;
+    } else {
+        setvbuf(fp, NULL, _IOFBF, EXPORT_BUFFER_SIZE);
+        fseek(fp, 0, SEEK_END);
+        long file_size = ftell(fp);
+        rewind(fp);
+
+        import->failed = !import_rows(import, db, fp, file_size);
+        fclose(fp);
+    }
+
+    sqlite3_close(db);
+    import->finished_source = g_idle_add(import_finished, import);
+    return NULL;
+}
+
+static gboolean import_progress_tick(gpointer data) {
+    ImportJob *import = data;
+    gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(import->app->import_progress),
+                                  g_atomic_int_get(&import->progress) / 1000.0);
+    return G_SOURCE_CONTINUE;
+}
+
+// Joins the thread unless import_wait already has
+static void import_job_free(ImportJob *import) {
+    if (import->thread != NULL) {
+        g_thread_join(import->thread);
+    }
+    g_free(import->filename);
+    g_string_free(import->errors, TRUE);
+    g_free(import);
+}
+
+// Refreshes the list, budget and charts once for the whole import
+static gboolean import_finished(gpointer data) {
+    ImportJob *import = data;
+    AppData *app = import->app;
+
+    g_source_remove(import->progress_source);
+    gtk_widget_hide(app->import_progress);
+    gtk_widget_set_sensitive(app->import_button, TRUE);
+    app->import_job = NULL;
+
+    if (import->imported > 0) {
+        // The import wrote through its own connection, past the update hook
+        if (app->storage.columnar_cache) {
+            load_expense_columns(app);
+        }
+        load_descriptions(app);
+        refresh_expense_view(app);
+        update_budget_progress(app);
+        update_charts(app);
+    }
+
+    GtkWidget *dialog;
+    if (import->failed && import->imported == 0) {
+        dialog = gtk_message_dialog_new(GTK_WINDOW(app->window),
+            GTK_DIALOG_DESTROY_WITH_PARENT,
+            GTK_MESSAGE_ERROR,
+            GTK_BUTTONS_CLOSE,
+            "Failed to import %s", import->filename);
+    } else {
+        dialog = gtk_message_dialog_new(GTK_WINDOW(app->window),
+            GTK_DIALOG_DESTROY_WITH_PARENT,
+            import->rejected > 0 || import->failed ? GTK_MESSAGE_WARNING : GTK_MESSAGE_INFO,
+            GTK_BUTTONS_CLOSE,
+            "%d expenses imported, %d rows rejected%s",
+            import->imported, import->rejected,
+            import->failed ? "; the import stopped on a database error" : "");
+        if (import->rejected > 0) {
+            if (import->rejected > IMPORT_MAX_REPORTED_ERRORS) {
+                g_string_append_printf(import->errors, "... and %d more",
+                                       import->rejected - IMPORT_MAX_REPORTED_ERRORS);
+            }
+            gtk_message_dialog_format_secondary_text(GTK_MESSAGE_DIALOG(dialog), "%s",
+                                                     import->errors->str);
+        }
+    }
+    import_job_free(import);
+    gtk_dialog_run(GTK_DIALOG(dialog));
+    gtk_widget_destroy(dialog);
+    return G_SOURCE_REMOVE;
+}
+
+// Asks for a CSV file in the export layout and imports it in the background
+static void import_csv(GtkButton *button, AppData *app) {
+    GtkWidget *chooser = gtk_file_chooser_dialog_new("Import Expenses",
+        GTK_WINDOW(app->window),
+        GTK_FILE_CHOOSER_ACTION_OPEN,
+        "_Cancel", GTK_RESPONSE_CANCEL,
+        "_Import", GTK_RESPONSE_ACCEPT,
+        NULL);
+    GtkFileFilter *filter = gtk_file_filter_new();
+    gtk_file_filter_set_name(filter, "CSV files");
+    gtk_file_filter_add_pattern(filter, "*.csv");
+    gtk_file_chooser_add_filter(GTK_FILE_CHOOSER(chooser), filter);
+
+    gchar *filename = NULL;
+    if (gtk_dialog_run(GTK_DIALOG(chooser)) == GTK_RESPONSE_ACCEPT) {
+        filename = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(chooser));
+    }
+    gtk_widget_destroy(chooser);
+    if (filename == NULL) {
+        return;
+    }
+
+    ImportJob *import = g_new0(ImportJob, 1);
+    import->app = app;
+    import->filename = filename;
+    import->errors = g_string_new(NULL);
+
+    app->import_job = import;
+    gtk_widget_set_sensitive(app->import_button, FALSE);
+    gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(app->import_progress), 0);
+    gtk_widget_show(app->import_progress);
+
+    import->progress_source = g_timeout_add(100, import_progress_tick, import);
+    import->thread = g_thread_new("import", import_thread, import);
+}
+
+// Stops an import still running at shutdown, keeping the rows it has
+// inserted so far, and cleans up as export_wait does
+static void import_wait(AppData *app) {
+    ImportJob *import = app->import_job;
+    if (import != NULL) {
+        g_atomic_int_set(&import->stopping, TRUE);
+        g_thread_join(import->thread);
+        import->thread = NULL;
+        g_source_remove(import->progress_source);
+        g_source_remove(import->finished_source);
+        import_job_free(import);
+        app->import_job = NULL;
+    }
+}
+
+// An online backup through SQLite's backup API. It copies
+// BACKUP_STEP_PAGES pages per step from the connection the UI writes on,
+// so a write made between steps goes into the copy too rather than
+// restarting it, and the copy is a consistent snapshot once complete.
+typedef struct _BackupJob {
+    AppData *app;               // NULL outside the UI (benchmark)
+    sqlite3 *db;                // Destination connection
+    sqlite3_backup *backup;
+    gchar *file;
+    gchar *part_file;           // Written until complete, then renamed to file
+    int rc;                     // Result of the last step
+    gint64 started;             // Monotonic time the backup began
+    gint64 elapsed;             // Duration of the whole backup, once ended
+    gint64 bytes;               // Size of the copy, once complete
+    gboolean manual;            // Started by the button, so the result is shown
+    guint source;               // Idle or wait source driving the steps
+} BackupJob;
+
+// Starts backing up source's schema, main or an attached archive, into
+// file. Returns NULL if the destination cannot be opened.
+static BackupJob *backup_begin(sqlite3 *source, const char *schema, const char *file) {
+    BackupJob *backup = g_new0(BackupJob, 1);
+    backup->file = g_strdup(file);
+    backup->part_file = g_strconcat(file, ".partial", NULL);
+    backup->rc = SQLITE_OK;
+    backup->started = g_get_monotonic_time();
+
+    g_remove(backup->part_file);
+    if (sqlite3_open(backup->part_file, &backup->db) == SQLITE_OK) {
+        backup->backup = sqlite3_backup_init(backup->db, "main", source, schema);
+    }
+    if (backup->backup == NULL) {
+        g_print("SQL error: %s\n", sqlite3_errmsg(backup->db));
+        sqlite3_close(backup->db);
+        g_remove(backup->part_file);
+        g_free(backup->file);
+        g_free(backup->part_file);
+        g_free(backup);
+        return NULL;
+    }
+    return backup;
+}
+
+// Copies the next BACKUP_STEP_PAGES pages. Returns SQLITE_OK while pages
+// remain and SQLITE_DONE once the copy is complete; SQLITE_BUSY and
+// SQLITE_LOCKED mean try again later, anything else that it failed.
+static int backup_step(BackupJob *backup) {
+    gint64 timer = g_get_monotonic_time();
+    backup->rc = sqlite3_backup_step(backup->backup, BACKUP_STEP_PAGES);
+    stats_record_since("backup_step", timer);
+    return backup->rc;
+}
+
+static double backup_fraction(BackupJob *backup) {
+    int total = sqlite3_backup_pagecount(backup->backup);
+    return total > 0 ? 1.0 - (double)sqlite3_backup_remaining(backup->backup) / total : 0.0;
+}
+
+// Finishes a backup, renaming the copy into place if it completed and
+// removing it otherwise. Returns TRUE if file now holds the backup.
+static gboolean backup_end(BackupJob *backup) {
+    gboolean complete = backup->rc == SQLITE_DONE;
+    GStatBuf st;
+
+    sqlite3_backup_finish(backup->backup);
+    complete = sqlite3_close(backup->db) == SQLITE_OK && complete;
+    if (complete && g_stat(backup->part_file, &st) == 0) {
+        backup->bytes = st.st_size;
+    }
+    if (complete && g_rename(backup->part_file, backup->file) != 0) {
+        complete = FALSE;
+    }
+    if (!complete) {
+        g_remove(backup->part_file);
+    }
+    backup->elapsed = g_get_monotonic_time() - backup->started;
+    return complete;
+}
+
+static void backup_job_free(BackupJob *backup) {
+    g_free(backup->file);
+    g_free(backup->part_file);
+    g_free(backup);
+}
+
+static gint compare_paths(gconstpointer a, gconstpointer b) {
+    return strcmp(*(const gchar *const *)a, *(const gchar *const *)b);
+}
+
+// The database file's name without its extension, which starts the name
+// of each of its backups and archives
+static gchar *database_prefix(const StorageProfile *profile) {
+    gchar *name = g_path_get_basename(profile->database_file);
+    gchar *dot = strrchr(name, '.');
+    if (dot != NULL && dot != name) {
+        *dot = '\0';
+    }
+    gchar *prefix = g_strconcat(name, "-", NULL);
+    g_free(name);
+    return prefix;
+}
+
+// Whether name is prefix, a YYYYMMDD-HHMMSS timestamp and suffix: the
+// name of a backup. Archives share the prefix, and may share the
+// directory, so rotation must not take them for backups.
+static gboolean is_backup_name(const gchar *name, const gchar *prefix, const char *suffix) {
+    static const char stamp[] = "dddddddd-dddddd";
+    gsize prefix_len = strlen(prefix);
+
+    if (!g_str_has_prefix(name, prefix) || !g_str_has_suffix(name, suffix) ||
+        strlen(name) != prefix_len + strlen(stamp) + strlen(suffix)) {
+        return FALSE;
+    }
+    for (gsize i = 0; stamp[i] != '\0'; i++) {
+        char c = name[prefix_len + i];
+        if (stamp[i] == 'd' ? !g_ascii_isdigit(c) : c != stamp[i]) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+// The backup files of the profile's database ending in suffix, oldest
+// first: names carry a YYYYMMDD-HHMMSS timestamp, so they sort by age
+static GPtrArray *list_backups(const StorageProfile *profile, const char *suffix) {
+    GPtrArray *files = g_ptr_array_new_with_free_func(g_free);
+    GDir *dir = g_dir_open(profile->backup_dir, 0, NULL);
+    if (dir == NULL) {
+        return files;
+    }
+
+    gchar *prefix = database_prefix(profile);
+    const gchar *name;
+    while ((name = g_dir_read_name(dir)) != NULL) {
+        if (is_backup_name(name, prefix, suffix)) {
+            g_ptr_array_add(files, g_build_filename(profile->backup_dir, name, NULL));
+        }
+    }
+    g_ptr_array_sort(files, compare_paths);
+    g_free(prefix);
+    g_dir_close(dir);
+    return files;
+}
+
+// Real time the newest backup was written, 0 if there is none
+static gint64 newest_backup_time(const StorageProfile *profile) {
+    GPtrArray *files = list_backups(profile, ".db");
+    gint64 newest = 0;
+    GStatBuf st;
+
+    if (files->len > 0 && g_stat(g_ptr_array_index(files, files->len - 1), &st) == 0) {
+        newest = (gint64)st.st_mtime * G_USEC_PER_SEC;
+    }
+    g_ptr_array_free(files, TRUE);
+    return newest;
+}
+
+// Removes the oldest backups past backup_keep, and copies left unfinished
+// by a crash
+static void rotate_backups(const StorageProfile *profile) {
+    GPtrArray *files = list_backups(profile, ".db");
+    for (gint i = 0; profile->backup_keep > 0 && i < (gint)files->len - profile->backup_keep; i++) {
+        g_remove(g_ptr_array_index(files, i));
+    }
+    g_ptr_array_free(files, TRUE);
+
+    files = list_backups(profile, ".db.partial");
+    for (guint i = 0; i < files->len; i++) {
+        g_remove(g_ptr_array_index(files, i));
+    }
+    g_ptr_array_free(files, TRUE);
+}
+
+static void backup_finished(BackupJob *backup) {
+    AppData *app = backup->app;
+    gboolean complete = backup_end(backup);
+
+    gtk_widget_hide(app->backup_progress);
+    gtk_widget_set_sensitive(app->backup_button, TRUE);
+    app->backup_job = NULL;
+
+    gchar *summary;
+    if (complete) {
+        double seconds = backup->elapsed / (double)G_USEC_PER_SEC;
+        double mib = backup->bytes / (1024.0 * 1024.0);
+        app->last_backup = g_get_real_time();
+        rotate_backups(&app->storage);
+        summary = g_strdup_printf("Backed up %.1f MiB to %s in %.2f s (%.1f MiB/s)",
+                                  mib, backup->file, seconds, seconds > 0 ? mib / seconds : 0.0);
+        gtk_widget_set_tooltip_text(app->backup_button, summary);
+    } else {
+        summary = g_strdup_printf("Backup to %s failed", backup->file);
+    }
+    g_print("%s\n", summary);
+
+    if (backup->manual) {
+        GtkWidget *dialog = gtk_message_dialog_new(GTK_WINDOW(app->window),
+            GTK_DIALOG_DESTROY_WITH_PARENT,
+            complete ? GTK_MESSAGE_INFO : GTK_MESSAGE_ERROR,
+            GTK_BUTTONS_CLOSE,
+            "%s", summary);
+        g_free(summary);
+        backup_job_free(backup);
+        gtk_dialog_run(GTK_DIALOG(dialog));
+        gtk_widget_destroy(dialog);
+        return;
+    }
+    g_free(summary);
+    backup_job_free(backup);
+}
+
+static gboolean backup_idle(gpointer data);
+
+static gboolean backup_resume(gpointer data) {
+    BackupJob *backup = data;
+    backup->source = g_idle_add(backup_idle, backup);
+    return G_SOURCE_REMOVE;
+}
+
+// Copies one step whenever the main loop is otherwise idle, so input and
+// redraws, and the inserts they trigger, go first
+static gboolean backup_idle(gpointer data) {
+    BackupJob *backup = data;
+
+    // An import commits through its own connection, and each such commit
+    // would restart the copy; wait until it is done
+    if (backup->app->import_job != NULL) {
+        backup->source = g_timeout_add(BACKUP_WAIT_MS, backup_resume, backup);
+        return G_SOURCE_REMOVE;
+    }
+
+    int rc = backup_step(backup);
+    if (rc == SQLITE_OK) {
+        gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(backup->app->backup_progress),
+                                      backup_fraction(backup));
+        return G_SOURCE_CONTINUE;
+    }
+    // Another connection holds a lock; retrying from an idle source would
+    // spin the main loop until it lets go, so wait and try again
+    if (rc == SQLITE_BUSY || rc == SQLITE_LOCKED) {
+        backup->source = g_timeout_add(BACKUP_WAIT_MS, backup_resume, backup);
+        return G_SOURCE_REMOVE;
+    }
+    backup->source = 0;
+    backup_finished(backup);
+    return G_SOURCE_REMOVE;
+}
+
+// Starts a backup into a new timestamped file in the backup directory,
+// unless one is already running
+static void start_backup(AppData *app, gboolean manual) {
+    if (app->backup_job != NULL) {
+        return;
+    }
+    if (g_mkdir_with_parents(app->storage.backup_dir, 0755) != 0) {
+        g_print("Cannot create backup directory %s\n", app->storage.backup_dir);
+        return;
+    }
+
+    gchar *prefix = database_prefix(&app->storage);
+    GDateTime *now = g_date_time_new_now_local();
+    gchar *stamp = g_date_time_format(now, "%Y%m%d-%H%M%S");
+    gchar *name = g_strconcat(prefix, stamp, ".db", NULL);
+    gchar *file = g_build_filename(app->storage.backup_dir, name, NULL);
+    BackupJob *backup = backup_begin(app->db, "main", file);
+    g_free(file);
+    g_free(name);
+    g_free(stamp);
+    g_date_time_unref(now);
+    g_free(prefix);
+    if (backup == NULL) {
+        return;
+    }
+
+    backup->app = app;
+    backup->manual = manual;
+    app->backup_job = backup;
+    gtk_widget_set_sensitive(app->backup_button, FALSE);
+    gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(app->backup_progress), 0);
+    gtk_widget_show(app->backup_progress);
+    backup->source = g_idle_add(backup_idle, backup);
+}
+
+static void backup_now(GtkButton *button, AppData *app) {
+    start_backup(app, TRUE);
+}
+
+// Starts a scheduled backup once the newest is backup_interval_min old
+static gboolean backup_tick(gpointer data) {
+    AppData *app = data;
+    gint64 interval = (gint64)app->storage.backup_interval_min * 60 * G_USEC_PER_SEC;
+
+    if (app->backup_job == NULL && g_get_real_time() - app->last_backup >= interval) {
+        start_backup(app, FALSE);
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+// Abandons a backup still running at shutdown; its partial copy is removed
+static void backup_wait(AppData *app) {
+    BackupJob *backup = app->backup_job;
+    if (backup != NULL) {
+        if (backup->source != 0) {
+            g_source_remove(backup->source);
+        }
+        backup->rc = SQLITE_ABORT;
+        backup_end(backup);
+        backup_job_free(backup);
+        app->backup_job = NULL;
+    }
+}
+
+// Year archives. With archive_keep_years set, the expenses of the years
+// before those kept move out of the database into one file per
+// ARCHIVE_SPAN_YEARS years, which every connection attaches as
+// archive_<first year>. Grouping the years keeps the archives within what
+// a connection can attach however long the ledger runs. The database stays
+// the size of the recent years, while the summary tables keep covering
+// the archived ones. Archived expenses are history: they are listed,
+// searched and exported, but edits and deletes only reach the database.
+// Backups copy the database alone, so each archive also keeps one copy in
+// backup_dir, rewritten whenever years move into it.
+
+// Schema of an archive, applied with its schema name for each %s. An
+// archive is written at most once a year and otherwise only read, so it
+// keeps a rollback journal, and every index of the expenses table for the
+// list's orders.
+static const char *const ARCHIVE_SCHEMA[] = {
+    "PRAGMA %s.journal_mode = delete",
+    "PRAGMA %s.synchronous = full",
+    "CREATE TABLE IF NOT EXISTS %s.expenses (" ARCHIVE_COLUMNS ")",
+    "CREATE INDEX IF NOT EXISTS %s.idx_expenses_date ON expenses(date)",
+    "CREATE INDEX IF NOT EXISTS %s.idx_expenses_category ON expenses(category_id, date)",
+    "CREATE INDEX IF NOT EXISTS %s.idx_expenses_amount ON expenses(amount, date)",
+    "CREATE INDEX IF NOT EXISTS %s.idx_expenses_description ON expenses(description, date)",
+    "CREATE INDEX IF NOT EXISTS %s.idx_expenses_payment_type ON expenses(payment_type_id, date)",
+    "CREATE INDEX IF NOT EXISTS %s.idx_expenses_category_amount ON expenses(category_id, amount, date)",
+    "CREATE INDEX IF NOT EXISTS %s.idx_expenses_category_description ON expenses(category_id, description, date)",
+    "CREATE INDEX IF NOT EXISTS %s.idx_expenses_category_payment_type "
+    "ON expenses(category_id, payment_type_id, date)",
+    "CREATE INDEX IF NOT EXISTS %s.idx_expenses_day ON expenses(day)",
+    "CREATE VIRTUAL TABLE IF NOT EXISTS %s.expenses_fts USING fts5("
+    "description, content='expenses', content_rowid='id', prefix='2 3')"
+};
+
+// The archive starting at year, named like the database's backups but
+// with just that year
+static gchar *archive_file(const StorageProfile *profile, gint year) {
+    gchar *prefix = database_prefix(profile);
+    gchar *name = g_strdup_printf("%s%04d.db", prefix, year);
+    gchar *file = g_build_filename(profile->archive_dir, name, NULL);
+    g_free(name);
+    g_free(prefix);
+    return file;
+}
+
+// The copy of the archive starting at year kept with the backups
+static gchar *archive_backup_file(const StorageProfile *profile, gint year) {
+    gchar *prefix = database_prefix(profile);
+    gchar *name = g_strdup_printf("%sarchive-%04d.db", prefix, year);
+    gchar *file = g_build_filename(profile->backup_dir, name, NULL);
+    g_free(name);
+    g_free(prefix);
+    return file;
+}
+
+static gint compare_years(gconstpointer a, gconstpointer b) {
+    return *(const gint *)a - *(const gint *)b;
+}
+
+// Lists the archives in archive_dir into archive_years. A connection
+// attaches at most ARCHIVE_MAX_ATTACHED databases, and reading only some
+// of the archives would drop their expenses from the list while the
+// totals still count them, so past that it fails. Returns FALSE then.
+static gboolean find_archives(StorageProfile *profile) {
+    g_array_set_size(profile->archive_years, 0);
+    GDir *dir = g_dir_open(profile->archive_dir, 0, NULL);
+    if (dir == NULL) {
+        return TRUE;
+    }
+
+    gchar *prefix = database_prefix(profile);
+    gsize prefix_len = strlen(prefix);
+    const gchar *name;
+    while ((name = g_dir_read_name(dir)) != NULL) {
+        if (g_str_has_prefix(name, prefix) && strlen(name) == prefix_len + strlen("YYYY.db") &&
+            g_str_has_suffix(name, ".db") && g_ascii_isdigit(name[prefix_len]) &&
+            g_ascii_isdigit(name[prefix_len + 1]) && g_ascii_isdigit(name[prefix_len + 2]) &&
+            g_ascii_isdigit(name[prefix_len + 3])) {
+            gint year = atoi(name + prefix_len);
+            g_array_append_val(profile->archive_years, year);
+        }
+    }
+    g_array_sort(profile->archive_years, compare_years);
+    g_free(prefix);
+    g_dir_close(dir);
+
+    if (profile->archive_years->len > ARCHIVE_MAX_ATTACHED) {
+        g_printerr("%s holds %u archives, more than the %d a connection can attach\n",
+                   profile->archive_dir, profile->archive_years->len, ARCHIVE_MAX_ATTACHED);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+// Attaches the archive starting at year as archive_<year>, unless db
+// already has it. Returns FALSE if it cannot be attached.
+static gboolean attach_archive(sqlite3 *db, const StorageProfile *profile, gint year) {
+    gchar *schema = g_strdup_printf("archive_%d", year);
+    gboolean ok = TRUE;
+
+    if (sqlite3_db_filename(db, schema) == NULL) {
+        gchar *file = archive_file(profile, year);
+        char *attach = sqlite3_mprintf("ATTACH %Q AS %s", file, schema);
+        char *err_msg = 0;
+        if (sqlite3_exec(db, attach, 0, 0, &err_msg) != SQLITE_OK) {
+            g_print("SQL error: %s\n", err_msg);
+            sqlite3_free(err_msg);
+            ok = FALSE;
+        }
+        sqlite3_free(attach);
+        g_free(file);
+    }
+    g_free(schema);
+    return ok;
+}
+
+// Attaches the archives db does not have yet, and (re)creates its
+// temporary ledger view: all the expenses, archived or not, for queries
+// that cover every year. Returns FALSE if an archive cannot be attached,
+// since the view would then leave its expenses out.
+static gboolean attach_archives(sqlite3 *db, const StorageProfile *profile) {
+    GString *sql = g_string_new("DROP VIEW IF EXISTS temp.ledger;"
+                                "CREATE TEMP VIEW ledger AS SELECT " LEDGER_COLUMNS " FROM main.expenses");
+    char *err_msg = 0;
+    gboolean ok = TRUE;
+
+    for (guint i = 0; ok && i < profile->archive_years->len; i++) {
+        gint year = g_array_index(profile->archive_years, gint, i);
+        ok = attach_archive(db, profile, year);
+        g_string_append_printf(sql, " UNION ALL SELECT " LEDGER_COLUMNS " FROM archive_%d.expenses", year);
+    }
+
+    if (ok && sqlite3_exec(db, sql->str, 0, 0, &err_msg) != SQLITE_OK) {
+        g_print("SQL error: %s\n", err_msg);
+        sqlite3_free(err_msg);
+        ok = FALSE;
+    }
+    g_string_free(sql, TRUE);
+    return ok;
+}
+
+// Moves the expenses of a year into the archive of its span, creating
+// and attaching the archive first if it is new, but not past
+// ARCHIVE_MAX_ATTACHED archives. The archive and the database are
+// committed one after the other, the archive first, so an interruption
+// leaves the rows in both, never in neither; the next run copies them
+// over their first copy and finishes the move. Rows whose date is not a
+// date stay. Returns the rows moved, or -1 on error.
+static int archive_year(sqlite3 *db, StorageProfile *profile, gint year) {
+    gint first_year = year - year % ARCHIVE_SPAN_YEARS;
+    char first_day[16], next_year[16];
+    char *err_msg = 0;
+    int moved = -1;
+
+    g_snprintf(first_day, sizeof(first_day), "%04d-01-01", year);
+    g_snprintf(next_year, sizeof(next_year), "%04d-01-01", year + 1);
+
+    gboolean known = FALSE;
+    for (guint i = 0; i < profile->archive_years->len; i++) {
+        known = known || g_array_index(profile->archive_years, gint, i) == first_year;
+    }
+    if (!known) {
+        // Only an archive that is attached goes into the list, so the
+        // ledger view never names a schema the connection lacks
+        if (profile->archive_years->len >= ARCHIVE_MAX_ATTACHED) {
+            g_print("Cannot archive %d: %d archives are attached already\n", year, ARCHIVE_MAX_ATTACHED);
+            return -1;
+        }
+        if (!attach_archive(db, profile, first_year)) {
+            return -1;
+        }
+        g_array_append_val(profile->archive_years, first_year);
+        g_array_sort(profile->archive_years, compare_years);
+        if (!attach_archives(db, profile)) {
+            return -1;
+        }
+    }
+
+    gchar *schema = g_strdup_printf("archive_%d", first_year);
+    gboolean ok = TRUE;
+    for (gsize i = 0; ok && i < G_N_ELEMENTS(ARCHIVE_SCHEMA); i++) {
+        gchar *sql = g_strdup_printf(ARCHIVE_SCHEMA[i], schema);
+        ok = sqlite3_exec(db, sql, 0, 0, &err_msg) == SQLITE_OK;
+        g_free(sql);
+    }
+
+    char *copy = sqlite3_mprintf(
+        "BEGIN;"
+        "INSERT OR REPLACE INTO %s.expenses (id, amount, description, category_id, payment_type_id, date) "
+        "SELECT id, amount, description, category_id, payment_type_id, date FROM main.expenses "
+        "WHERE date >= %Q AND date < %Q AND day IS NOT NULL;"
+        "INSERT INTO %s.expenses_fts(expenses_fts) VALUES('rebuild');"
+        "COMMIT;",
+        schema, first_day, next_year, schema);
+    char *delete = sqlite3_mprintf(
+        "DELETE FROM main.expenses WHERE date >= %Q AND date < %Q AND id IN (SELECT id FROM %s.expenses);",
+        first_day, next_year, schema);
+    gchar *remove = g_strconcat("BEGIN; DROP TRIGGER expenses_totals_ad;", delete,
+                                SQL_TOTALS_DELETE_TRIGGER "COMMIT;", NULL);
+
+    if (ok && sqlite3_exec(db, copy, 0, 0, &err_msg) == SQLITE_OK &&
+        sqlite3_exec(db, remove, 0, 0, &err_msg) == SQLITE_OK) {
+        moved = sqlite3_changes(db);
+        gchar *file = archive_file(profile, first_year);
+        g_print("Archived %d expenses of %d in %s\n", moved, year, file);
+        g_free(file);
+    } else {
+        g_print("SQL error: %s\n", err_msg);
+        sqlite3_free(err_msg);
+        sqlite3_exec(db, "ROLLBACK", 0, 0, NULL);
+    }
+
+    sqlite3_free(copy);
+    sqlite3_free(delete);
+    g_free(remove);
+    g_free(schema);
+    return moved;
+}
+
+// Copies into backup_dir the archives that hold any year from first_year
+// to last_year, which just changed, and those with no copy yet. There is
+// one copy per archive, never rotated, since every backup relies on it.
+static void backup_archives(sqlite3 *db, const StorageProfile *profile, gint first_year, gint last_year) {
+    if (g_mkdir_with_parents(profile->backup_dir, 0755) != 0) {
+        g_print("Cannot create backup directory %s\n", profile->backup_dir);
+        return;
+    }
+
+    for (guint i = 0; i < profile->archive_years->len; i++) {
+        gint year = g_array_index(profile->archive_years, gint, i);
+        gchar *file = archive_backup_file(profile, year);
+        gboolean changed = year + ARCHIVE_SPAN_YEARS > first_year && year <= last_year;
+
+        if (changed || !g_file_test(file, G_FILE_TEST_EXISTS)) {
+            gchar *schema = g_strdup_printf("archive_%d", year);
+            BackupJob *backup = backup_begin(db, schema, file);
+            if (backup != NULL) {
+                while (backup_step(backup) == SQLITE_OK) {
+                }
+                if (!backup_end(backup)) {
+                    g_print("Backup of %s to %s failed\n", schema, file);
+                }
+                backup_job_free(backup);
+            }
+            g_free(schema);
+        }
+        g_free(file);
+    }
+}
+
+// Archives every year before the archive_keep_years kept, this one
+// included, that still has expenses in the database, oldest first and
+// stopping at the first that fails, then compacts the database if
+// anything moved and backs up the archives. db must not be in a
+// transaction. Returns the rows moved, or -1 on error.
+static int archive_closed_years(sqlite3 *db, StorageProfile *profile) {
+    time_t t = time(NULL);
+    gint first_kept = localtime(&t)->tm_year + 1900 - profile->archive_keep_years + 1;
+    char from_date[16] = "0000-01-01", to_date[16];
+    gboolean failed = FALSE;
+    gint first_moved = 0, last_moved = 0;
+    int total = 0;
+
+    if (g_mkdir_with_parents(profile->archive_dir, 0755) != 0) {
+        g_print("Cannot create archive directory %s\n", profile->archive_dir);
+        return -1;
+    }
+    g_snprintf(to_date, sizeof(to_date), "%04d-01-01", first_kept);
+
+    // Finds the oldest year left, one seek on idx_expenses_date per year
+    for (;;) {
+        sqlite3_stmt *stmt;
+        gint year = 0;
+        const char *sql =
+            "SELECT date FROM expenses WHERE date >= ? AND date < ? AND day IS NOT NULL ORDER BY date LIMIT 1";
+
+        if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+            g_print("SQL error: %s\n", sqlite3_errmsg(db));
+            return -1;
+        }
+        sqlite3_bind_text(stmt, 1, from_date, -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 2, to_date, -1, SQLITE_STATIC);
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            year = atoi((const char *)sqlite3_column_text(stmt, 0));
+        }
+        sqlite3_finalize(stmt);
+        if (year == 0) {
+            break;
+        }
+
+        int moved = archive_year(db, profile, year);
+        if (moved < 0) {
+            failed = TRUE;
+            break;
+        }
+        first_moved = first_moved == 0 ? year : first_moved;
+        last_moved = year;
+        total += moved;
+        g_snprintf(from_date, sizeof(from_date), "%04d-01-01", year + 1);
+    }
+
+    // Deleting leaves the pages free but the file as large as before
+    if (total > 0 && sqlite3_exec(db, "VACUUM", 0, 0, NULL) != SQLITE_OK) {
+        g_print("SQL error: %s\n", sqlite3_errmsg(db));
+    }
+    backup_archives(db, profile, first_moved, last_moved);
+    return failed ? -1 : total;
+}
+
+static void init_budget_section(AppData *app, GtkWidget *main_box) {
+    // Create horizontal box for budget section
+    GtkWidget *budget_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
+    
+    // Create label
+    GtkWidget *budget_label = gtk_label_new("Set Monthly Budget:");
+    
+    // Create budget entry
+    app->budget_entry = gtk_entry_new();
+    gtk_entry_set_placeholder_text(GTK_ENTRY(app->budget_entry), "Enter monthly budget");
+    
+    // Create save budget button with blue background
+    app->budget_button = gtk_button_new_with_label("Save Budget");
+    GtkStyleContext *context = gtk_widget_get_style_context(app->budget_button);
+    gtk_style_context_add_class(context, "suggested-action");
+    
+    // Add CSS for the button
+    GtkCssProvider *provider = gtk_css_provider_new();
+    gtk_css_provider_load_from_data(provider,
+        ".suggested-action { background: #007bff; color: white; }"
+        ".suggested-action:hover { background: #0056b3; }", -1, NULL);
+    gtk_style_context_add_provider(context,
+        GTK_STYLE_PROVIDER(provider),
+        GTK_STYLE_PROVIDER_PRIORITY_APPLICATION);
+    g_object_unref(provider);
+
+    // Create progress bar
+    app->progress_bar = gtk_progress_bar_new();
+    gtk_progress_bar_set_show_text(GTK_PROGRESS_BAR(app->progress_bar), TRUE);
+    
+    // Pack widgets
+    gtk_box_pack_start(GTK_BOX(budget_box), budget_label, FALSE, FALSE, 5);
+    gtk_box_pack_start(GTK_BOX(budget_box), app->budget_entry, TRUE, TRUE, 5);
+    gtk_box_pack_start(GTK_BOX(budget_box), app->budget_button, FALSE, FALSE, 5);
+    
+    // Add budget box and progress bar to main box
+    gtk_box_pack_start(GTK_BOX(main_box), budget_box, FALSE, FALSE, 5);
+    gtk_box_pack_start(GTK_BOX(main_box), app->progress_bar, FALSE, FALSE, 5);
+
+    // Connect signals
+    g_signal_connect(app->budget_button, "clicked", G_CALLBACK(set_monthly_budget), app);
+
+    // Load existing budget if any
+    load_current_budget(app);
+    update_budget_progress(app);
+}
+
+static void load_current_budget(AppData *app) {
+    time_t t = time(NULL);
+    struct tm *tm = localtime(&t);
+    char month[8];
+    strftime(month, sizeof(month), "%Y-%m", tm);
+
+    sqlite3_stmt *stmt = stmt_cache_get(&app->stmts, SQL_SELECT_BUDGET);
+    
+    if (stmt != NULL) {
+        sqlite3_bind_text(stmt, 1, month, -1, SQLITE_STATIC);
+        
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            app->monthly_budget = sqlite3_column_double(stmt, 0);
+            char budget_text[32];
+            g_snprintf(budget_text, sizeof(budget_text), "%.2f", app->monthly_budget);
+            gtk_entry_set_text(GTK_ENTRY(app->budget_entry), budget_text);
+        }
+        
+        sqlite3_reset(stmt);
+    }
+}
+
+static void set_monthly_budget(GtkButton *button, AppData *app) {
+    const char *budget_text = gtk_entry_get_text(GTK_ENTRY(app->budget_entry));
+    double new_budget = atof(budget_text);
+    
+    if (new_budget <= 0) {
+        GtkWidget *dialog = gtk_message_dialog_new(GTK_WINDOW(app->window),
+            GTK_DIALOG_DESTROY_WITH_PARENT,
+            GTK_MESSAGE_ERROR,
+            GTK_BUTTONS_CLOSE,
+            "Please enter a valid budget amount greater than 0");
+        gtk_dialog_run(GTK_DIALOG(dialog));
+        gtk_widget_destroy(dialog);
+        return;
+    }
+
+    // Get current month
+    time_t t = time(NULL);
+    struct tm *tm = localtime(&t);
+    char month[8];
+    strftime(month, sizeof(month), "%Y-%m", tm);
+
+    // Check if budget already exists for this month
+    sqlite3_stmt *check_stmt = stmt_cache_get(&app->stmts, SQL_BUDGET_EXISTS);
+    int budget_exists = 0;
+    
+    if (check_stmt != NULL) {
+        sqlite3_bind_text(check_stmt, 1, month, -1, SQLITE_STATIC);
+        if (sqlite3_step(check_stmt) == SQLITE_ROW) {
+            budget_exists = 1;
+        }
+        sqlite3_reset(check_stmt);
+    }
+
+    if (budget_exists) {
+        GtkWidget *dialog = gtk_message_dialog_new(GTK_WINDOW(app->window),
+            GTK_DIALOG_DESTROY_WITH_PARENT,
+            GTK_MESSAGE_ERROR,
+            GTK_BUTTONS_CLOSE,
+            "Budget for this month has already been set");
+        gtk_dialog_run(GTK_DIALOG(dialog));
+        gtk_widget_destroy(dialog);
+        return;
+    }
+
+    // Save new budget
+    sqlite3_stmt *stmt = stmt_cache_get(&app->stmts, SQL_INSERT_BUDGET);
+    
+    if (stmt != NULL) {
+        sqlite3_bind_double(stmt, 1, new_budget);
+        sqlite3_bind_text(stmt, 2, month, -1, SQLITE_STATIC);
+        int rc = sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+        
+        if (rc == SQLITE_DONE) {
+            app->monthly_budget = new_budget;
+            update_budget_progress(app);
+            
+            GtkWidget *dialog = gtk_message_dialog_new(GTK_WINDOW(app->window),
+                GTK_DIALOG_DESTROY_WITH_PARENT,
+                GTK_MESSAGE_INFO,
+                GTK_BUTTONS_CLOSE,
+                "Monthly budget set successfully!");
+            gtk_dialog_run(GTK_DIALOG(dialog));
+            gtk_widget_destroy(dialog);
+        }
+    }
+}
+
+typedef struct {
+    char month[8];
+    double spend;
+} BudgetJob;
+
+static void run_budget_job(DbWorker *worker, DbJob *job) {
+    BudgetJob *budget = job->data;
+    sqlite3_stmt *stmt = stmt_cache_get(&worker->stmts, SQL_MONTH_SPEND);
+
+    if (stmt != NULL) {
+        sqlite3_bind_text(stmt, 1, budget->month, -1, SQLITE_STATIC);
+
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            budget->spend = sqlite3_column_double(stmt, 0);
+        }
+
+        sqlite3_reset(stmt);
+    }
+}
+
+static void budget_job_done(AppData *app, DbJob *job) {
+    BudgetJob *budget = job->data;
+    app->current_spend = budget->spend;
+
+    if (app->monthly_budget > 0) {
+        double fraction = app->current_spend / app->monthly_budget;
+        gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(app->progress_bar), 
+            fraction > 1.0 ? 1.0 : fraction);
+        
+        char progress_text[64];
+        g_snprintf(progress_text, sizeof(progress_text), 
+            "%.2f / %.2f (%.1f%%)", 
+            app->current_spend, 
+            app->monthly_budget,
+            fraction * 100);
+        gtk_progress_bar_set_text(GTK_PROGRESS_BAR(app->progress_bar), progress_text);
+    }
+}
+
+static void update_budget_progress(AppData *app) {
+    // Get current month's expenses
+    time_t t = time(NULL);
+    struct tm *tm = localtime(&t);
+    BudgetJob *budget = g_new0(BudgetJob, 1);
+    strftime(budget->month, sizeof(budget->month), "%Y-%m", tm);
+
+    ColumnFilter filter = {0};
+    if (sync_expense_columns(app) &&
+        month_day_range(budget->month, &filter.first_day, &filter.last_day)) {
+        DbJob job = {.data = budget};
+        budget->spend = expense_columns_sum(app->columns, &filter);
+        budget_job_done(app, &job);
+        g_free(budget);
+        return;
+    }
+
+    db_worker_submit(app->worker, app, DB_JOB_BUDGET, run_budget_job, budget_job_done,
+                     budget, g_free);
+}
+
+static void init_analytics_section(AppData *app, GtkWidget *main_box) {
+    // Create horizontal box for charts
+    GtkWidget *charts_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 20);
+    gtk_widget_set_margin_top(charts_box, 10);
+    gtk_widget_set_margin_bottom(charts_box, 10);
+    
+    // Create frames for each chart
+    GtkWidget *category_frame = gtk_frame_new("Spending by Category");
+    GtkWidget *payment_frame = gtk_frame_new("Spending by Payment Mode");
+    
+    // Set frame borders and padding
+    gtk_frame_set_shadow_type(GTK_FRAME(category_frame), GTK_SHADOW_ETCHED_IN);
+    gtk_frame_set_shadow_type(GTK_FRAME(payment_frame), GTK_SHADOW_ETCHED_IN);
+    gtk_widget_set_margin_start(category_frame, 10);
+    gtk_widget_set_margin_end(category_frame, 10);
+    gtk_widget_set_margin_start(payment_frame, 10);
+    gtk_widget_set_margin_end(payment_frame, 10);
+
+    // Create drawing areas for charts
+    app->category_chart = gtk_drawing_area_new();
+    app->payment_chart = gtk_drawing_area_new();
+    gtk_widget_set_size_request(app->category_chart, 300, 300);
+    gtk_widget_set_size_request(app->payment_chart, 300, 300);
+
+    // Add drawing areas to frames
+    gtk_container_add(GTK_CONTAINER(category_frame), app->category_chart);
+    gtk_container_add(GTK_CONTAINER(payment_frame), app->payment_chart);
+
+    // Pack frames into charts box
+    gtk_box_pack_start(GTK_BOX(charts_box), category_frame, TRUE, TRUE, 0);
+    gtk_box_pack_start(GTK_BOX(charts_box), payment_frame, TRUE, TRUE, 0);
+
+    // Add charts box to main box
+    gtk_box_pack_start(GTK_BOX(main_box), charts_box, FALSE, FALSE, 0);
+
+    // Connect drawing signals
+    g_signal_connect(app->category_chart, "draw", G_CALLBACK(draw_category_chart), app);
+    g_signal_connect(app->payment_chart, "draw", G_CALLBACK(draw_payment_chart), app);
+
+    init_trend_chart(app, main_box);
+}
+
+// Picks the color of a dictionary id: the palette entry for built-in ids,
+// then hues spaced by the golden angle for ids users added
+static void chart_color(const ChartColor *palette, int n_palette, gint id, double *r, double *g, double *b) {
+    if (id >= 1 && id <= n_palette) {
+        *r = palette[id - 1].r;
+        *g = palette[id - 1].g;
+        *b = palette[id - 1].b;
+    } else {
+        gtk_hsv_to_rgb(fmod(id * 0.618033988749895, 1.0), 0.65, 0.85, r, g, b);
+    }
+}
+
+// Paints a pie of totals, indexed by dictionary id, with its legend
+static void render_pie_chart(cairo_t *cr, int width, int height, const GArray *totals,
+                             const Dictionary *names, const ChartColor *palette, int n_palette) {
+    int size = MIN(width, height);
+    double radius = size * 0.35;
+    double center_x = width / 2;
+    double center_y = height / 2;
+
+    double total = 0;
+    for (guint id = 1; id < totals->len; id++) {
+        total += g_array_index(totals, double, id);
+    }
+
+    // Draw pie chart
+    double start_angle = -G_PI / 2;
+    double legend_y = 20;
+
+    for (guint id = 1; id < totals->len; id++) {
+        double amount = g_array_index(totals, double, id);
+        const char *label = dictionary_name(names, id);
+        if (amount > 0 && label != NULL) {
+            double slice = 2 * G_PI * amount / total;
+            double r, g, b;
+            chart_color(palette, n_palette, id, &r, &g, &b);
+            
+            // Draw slice
+            cairo_move_to(cr, center_x, center_y);
+            cairo_arc(cr, center_x, center_y, radius, 
+                     start_angle, start_angle + slice);
             cairo_close_path(cr);
             
-            cairo_set_source_rgb(cr, 
-                CATEGORY_COLORS[i].r,
-                CATEGORY_COLORS[i].g,
-                CATEGORY_COLORS[i].b);
-            cairo_fill_preserve(cr);
-            cairo_set_source_rgb(cr, 1, 1, 1);
-            cairo_stroke(cr);
+            cairo_set_source_rgb(cr, r, g, b);
+            cairo_fill_preserve(cr);
+            cairo_set_source_rgb(cr, 1, 1, 1);
+            cairo_stroke(cr);
+
+            // Draw legend
+            cairo_set_source_rgb(cr, r, g, b);
+            cairo_rectangle(cr, width - 150, legend_y, 15, 15);
+            cairo_fill(cr);
+
+            cairo_set_source_rgb(cr, 0, 0, 0);
+            cairo_move_to(cr, width - 130, legend_y + 12);
+            char legend_text[100];
+            snprintf(legend_text, sizeof(legend_text), "%s (%.1f%%)",
+                    label,
+                    (amount / total) * 100);
+            cairo_show_text(cr, legend_text);
+
+            legend_y += 25;
+            start_angle += slice;
+        }
+    }
+}
+
+// Drops a rendered chart so the next draw renders it again
+static void chart_cache_invalidate(ChartCache *cache) {
+    if (cache->surface != NULL) {
+        cairo_surface_destroy(cache->surface);
+        cache->surface = NULL;
+    }
+}
+
+// Blits the cached chart, first rendering it if the data changed or the
+// widget has a new size or scale since it was last drawn
+static gboolean draw_cached_chart(GtkWidget *widget, cairo_t *cr, ChartCache *cache,
+                                  const GArray *totals, const Dictionary *names,
+                                  const ChartColor *palette, int n_palette) {
+    int width = gtk_widget_get_allocated_width(widget);
+    int height = gtk_widget_get_allocated_height(widget);
+    int scale = gtk_widget_get_scale_factor(widget);
+
+    if (cache->surface != NULL &&
+        (cache->width != width || cache->height != height || cache->scale != scale)) {
+        chart_cache_invalidate(cache);
+    }
+
+    if (cache->surface == NULL) {
+        cache->surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width * scale, height * scale);
+        cairo_surface_set_device_scale(cache->surface, scale, scale);
+        cache->width = width;
+        cache->height = height;
+        cache->scale = scale;
+
+        gint64 timer = g_get_monotonic_time();
+        cairo_t *surface_cr = cairo_create(cache->surface);
+        render_pie_chart(surface_cr, width, height, totals, names, palette, n_palette);
+        cairo_destroy(surface_cr);
+        stats_record_since("render_pie_chart", timer);
+
+        cache->misses++;
+        g_debug("Chart cache miss at %dx%d: %u hits, %u misses",
+                width, height, cache->hits, cache->misses);
+    } else {
+        cache->hits++;
+    }
+
+    cairo_set_source_surface(cr, cache->surface, 0, 0);
+    cairo_paint(cr);
+    return TRUE;
+}
+
+// Category totals come from the DB worker, see update_charts
+static gboolean draw_category_chart(GtkWidget *widget, cairo_t *cr, AppData *app) {
+    gint64 timer = g_get_monotonic_time();
+    gboolean handled = draw_cached_chart(widget, cr, &app->category_cache, app->category_totals,
+                                         &app->categories, CATEGORY_COLORS, G_N_ELEMENTS(CATEGORY_COLORS));
+    stats_record_since("draw_category_chart", timer);
+    return handled;
+}
+
+// Payment totals come from the DB worker, see update_charts
+static gboolean draw_payment_chart(GtkWidget *widget, cairo_t *cr, AppData *app) {
+    gint64 timer = g_get_monotonic_time();
+    gboolean handled = draw_cached_chart(widget, cr, &app->payment_cache, app->payment_totals,
+                                         &app->payment_types, PAYMENT_COLORS, G_N_ELEMENTS(PAYMENT_COLORS));
+    stats_record_since("draw_payment_chart", timer);
+    return handled;
+}
+
+static void day_series_free(DaySeries *series) {
+    g_array_free(series->prefix, TRUE);
+    g_free(series);
+}
+
+static gint32 day_series_last_day(const DaySeries *series) {
+    return series->first_day + (gint32)series->prefix->len - 2;
+}
+
+// Total spend of days first_day to last_day, in O(1)
+static double day_series_total(const DaySeries *series, gint32 first_day, gint32 last_day) {
+    gint64 n_days = series->prefix->len - 1;
+    gint64 start = CLAMP((gint64)first_day - series->first_day, 0, n_days);
+    gint64 end = CLAMP((gint64)last_day - series->first_day + 1, 0, n_days);
+
+    if (end <= start) {
+        return 0.0;
+    }
+    return (g_array_index(series->prefix, gint64, end) -
+            g_array_index(series->prefix, gint64, start)) / 100.0;
+}
+
+// Reads day_totals into a series. Days without expenses repeat the
+// running total, so the series covers every day from the first expense
+// to the last.
+static DaySeries *load_day_series(StmtCache *stmts) {
+    sqlite3_stmt *stmt = stmt_cache_get(stmts, SQL_DAY_TOTALS);
+    DaySeries *series = g_new0(DaySeries, 1);
+    gint64 running = 0;
+
+    series->prefix = g_array_new(FALSE, FALSE, sizeof(gint64));
+    g_array_append_val(series->prefix, running);
+    if (stmt != NULL) {
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            gint32 day = sqlite3_column_int(stmt, 0);
+            if (series->prefix->len == 1) {
+                series->first_day = day;
+            }
+            while (day_series_last_day(series) < day - 1) {
+                g_array_append_val(series->prefix, running);
+            }
+            running += llround(sqlite3_column_double(stmt, 1) * 100.0);
+            g_array_append_val(series->prefix, running);
+        }
+        sqlite3_reset(stmt);
+    }
+    return series;
+}
+
+typedef struct {
+    DaySeries *series;
+} TrendJob;
+
+static void trend_job_free(gpointer data) {
+    TrendJob *trend = data;
+    if (trend->series != NULL) {
+        day_series_free(trend->series);
+    }
+    g_free(trend);
+}
+
+static void run_trend_job(DbWorker *worker, DbJob *job) {
+    TrendJob *trend = job->data;
+    trend->series = load_day_series(&worker->stmts);
+}
+
+// Takes the worker's series over; the job frees the previous one
+static void trend_job_done(AppData *app, DbJob *job) {
+    TrendJob *trend = job->data;
+    DaySeries *previous = app->trend_series;
+    app->trend_series = trend->series;
+    trend->series = previous;
+    gtk_widget_queue_draw(app->trend_chart);
+}
+
+// Reloads the per-day series on the DB worker. day_totals holds one row
+// per day with expenses, so this reads a few thousand rows at most;
+// panning and zooming only redraw from the series in memory.
+static void update_trend_series(AppData *app) {
+    db_worker_submit(app->worker, app, DB_JOB_TREND, run_trend_job, trend_job_done,
+                     g_new0(TrendJob, 1), trend_job_free);
+}
+
+// First day of the bucket that holds day. Weeks start on Monday; day 4,
+// 1970-01-05, was one.
+static gint32 trend_bucket_start(int unit, gint32 day) {
+    GDate date;
+
+    switch (unit) {
+    case TREND_BY_WEEK:
+        return day - (((day - 4) % 7) + 7) % 7;
+    case TREND_BY_MONTH:
+        day_to_date(day, &date);
+        g_date_set_day(&date, 1);
+        return date_to_day(&date);
+    default:
+        return day;
+    }
+}
+
+// First day of the bucket after the one starting on start
+static gint32 trend_bucket_next(int unit, gint32 start) {
+    GDate date;
+
+    switch (unit) {
+    case TREND_BY_WEEK:
+        return start + 7;
+    case TREND_BY_MONTH:
+        day_to_date(start, &date);
+        g_date_add_months(&date, 1);
+        return date_to_day(&date);
+    default:
+        return start + 1;
+    }
+}
+
+// Moves the window to n_days days from first_day, keeping it within
+// the zoom limits, GDate's range and in sight of the series
+static void trend_set_window(AppData *app, gint32 first_day, gint32 n_days) {
+    n_days = CLAMP(n_days, TREND_MIN_DAYS, TREND_MAX_DAYS);
+    if (app->trend_series != NULL && app->trend_series->prefix->len > 1) {
+        first_day = MIN(first_day, day_series_last_day(app->trend_series));
+        first_day = MAX(first_day, app->trend_series->first_day - n_days + 1);
+    }
+    first_day = CLAMP(first_day, TREND_EARLIEST_DAY, TREND_LATEST_DAY - n_days + 1);
+    app->trend_first_day = first_day;
+    app->trend_last_day = first_day + n_days - 1;
+    gtk_widget_queue_draw(app->trend_chart);
+}
+
+static double trend_plot_width(GtkWidget *widget) {
+    return MAX(1, gtk_widget_get_allocated_width(widget) - TREND_MARGIN_LEFT - TREND_MARGIN_RIGHT);
+}
+
+static void draw_trend_label(cairo_t *cr, double x, double y, const char *text) {
+    cairo_move_to(cr, x, y);
+    cairo_show_text(cr, text);
+}
+
+// Bars of the spend per bucket across the window, with the average of
+// the last TREND_AVERAGE_BUCKETS buckets as a line. Each bucket and each
+// average is a difference of two prefix sums, so a redraw costs one step
+// per bucket whatever the window or ledger size.
+static gboolean draw_trend_chart(GtkWidget *widget, cairo_t *cr, AppData *app) {
+    const DaySeries *series = app->trend_series;
+    int width = gtk_widget_get_allocated_width(widget);
+    int height = gtk_widget_get_allocated_height(widget);
+    double plot_width = trend_plot_width(widget);
+    double plot_height = MAX(1, height - TREND_MARGIN_TOP - TREND_MARGIN_BOTTOM);
+    double n_days = app->trend_last_day - app->trend_first_day + 1;
+    double day_width = plot_width / n_days;
+    double bottom = TREND_MARGIN_TOP + plot_height;
+
+    if (series == NULL) {
+        return TRUE;
+    }
+    gint64 timer = g_get_monotonic_time();
+
+    // Scale to the largest bucket in view
+    double max_total = 0;
+    gint32 first_bucket = trend_bucket_start(app->trend_unit, app->trend_first_day);
+    for (gint32 start = first_bucket; start <= app->trend_last_day;) {
+        gint32 next = trend_bucket_next(app->trend_unit, start);
+        max_total = MAX(max_total, day_series_total(series, start, next - 1));
+        start = next;
+    }
+    if (max_total <= 0) {
+        max_total = 1;
+    }
+
+    cairo_save(cr);
+    cairo_rectangle(cr, TREND_MARGIN_LEFT, TREND_MARGIN_TOP, plot_width, plot_height);
+    cairo_clip(cr);
+
+    cairo_set_source_rgb(cr, 0.3, 0.5, 0.9);
+    for (gint32 start = first_bucket; start <= app->trend_last_day;) {
+        gint32 next = trend_bucket_next(app->trend_unit, start);
+        double x = TREND_MARGIN_LEFT + (start - app->trend_first_day) * day_width;
+        double bar_width = (next - start) * day_width;
+        double bar_height = day_series_total(series, start, next - 1) / max_total * plot_height;
+
+        cairo_rectangle(cr, x + bar_width * 0.1, bottom - bar_height, MAX(bar_width * 0.8, 1), bar_height);
+        start = next;
+    }
+    cairo_fill(cr);
+
+    // The average of the first bucket reaches back before the window
+    gint32 average_start = first_bucket;
+    for (int i = 1; i < TREND_AVERAGE_BUCKETS; i++) {
+        average_start = trend_bucket_start(app->trend_unit, average_start - 1);
+    }
+
+    cairo_set_source_rgb(cr, 0.9, 0.4, 0.1);
+    cairo_set_line_width(cr, 2);
+    for (gint32 start = first_bucket; start <= app->trend_last_day;) {
+        gint32 next = trend_bucket_next(app->trend_unit, start);
+        double x = TREND_MARGIN_LEFT + ((start + next) / 2.0 - app->trend_first_day) * day_width;
+        double average = day_series_total(series, average_start, next - 1) / TREND_AVERAGE_BUCKETS;
+
+        cairo_line_to(cr, x, bottom - average / max_total * plot_height);
+        average_start = trend_bucket_next(app->trend_unit, average_start);
+        start = next;
+    }
+    cairo_stroke(cr);
+    cairo_restore(cr);
+
+    // Axes and labels
+    char label[64];
+    GDate date;
+    cairo_set_source_rgb(cr, 0.5, 0.5, 0.5);
+    cairo_set_line_width(cr, 1);
+    cairo_move_to(cr, TREND_MARGIN_LEFT, TREND_MARGIN_TOP);
+    cairo_line_to(cr, TREND_MARGIN_LEFT, bottom);
+    cairo_line_to(cr, width - TREND_MARGIN_RIGHT, bottom);
+    cairo_stroke(cr);
+
+    cairo_set_source_rgb(cr, 0, 0, 0);
+    g_snprintf(label, sizeof(label), "%.2f", max_total);
+    draw_trend_label(cr, 5, TREND_MARGIN_TOP + 10, label);
+    draw_trend_label(cr, 5, bottom, "0");
+    day_to_date(app->trend_first_day, &date);
+    g_date_strftime(label, sizeof(label), "%Y-%m-%d", &date);
+    draw_trend_label(cr, TREND_MARGIN_LEFT, height - 5, label);
+    day_to_date(app->trend_last_day, &date);
+    g_date_strftime(label, sizeof(label), "%Y-%m-%d", &date);
+    draw_trend_label(cr, width - TREND_MARGIN_RIGHT - 70, height - 5, label);
+
+    stats_record_since("draw_trend_chart", timer);
+    return TRUE;
+}
+
+// Scrolling zooms around the day under the pointer
+static gboolean on_trend_scroll(GtkWidget *widget, GdkEventScroll *event, AppData *app) {
+    double n_days = app->trend_last_day - app->trend_first_day + 1;
+    double steps;
+
+    if (event->direction == GDK_SCROLL_UP) {
+        steps = -1;
+    } else if (event->direction == GDK_SCROLL_DOWN) {
+        steps = 1;
+    } else if (event->direction == GDK_SCROLL_SMOOTH) {
+        steps = event->delta_y;
+    } else {
+        return FALSE;
+    }
+
+    double fraction = CLAMP((event->x - TREND_MARGIN_LEFT) / trend_plot_width(widget), 0, 1);
+    double anchor = app->trend_first_day + fraction * n_days;
+    double new_n_days = CLAMP(n_days * pow(TREND_ZOOM_STEP, steps), TREND_MIN_DAYS, TREND_MAX_DAYS);
+    trend_set_window(app, (gint32)floor(anchor - fraction * new_n_days), (gint32)round(new_n_days));
+    return TRUE;
+}
+
+// Dragging with the first button pans
+static gboolean on_trend_button_press(GtkWidget *widget, GdkEventButton *event, AppData *app) {
+    if (event->button != 1) {
+        return FALSE;
+    }
+    app->trend_dragging = TRUE;
+    app->trend_drag_x = event->x;
+    app->trend_drag_first_day = app->trend_first_day;
+    return TRUE;
+}
+
+static gboolean on_trend_button_release(GtkWidget *widget, GdkEventButton *event, AppData *app) {
+    if (event->button != 1) {
+        return FALSE;
+    }
+    app->trend_dragging = FALSE;
+    return TRUE;
+}
+
+static gboolean on_trend_motion(GtkWidget *widget, GdkEventMotion *event, AppData *app) {
+    if (!app->trend_dragging) {
+        return FALSE;
+    }
+    gint32 n_days = app->trend_last_day - app->trend_first_day + 1;
+    double shift = (app->trend_drag_x - event->x) / trend_plot_width(widget) * n_days;
+    trend_set_window(app, app->trend_drag_first_day + (gint32)round(shift), n_days);
+    return TRUE;
+}
+
+static void trend_unit_changed(GtkComboBox *combo, AppData *app) {
+    app->trend_unit = gtk_combo_box_get_active(combo);
+    gtk_widget_queue_draw(app->trend_chart);
+}
+
+// Spend per day, week or month over a window that opens on the last
+// TREND_INITIAL_DAYS days; scroll to zoom, drag to pan
+static void init_trend_chart(AppData *app, GtkWidget *main_box) {
+    GtkWidget *trend_frame = gtk_frame_new("Spending over Time");
+    gtk_frame_set_shadow_type(GTK_FRAME(trend_frame), GTK_SHADOW_ETCHED_IN);
+    gtk_widget_set_margin_start(trend_frame, 10);
+    gtk_widget_set_margin_end(trend_frame, 10);
+
+    GtkWidget *trend_box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 5);
+    GtkWidget *unit_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
+    GtkWidget *unit_combo = gtk_combo_box_text_new();
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(unit_combo), "Day");
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(unit_combo), "Week");
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(unit_combo), "Month");
+    app->trend_unit = TREND_BY_WEEK;
+    gtk_combo_box_set_active(GTK_COMBO_BOX(unit_combo), app->trend_unit);
+    gtk_box_pack_start(GTK_BOX(unit_box), gtk_label_new("Per:"), FALSE, FALSE, 5);
+    gtk_box_pack_start(GTK_BOX(unit_box), unit_combo, FALSE, FALSE, 0);
+    gchar *hint = g_strdup_printf("Scroll to zoom, drag to pan; the line averages the last %d bars",
+                                  TREND_AVERAGE_BUCKETS);
+    gtk_box_pack_start(GTK_BOX(unit_box), gtk_label_new(hint), FALSE, FALSE, 10);
+    g_free(hint);
+
+    app->trend_chart = gtk_drawing_area_new();
+    gtk_widget_set_size_request(app->trend_chart, -1, 200);
+    gtk_widget_add_events(app->trend_chart, GDK_SCROLL_MASK | GDK_SMOOTH_SCROLL_MASK |
+                          GDK_BUTTON_PRESS_MASK | GDK_BUTTON_RELEASE_MASK | GDK_BUTTON1_MOTION_MASK);
+
+    gtk_box_pack_start(GTK_BOX(trend_box), unit_box, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(trend_box), app->trend_chart, TRUE, TRUE, 0);
+    gtk_container_add(GTK_CONTAINER(trend_frame), trend_box);
+    gtk_box_pack_start(GTK_BOX(main_box), trend_frame, FALSE, FALSE, 0);
+
+    GDate today;
+    g_date_clear(&today, 1);
+    g_date_set_time_t(&today, time(NULL));
+    trend_set_window(app, date_to_day(&today) - TREND_INITIAL_DAYS + 1, TREND_INITIAL_DAYS);
+
+    g_signal_connect(unit_combo, "changed", G_CALLBACK(trend_unit_changed), app);
+    g_signal_connect(app->trend_chart, "draw", G_CALLBACK(draw_trend_chart), app);
+    g_signal_connect(app->trend_chart, "scroll-event", G_CALLBACK(on_trend_scroll), app);
+    g_signal_connect(app->trend_chart, "button-press-event", G_CALLBACK(on_trend_button_press), app);
+    g_signal_connect(app->trend_chart, "button-release-event", G_CALLBACK(on_trend_button_release), app);
+    g_signal_connect(app->trend_chart, "motion-notify-event", G_CALLBACK(on_trend_motion), app);
+}
+
+static gboolean refresh_diagnostics(gpointer data) {
+    AppData *app = data;
+    GString *report = stats_report();
+    gtk_text_buffer_set_text(gtk_text_view_get_buffer(GTK_TEXT_VIEW(app->stats_view)), report->str, -1);
+    g_string_free(report, TRUE);
+    return G_SOURCE_CONTINUE;
+}
+
+// The panel is only refreshed while it is expanded
+static void on_diagnostics_toggled(GObject *expander, GParamSpec *pspec, AppData *app) {
+    if (gtk_expander_get_expanded(GTK_EXPANDER(expander))) {
+        refresh_diagnostics(app);
+        app->stats_source = g_timeout_add(STATS_REFRESH_MS, refresh_diagnostics, app);
+    } else if (app->stats_source != 0) {
+        g_source_remove(app->stats_source);
+        app->stats_source = 0;
+    }
+}
+
+// Collapsed panel listing, per SQL statement and timed handler, the
+// number of calls, total time and p50/p99/max latency
+static void init_diagnostics_section(AppData *app, GtkWidget *main_box) {
+    GtkWidget *expander = gtk_expander_new("Diagnostics");
+    GtkWidget *scrolled_window = gtk_scrolled_window_new(NULL, NULL);
+    gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scrolled_window), GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
+    gtk_widget_set_size_request(scrolled_window, -1, 150);
+
+    app->stats_view = gtk_text_view_new();
+    gtk_text_view_set_editable(GTK_TEXT_VIEW(app->stats_view), FALSE);
+    gtk_text_view_set_cursor_visible(GTK_TEXT_VIEW(app->stats_view), FALSE);
+    gtk_text_view_set_monospace(GTK_TEXT_VIEW(app->stats_view), TRUE);
+
+    gtk_container_add(GTK_CONTAINER(scrolled_window), app->stats_view);
+    gtk_container_add(GTK_CONTAINER(expander), scrolled_window);
+    gtk_box_pack_start(GTK_BOX(main_box), expander, FALSE, FALSE, 0);
+
+    g_signal_connect(expander, "notify::expanded", G_CALLBACK(on_diagnostics_toggled), app);
+}
+
+// Chart totals of the list's category and date filters, as a copy the
+// DB worker reads while the filters change
+typedef struct {
+    gint category_id;           // 0 for all
+    gchar *from_date;           // NULL for an open end
+    gchar *to_date;
+    const GArray *archives;     // Archived years, from the storage profile
+    GArray *category_totals;
+    GArray *payment_totals;
+} ChartsJob;
+
+static void charts_job_free(gpointer data) {
+    ChartsJob *charts = data;
+    g_free(charts->from_date);
+    g_free(charts->to_date);
+    g_array_free(charts->category_totals, TRUE);
+    g_array_free(charts->payment_totals, TRUE);
+    g_free(charts);
+}
+
+// Reads the rows of a totals query into totals, indexed by the
+// dictionary id in their first column
+static void read_chart_totals(sqlite3_stmt *stmt, GArray *totals) {
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        gint id = sqlite3_column_int(stmt, 0);
+        if (id <= 0) {
+            continue;
+        }
+        if ((guint)id >= totals->len) {
+            g_array_set_size(totals, id + 1);
+        }
+        g_array_index(totals, double, id) = sqlite3_column_double(stmt, 1);
+    }
+    sqlite3_reset(stmt);
+}
+
+// Reads one totals query into totals. month is bound to the query's
+// parameter, if it has one.
+static void load_chart_totals(StmtCache *stmts, const char *sql, const char *month, GArray *totals) {
+    sqlite3_stmt *stmt = stmt_cache_get(stmts, sql);
+
+    if (stmt != NULL) {
+        if (month != NULL) {
+            sqlite3_bind_text(stmt, 1, month, -1, SQLITE_STATIC);
+        }
+        read_chart_totals(stmt, totals);
+    }
+}
+
+// Totals the filtered expenses by column, category_id or payment_type_id,
+// into totals. The summary tables have no per-day breakdown, so this
+// reads the rows the filter covers, from the archives too.
+static void load_filtered_chart_totals(StmtCache *stmts, const ChartsJob *charts, const char *column,
+                                       GArray *totals) {
+    GString *sql = g_string_new(NULL);
+    const char *glue = " WHERE ";
+
+    g_string_append_printf(sql, "SELECT %s, SUM(amount) FROM ", column);
+    append_partitions(sql, charts->archives, charts->from_date, charts->to_date);
+    if (charts->category_id > 0) {
+        g_string_append(sql, " WHERE category_id = ?");
+        glue = " AND ";
+    }
+    append_date_range(sql, &glue, "date", charts->from_date, charts->to_date);
+    g_string_append_printf(sql, " GROUP BY %s", column);
+
+    sqlite3_stmt *stmt = stmt_cache_get(stmts, sql->str);
+    if (stmt != NULL) {
+        int param = 1;
+        if (charts->category_id > 0) {
+            sqlite3_bind_int(stmt, param++, charts->category_id);
+        }
+        bind_date_range(stmt, &param, charts->from_date, charts->to_date);
+        read_chart_totals(stmt, totals);
+    } else {
+        g_print("SQL error: %s\n", sqlite3_errmsg(stmts->db));
+    }
+    g_string_free(sql, TRUE);
+}
+
+// Unfiltered charts read the summary tables, a row per category or
+// payment type; filtered ones total the expenses the filter covers
+static void run_charts_job(DbWorker *worker, DbJob *job) {
+    ChartsJob *charts = job->data;
+
+    if (charts->category_id == 0 && charts->from_date == NULL && charts->to_date == NULL) {
+        load_chart_totals(&worker->stmts, SQL_CATEGORY_TOTALS, NULL, charts->category_totals);
+        load_chart_totals(&worker->stmts, SQL_PAYMENT_TOTALS, NULL, charts->payment_totals);
+    } else {
+        load_filtered_chart_totals(&worker->stmts, charts, "category_id", charts->category_totals);
+        load_filtered_chart_totals(&worker->stmts, charts, "payment_type_id", charts->payment_totals);
+    }
+}
+
+// Takes the worker's arrays over; the job frees the previous ones
+static void charts_job_done(AppData *app, DbJob *job) {
+    ChartsJob *charts = job->data;
+    GArray *previous = app->category_totals;
+    app->category_totals = charts->category_totals;
+    charts->category_totals = previous;
+    previous = app->payment_totals;
+    app->payment_totals = charts->payment_totals;
+    charts->payment_totals = previous;
+    chart_cache_invalidate(&app->category_cache);
+    chart_cache_invalidate(&app->payment_cache);
+    gtk_widget_queue_draw(app->category_chart);
+    gtk_widget_queue_draw(app->payment_chart);
+}
+
+// Refetches the category and payment totals of the list's category and
+// date filters, and redraws with them. The search text does not narrow
+// them. The totals come from the analytics columns when they are loaded,
+// else from the DB worker.
+static void update_chart_totals(AppData *app) {
+    ChartsJob *charts = g_new0(ChartsJob, 1);
+    charts->category_totals = g_array_new(FALSE, TRUE, sizeof(double));
+    charts->payment_totals = g_array_new(FALSE, TRUE, sizeof(double));
+
+    if (sync_expense_columns(app)) {
+        const ColumnFilter filter = {date_string_to_day(app->filter_from_date, G_MININT32),
+                                     date_string_to_day(app->filter_to_date, G_MAXINT32),
+                                     app->filter_category_id};
+        DbJob job = {.data = charts};
+        gint64 timer = g_get_monotonic_time();
+        expense_columns_group(app->columns, &filter, FALSE, charts->category_totals);
+        expense_columns_group(app->columns, &filter, TRUE, charts->payment_totals);
+        stats_record_since("expense_columns_group", timer);
+        charts_job_done(app, &job);
+        charts_job_free(charts);
+        return;
+    }
+
+    charts->category_id = app->filter_category_id;
+    charts->from_date = g_strdup(app->filter_from_date);
+    charts->to_date = g_strdup(app->filter_to_date);
+    charts->archives = app->storage.archive_years;
+    db_worker_submit(app->worker, app, DB_JOB_CHARTS, run_charts_job, charts_job_done,
+                     charts, charts_job_free);
+}
+
+// Refetches the chart totals and the trend series and redraws with them;
+// the draw handlers only paint the data already in AppData
+static void update_charts(AppData *app) {
+    update_trend_series(app);
+    update_chart_totals(app);
+}
+
+static ExpenseColumns *expense_columns_new(void) {
+    ExpenseColumns *columns = g_new0(ExpenseColumns, 1);
+    columns->ids = g_array_new(FALSE, FALSE, sizeof(gint));
+    columns->cents = g_array_new(FALSE, FALSE, sizeof(gint64));
+    columns->days = g_array_new(FALSE, FALSE, sizeof(gint32));
+    columns->category_ids = g_array_new(FALSE, FALSE, sizeof(guint16));
+    columns->payment_type_ids = g_array_new(FALSE, FALSE, sizeof(guint16));
+    return columns;
+}
+
+static void expense_columns_free(ExpenseColumns *columns) {
+    g_array_free(columns->ids, TRUE);
+    g_array_free(columns->cents, TRUE);
+    g_array_free(columns->days, TRUE);
+    g_array_free(columns->category_ids, TRUE);
+    g_array_free(columns->payment_type_ids, TRUE);
+    g_free(columns);
+}
+
+static void expense_columns_set_size(ExpenseColumns *columns, guint n_rows) {
+    g_array_set_size(columns->ids, n_rows);
+    g_array_set_size(columns->cents, n_rows);
+    g_array_set_size(columns->days, n_rows);
+    g_array_set_size(columns->category_ids, n_rows);
+    g_array_set_size(columns->payment_type_ids, n_rows);
+}
+
+// Stores row i from the amount, day, category_id and payment_type_id
+// columns of stmt, starting at column first. Returns FALSE if an id does
+// not fit the 16-bit id columns.
+static gboolean expense_columns_set(ExpenseColumns *columns, guint i, gint id,
+                                    sqlite3_stmt *stmt, int first) {
+    gint category_id = sqlite3_column_int(stmt, first + 2);
+    gint payment_type_id = sqlite3_column_int(stmt, first + 3);
+
+    if (category_id <= 0 || category_id > G_MAXUINT16 ||
+        payment_type_id < 0 || payment_type_id > G_MAXUINT16) {
+        return FALSE;
+    }
+    g_array_index(columns->ids, gint, i) = id;
+    g_array_index(columns->cents, gint64, i) = llround(sqlite3_column_double(stmt, first) * 100.0);
+    g_array_index(columns->days, gint32, i) = sqlite3_column_type(stmt, first + 1) == SQLITE_NULL ?
+        G_MININT32 : sqlite3_column_int(stmt, first + 1);
+    g_array_index(columns->category_ids, guint16, i) = category_id;
+    g_array_index(columns->payment_type_ids, guint16, i) = payment_type_id;
+    columns->max_category_id = MAX(columns->max_category_id, category_id);
+    columns->max_payment_type_id = MAX(columns->max_payment_type_id, payment_type_id);
+    return TRUE;
+}
+
+// Reads every expense into a new set of columns. Returns NULL on a
+// database error or an id the columns cannot hold.
+static ExpenseColumns *expense_columns_load(StmtCache *stmts) {
+    sqlite3_stmt *stmt = stmt_cache_get(stmts, SQL_SELECT_COLUMNS);
+    if (stmt == NULL) {
+        return NULL;
+    }
+
+    ExpenseColumns *columns = expense_columns_new();
+    gboolean ok = TRUE;
+    int rc;
+    while (ok && (rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        guint i = columns->ids->len;
+        expense_columns_set_size(columns, i + 1);
+        ok = expense_columns_set(columns, i, sqlite3_column_int(stmt, 0), stmt, 1);
+    }
+    if (ok && rc != SQLITE_DONE) {
+        g_print("SQL error: %s\n", sqlite3_errmsg(sqlite3_db_handle(stmt)));
+        ok = FALSE;
+    }
+    sqlite3_reset(stmt);
+
+    if (!ok) {
+        expense_columns_free(columns);
+        return NULL;
+    }
+    return columns;
+}
+
+// Index of the row with id, or -1
+static gint expense_columns_find(const ExpenseColumns *columns, gint id) {
+    const gint *ids = (const gint *)columns->ids->data;
+    guint low = 0, high = columns->ids->len;
+
+    while (low < high) {
+        guint middle = low + (high - low) / 2;
+        if (ids[middle] < id) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low < columns->ids->len && ids[low] == id ? (gint)low : -1;
+}
+
+// Drops the tombstones, keeping the rows in id order
+static void expense_columns_compact(ExpenseColumns *columns) {
+    guint n_kept = 0;
+
+    for (guint i = 0; i < columns->ids->len; i++) {
+        if (g_array_index(columns->category_ids, guint16, i) == 0) {
+            continue;
+        }
+        g_array_index(columns->ids, gint, n_kept) = g_array_index(columns->ids, gint, i);
+        g_array_index(columns->cents, gint64, n_kept) = g_array_index(columns->cents, gint64, i);
+        g_array_index(columns->days, gint32, n_kept) = g_array_index(columns->days, gint32, i);
+        g_array_index(columns->category_ids, guint16, n_kept) =
+            g_array_index(columns->category_ids, guint16, i);
+        g_array_index(columns->payment_type_ids, guint16, n_kept) =
+            g_array_index(columns->payment_type_ids, guint16, i);
+        n_kept++;
+    }
+    expense_columns_set_size(columns, n_kept);
+    columns->n_deleted = 0;
+}
+
+// Rereads the rows whose ids were written and updates, appends or
+// tombstones them to match. Rereading rather than replaying the writes
+// also covers writes that were rolled back. Returns FALSE if a row cannot
+// be applied in place (an id below the last one, or one the columns
+// cannot hold); the columns must then be reloaded.
+static gboolean expense_columns_apply(ExpenseColumns *columns, StmtCache *stmts, const GArray *changes) {
+    sqlite3_stmt *stmt = stmt_cache_get(stmts, SQL_SELECT_EXPENSE_COLUMNS);
+    gboolean ok = stmt != NULL;
+
+    for (guint c = 0; ok && c < changes->len; c++) {
+        gint id = g_array_index(changes, gint, c);
+        gint i = expense_columns_find(columns, id);
+
+        sqlite3_bind_int(stmt, 1, id);
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            if (i < 0) {
+                guint n_rows = columns->ids->len;
+                ok = n_rows == 0 || g_array_index(columns->ids, gint, n_rows - 1) < id;
+                if (ok) {
+                    expense_columns_set_size(columns, n_rows + 1);
+                    i = n_rows;
+                }
+            } else if (g_array_index(columns->category_ids, guint16, i) == 0) {
+                columns->n_deleted--;
+            }
+            ok = ok && expense_columns_set(columns, i, id, stmt, 0);
+        } else if (i >= 0 && g_array_index(columns->category_ids, guint16, i) != 0) {
+            g_array_index(columns->cents, gint64, i) = 0;
+            g_array_index(columns->category_ids, guint16, i) = 0;
+            columns->n_deleted++;
+        }
+        sqlite3_reset(stmt);
+    }
+
+    if (ok && columns->n_deleted * COLUMN_MAX_DELETED_FRACTION > columns->ids->len) {
+        expense_columns_compact(columns);
+    }
+    return ok;
+}
+
+// The cents of a row if it passes the filter, else 0, without branches:
+// the comparisons build an all-ones or all-zeros mask
+static inline gint64 column_filtered(gint64 cents, gint32 day, guint16 row_category_id,
+                                     gint32 first_day, gint32 last_day, guint16 category_id) {
+    gint64 match = (gint64)(day >= first_day) & (gint64)(day <= last_day) &
+                   ((gint64)(category_id == 0) | (gint64)(row_category_id == category_id));
+    return cents & -match;
+}
+
+#ifdef COLUMN_VECTORS
+// COLUMN_LANES values of each column. The compiler maps the operations on
+// them to the target's SIMD instructions, or to scalar code without any.
+typedef gint64 CentsVector __attribute__((vector_size(COLUMN_LANES * sizeof(gint64))));
+typedef gint32 DayVector __attribute__((vector_size(COLUMN_LANES * sizeof(gint32))));
+typedef gint16 CategoryVector __attribute__((vector_size(COLUMN_LANES * sizeof(gint16))));
+
+// column_filtered for the COLUMN_LANES rows from cents, days and
+// category_ids on, into *filtered. Comparing vectors yields all-ones or
+// all-zeros lanes, which are widened to the cents' width to mask them.
+static inline void column_filtered_lanes(CentsVector *filtered, const gint64 *cents, const gint32 *days,
+                                         const guint16 *category_ids, gint32 first_day, gint32 last_day,
+                                         guint16 category_id) {
+    CentsVector row_cents;
+    DayVector row_days;
+    CategoryVector row_category_ids;
+
+    // The columns are only aligned for their elements
+    memcpy(&row_cents, cents, sizeof(row_cents));
+    memcpy(&row_days, days, sizeof(row_days));
+    memcpy(&row_category_ids, category_ids, sizeof(row_category_ids));
+
+    DayVector in_range = (row_days >= first_day) & (row_days <= last_day);
+    CategoryVector in_category = (row_category_ids == (gint16)category_id) | (gint16)-(category_id == 0);
+    DayVector match = in_range & __builtin_convertvector(in_category, DayVector);
+    *filtered = row_cents & __builtin_convertvector(match, CentsVector);
+}
+#endif
+
+// The analytics kernels scan the columns once, COLUMN_LANES rows per
+// vector step and the remaining rows one at a time, with no branches on
+// the data. Integer cents keep the sums exact and independent of the
+// addition order.
+static double expense_columns_sum(const ExpenseColumns *columns, const ColumnFilter *filter) {
+    const gint64 *restrict cents = (const gint64 *)columns->cents->data;
+    const gint32 *restrict days = (const gint32 *)columns->days->data;
+    const guint16 *restrict category_ids = (const guint16 *)columns->category_ids->data;
+    const gint32 first_day = filter->first_day;
+    const gint32 last_day = filter->last_day;
+    const guint16 category_id = filter->category_id;
+    const guint n_rows = columns->cents->len;
+    gint64 sum = 0;
+    guint i = 0;
+
+#ifdef COLUMN_VECTORS
+    CentsVector lane_sums = {0};
+    for (; i + COLUMN_LANES <= n_rows; i += COLUMN_LANES) {
+        CentsVector filtered;
+        column_filtered_lanes(&filtered, cents + i, days + i, category_ids + i, first_day, last_day, category_id);
+        lane_sums += filtered;
+    }
+    for (int lane = 0; lane < COLUMN_LANES; lane++) {
+        sum += lane_sums[lane];
+    }
+#endif
+    for (; i < n_rows; i++) {
+        sum += column_filtered(cents[i], days[i], category_ids[i], first_day, last_day, category_id);
+    }
+    return sum / 100.0;
+}
+
+// Totals the filtered rows by category, or by payment type, into totals
+// indexed by id as load_chart_totals fills it. Each chunk of rows is
+// filtered a vector at a time, then scattered into per-lane partial
+// totals so that runs of rows in one group do not wait on each other's
+// stores.
+static void expense_columns_group(const ExpenseColumns *columns, const ColumnFilter *filter,
+                                  gboolean by_payment_type, GArray *totals) {
+    const gint32 first_day = filter->first_day;
+    const gint32 last_day = filter->last_day;
+    const guint16 category_id = filter->category_id;
+    const guint n_rows = columns->cents->len;
+    const guint16 *groups = (const guint16 *)(by_payment_type ?
+        columns->payment_type_ids->data : columns->category_ids->data);
+    guint n_groups = (by_payment_type ? columns->max_payment_type_id : columns->max_category_id) + 1;
+    gint64 *partial = g_new0(gint64, (gsize)n_groups * COLUMN_LANES);
+    gint64 filtered[COLUMN_CHUNK_ROWS];
+
+    for (guint start = 0; start < n_rows; start += COLUMN_CHUNK_ROWS) {
+        const gint64 *restrict cents = (const gint64 *)columns->cents->data + start;
+        const gint32 *restrict days = (const gint32 *)columns->days->data + start;
+        const guint16 *restrict category_ids = (const guint16 *)columns->category_ids->data + start;
+        const guint16 *chunk_groups = groups + start;
+        const guint n_chunk_rows = MIN(n_rows - start, COLUMN_CHUNK_ROWS);
+        guint i = 0;
+
+#ifdef COLUMN_VECTORS
+        for (; i + COLUMN_LANES <= n_chunk_rows; i += COLUMN_LANES) {
+            CentsVector lanes;
+            column_filtered_lanes(&lanes, cents + i, days + i, category_ids + i, first_day, last_day, category_id);
+            memcpy(filtered + i, &lanes, sizeof(lanes));
+        }
+#endif
+        for (; i < n_chunk_rows; i++) {
+            filtered[i] = column_filtered(cents[i], days[i], category_ids[i], first_day, last_day, category_id);
+        }
+        for (i = 0; i < n_chunk_rows; i++) {
+            partial[chunk_groups[i] * COLUMN_LANES + i % COLUMN_LANES] += filtered[i];
+        }
+    }
+
+    if (totals->len < n_groups) {
+        g_array_set_size(totals, n_groups);
+    }
+    // Group 0 holds only tombstones
+    for (guint group = 1; group < n_groups; group++) {
+        gint64 total = 0;
+        for (int lane = 0; lane < COLUMN_LANES; lane++) {
+            total += partial[group * COLUMN_LANES + lane];
+        }
+        g_array_index(totals, double, group) = total / 100.0;
+    }
+    g_free(partial);
+}
+
+// Day number, as the day column counts them, of a valid GDate
+static gint32 date_to_day(const GDate *date) {
+    return (gint32)g_date_get_julian(date) - DAY_EPOCH_JULIAN;
+}
+
+static void day_to_date(gint32 day, GDate *date) {
+    g_date_clear(date, 1);
+    g_date_set_julian(date, day + DAY_EPOCH_JULIAN);
+}
+
+// Day number of a YYYY-MM-DD date, or fallback for NULL or anything else
+static gint32 date_string_to_day(const gchar *text, gint32 fallback) {
+    guint year, month, day;
+    GDate date;
+
+    if (text == NULL || sscanf(text, "%4u-%2u-%2u", &year, &month, &day) != 3 ||
+        !g_date_valid_dmy(day, month, year)) {
+        return fallback;
+    }
+    g_date_clear(&date, 1);
+    g_date_set_dmy(&date, day, month, year);
+    return date_to_day(&date);
+}
+
+// Day numbers, as the day column counts them, of the first and last day
+// of a YYYY-MM month
+static gboolean month_day_range(const char *month, gint32 *first_day, gint32 *last_day) {
+    guint year, month_number;
+    GDate date;
+
+    if (sscanf(month, "%4u-%2u", &year, &month_number) != 2 ||
+        !g_date_valid_dmy(1, month_number, year)) {
+        return FALSE;
+    }
+    g_date_clear(&date, 1);
+    g_date_set_dmy(&date, 1, month_number, year);
+    *first_day = date_to_day(&date);
+    *last_day = *first_day + g_date_get_days_in_month(month_number, year) - 1;
+    return TRUE;
+}
+
+// Records the expenses the UI connection writes, for sync_expense_columns
+static void on_expense_write(void *data, int op, const char *db_name, const char *table,
+                             sqlite3_int64 rowid) {
+    AppData *app = data;
+
+    if (strcmp(table, "expenses") == 0) {
+        gint id = (gint)rowid;
+        g_array_append_val(app->column_changes, id);
+    }
+}
+
+typedef struct {
+    ExpenseColumns *columns;
+} ColumnsJob;
+
+static void columns_job_free(gpointer data) {
+    ColumnsJob *load = data;
+    if (load->columns != NULL) {
+        expense_columns_free(load->columns);
+    }
+    g_free(load);
+}
+
+static void run_columns_job(DbWorker *worker, DbJob *job) {
+    ColumnsJob *load = job->data;
+    load->columns = expense_columns_load(&worker->stmts);
+}
+
+// Installs the columns, catches them up with the writes made while they
+// loaded, and recomputes the analytics from them
+static void columns_job_done(AppData *app, DbJob *job) {
+    ColumnsJob *load = job->data;
+
+    if (load->columns == NULL) {
+        g_print("Columnar cache disabled; analytics run through SQL\n");
+        sqlite3_update_hook(app->db, NULL, NULL);
+        g_array_set_size(app->column_changes, 0);
+        return;
+    }
+    app->columns = load->columns;
+    load->columns = NULL;
+    update_budget_progress(app);
+    update_charts(app);
+}
+
+// (Re)loads the analytics columns on the DB worker. Until they arrive
+// the analytics run through SQL. The worker reads a snapshot taken after
+// this call, and every later write on db is recorded from now on, so
+// replaying the recorded ids over the snapshot brings it up to date.
+static void load_expense_columns(AppData *app) {
+    if (app->columns != NULL) {
+        expense_columns_free(app->columns);
+        app->columns = NULL;
+    }
+    g_array_set_size(app->column_changes, 0);
+    sqlite3_update_hook(app->db, on_expense_write, app);
+    db_worker_submit(app->worker, app, DB_JOB_COLUMNS, run_columns_job, columns_job_done,
+                     g_new0(ColumnsJob, 1), columns_job_free);
+}
+
+// Applies the recorded writes to the analytics columns. Returns TRUE if
+// the columns are loaded and current; FALSE means use SQL, and starts a
+// reload if the writes could not be applied.
+static gboolean sync_expense_columns(AppData *app) {
+    if (app->columns == NULL) {
+        return FALSE;
+    }
+    if (app->column_changes->len > 0) {
+        gint64 timer = g_get_monotonic_time();
+        gboolean applied = expense_columns_apply(app->columns, &app->stmts, app->column_changes);
+        stats_record_since("expense_columns_apply", timer);
+        if (!applied) {
+            load_expense_columns(app);
+            return FALSE;
+        }
+        g_array_set_size(app->column_changes, 0);
+    }
+    return TRUE;
+}
+
+// The date range filter: each bound is a calendar enabled by its check
+// button, so either end can stay open. The calendars fold away in an
+// expander whose label shows the active range.
+static void add_date_filter(AppData *app, GtkWidget *main_box) {
+    GtkWidget *date_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
+    
+    app->from_check = gtk_check_button_new_with_label("From:");
+    app->to_check = gtk_check_button_new_with_label("To:");
+    
+    app->from_calendar = gtk_calendar_new();
+    app->to_calendar = gtk_calendar_new();
+    gtk_widget_set_sensitive(app->from_calendar, FALSE);
+    gtk_widget_set_sensitive(app->to_calendar, FALSE);
+    
+    gtk_box_pack_start(GTK_BOX(date_box), app->from_check, FALSE, FALSE, 5);
+    gtk_box_pack_start(GTK_BOX(date_box), app->from_calendar, FALSE, FALSE, 5);
+    gtk_box_pack_start(GTK_BOX(date_box), app->to_check, FALSE, FALSE, 5);
+    gtk_box_pack_start(GTK_BOX(date_box), app->to_calendar, FALSE, FALSE, 5);
+    
+    app->date_expander = gtk_expander_new("Dates: all");
+    gtk_container_add(GTK_CONTAINER(app->date_expander), date_box);
+    gtk_box_pack_start(GTK_BOX(main_box), app->date_expander, FALSE, FALSE, 5);
+
+    g_signal_connect(app->from_check, "toggled", G_CALLBACK(date_filter_changed), app);
+    g_signal_connect(app->to_check, "toggled", G_CALLBACK(date_filter_changed), app);
+    g_signal_connect(app->from_calendar, "day-selected", G_CALLBACK(date_filter_changed), app);
+    g_signal_connect(app->to_calendar, "day-selected", G_CALLBACK(date_filter_changed), app);
+}
+
+// The calendar's day as YYYY-MM-DD, or NULL while its check button is off
+static gchar *calendar_bound(GtkWidget *check, GtkWidget *calendar) {
+    gboolean active = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(check));
+    gtk_widget_set_sensitive(calendar, active);
+    if (!active) {
+        return NULL;
+    }
+    guint year, month, day;
+    gtk_calendar_get_date(GTK_CALENDAR(calendar), &year, &month, &day);
+    return g_strdup_printf("%04u-%02u-%02u", year, month + 1, day);
+}
+
+static void date_filter_changed(GtkWidget *widget, AppData *app) {
+    g_free(app->filter_from_date);
+    g_free(app->filter_to_date);
+    app->filter_from_date = calendar_bound(app->from_check, app->from_calendar);
+    app->filter_to_date = calendar_bound(app->to_check, app->to_calendar);
+
+    gchar *label;
+    if (app->filter_from_date != NULL && app->filter_to_date != NULL) {
+        label = g_strdup_printf("Dates: %s to %s", app->filter_from_date, app->filter_to_date);
+    } else if (app->filter_from_date != NULL) {
+        label = g_strdup_printf("Dates: from %s", app->filter_from_date);
+    } else if (app->filter_to_date != NULL) {
+        label = g_strdup_printf("Dates: until %s", app->filter_to_date);
+    } else {
+        label = g_strdup("Dates: all");
+    }
+    gtk_expander_set_label(GTK_EXPANDER(app->date_expander), label);
+    g_free(label);
+
+    // Reruns the category and search filters with the new range
+    filter_changed(GTK_COMBO_BOX(app->filter_combo), app);
+}
+
+static void on_expense_selected(GtkTreeSelection *selection, AppData *app) {
+    GtkTreeModel *model;
+    GtkTreeIter iter;
+
+    // Reset the selected ID
+    app->selected_expense_id = -1;
+    
+    if (gtk_tree_selection_get_selected(selection, &model, &iter)) {
+        // Store the selected iterator
+        app->selected_iter = iter;
+        
+        // Get the ID from the model
+        gint id;
+        gtk_tree_model_get(model, &iter, 0, &id, -1);
+        app->selected_expense_id = id;
+        
+        // Enable buttons
+        gtk_widget_set_sensitive(app->edit_button, TRUE);
+        gtk_widget_set_sensitive(app->delete_button, TRUE);
+    } else {
+        // Disable buttons if nothing is selected
+        gtk_widget_set_sensitive(app->edit_button, FALSE);
+        gtk_widget_set_sensitive(app->delete_button, FALSE);
+    }
+}
+
+static void reset_selection(AppData *app) {
+    app->selected_expense_id = -1;
+    gtk_tree_selection_unselect_all(app->selection);
+    gtk_widget_set_sensitive(app->edit_button, FALSE);
+    gtk_widget_set_sensitive(app->delete_button, FALSE);
+}
+
+static void edit_expense(GtkButton *button, AppData *app) {
+    if (app->selected_expense_id < 0) {
+        g_print("No expense selected for editing\n");
+        return;
+    }
+
+    // Deltas shift row indices, so take the selection's current iterator
+    GtkTreeIter iter;
+    if (gtk_tree_selection_get_selected(app->selection, NULL, &iter)) {
+        show_edit_dialog(app, app->selected_expense_id, iter);
+    }
+}
+
+// Whether the edit or delete just run changed no row because the expense
+// is archived: those change the database alone. Tells the user so.
+static gboolean expense_is_archived(AppData *app) {
+    if (sqlite3_changes(app->db) > 0) {
+        return FALSE;
+    }
+
+    GtkWidget *dialog = gtk_message_dialog_new(GTK_WINDOW(app->window),
+        GTK_DIALOG_MODAL,
+        GTK_MESSAGE_INFO,
+        GTK_BUTTONS_OK,
+        "This expense is archived with its year and cannot be changed.");
+    gtk_dialog_run(GTK_DIALOG(dialog));
+    gtk_widget_destroy(dialog);
+    return TRUE;
+}
+
+static void delete_expense(GtkButton *button, AppData *app) {
+    if (app->selected_expense_id < 0) {
+        g_print("No expense selected for deletion\n");
+        return;
+    }
+
+    GtkWidget *dialog = gtk_message_dialog_new(GTK_WINDOW(app->window),
+        GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
+        GTK_MESSAGE_QUESTION,
+        GTK_BUTTONS_YES_NO,
+        "Are you sure you want to delete this expense?");
+
+    gint response = gtk_dialog_run(GTK_DIALOG(dialog));
+    gtk_widget_destroy(dialog);
+
+    if (response == GTK_RESPONSE_YES) {
+        sqlite3_stmt *stmt = stmt_cache_get(&app->stmts, SQL_DELETE_EXPENSE);
+
+        // The row's values, for removing it from the view
+        ExpenseRow old = {.id = app->selected_expense_id};
+        gchar *category = NULL, *payment_type = NULL;
+        GtkTreeIter iter;
+        if (gtk_tree_selection_get_selected(app->selection, NULL, &iter)) {
+            gtk_tree_model_get(GTK_TREE_MODEL(app->expense_model), &iter,
+                EXPENSE_COL_DESCRIPTION, &old.description,
+                EXPENSE_COL_AMOUNT, &old.amount,
+                EXPENSE_COL_PAYMENT_TYPE, &payment_type,
+                EXPENSE_COL_DATE, &old.date,
+                EXPENSE_COL_CATEGORY, &category,
+                -1);
+            old.category_id = dictionary_lookup(&app->categories, category);
+            old.payment_type_id = dictionary_lookup(&app->payment_types, payment_type);
+        }
+
+        if (stmt != NULL) {
+            sqlite3_bind_int(stmt, 1, old.id);
+            int rc = sqlite3_step(stmt);
+            sqlite3_reset(stmt);
+
+            if (rc == SQLITE_DONE && !expense_is_archived(app)) {
+                description_index_add(app->descriptions, old.description, old.category_id,
+                                      old.payment_type_id, -1);
+                expense_deleted(app, &old);
+                update_budget_progress(app);
+                update_charts(app);
+
+                // Show success message
+                GtkWidget *success_dialog = gtk_message_dialog_new(GTK_WINDOW(app->window),
+                    GTK_DIALOG_MODAL,
+                    GTK_MESSAGE_INFO,
+                    GTK_BUTTONS_OK,
+                    "Expense deleted successfully!");
+                gtk_dialog_run(GTK_DIALOG(success_dialog));
+                gtk_widget_destroy(success_dialog);
+            }
+
+        }
+        expense_row_clear(&old);
+        g_free(category);
+        g_free(payment_type);
+    }
+}
+
+static void show_edit_dialog(AppData *app, gint id, GtkTreeIter iter) {
+    // Create edit dialog
+    GtkWidget *dialog = gtk_dialog_new_with_buttons("Edit Expense",
+        GTK_WINDOW(app->window),
+        GTK_DIALOG_MODAL,
+        "Save", GTK_RESPONSE_ACCEPT,
+        "Cancel", GTK_RESPONSE_CANCEL,
+        NULL);
+
+    // Create form grid
+    GtkWidget *content_area = gtk_dialog_get_content_area(GTK_DIALOG(dialog));
+    GtkWidget *grid = gtk_grid_new();
+    gtk_grid_set_row_spacing(GTK_GRID(grid), 5);
+    gtk_grid_set_column_spacing(GTK_GRID(grid), 5);
+    gtk_container_set_border_width(GTK_CONTAINER(grid), 10);
+
+    // Create form fields
+    GtkWidget *amount_entry = gtk_entry_new();
+    GtkWidget *description_entry = gtk_entry_new();
+    GtkWidget *category_combo = gtk_combo_box_text_new();
+    GtkWidget *payment_combo = gtk_combo_box_text_new();
+    GtkWidget *date_entry = gtk_entry_new();
+
+    // Get current values
+    GtkTreeModel *model = GTK_TREE_MODEL(app->expense_model);
+    gdouble amount;
+    gchar *description, *category, *payment_type, *date;
+    gtk_tree_model_get(model, &iter,
+        EXPENSE_COL_AMOUNT, &amount,
+        EXPENSE_COL_DESCRIPTION, &description,
+        EXPENSE_COL_CATEGORY, &category,
+        EXPENSE_COL_PAYMENT_TYPE, &payment_type,
+        EXPENSE_COL_DATE, &date,
+        -1);
+
+    // Set current values
+    char amount_text[32];
+    g_snprintf(amount_text, sizeof(amount_text), "%.2f", amount);
+    gtk_entry_set_text(GTK_ENTRY(amount_entry), amount_text);
+    gtk_entry_set_text(GTK_ENTRY(description_entry), description ? description : "");
+    gtk_entry_set_text(GTK_ENTRY(date_entry), date ? date : "");
+    gtk_entry_set_placeholder_text(GTK_ENTRY(date_entry), "YYYY-MM-DD");
+
+    // Add categories
+    gint category_id = dictionary_lookup(&app->categories, category);
+    dictionary_fill_combo(&app->categories, category_combo);
+    dictionary_set_active(&app->categories, category_combo, category_id);
+
+    // Add payment types
+    dictionary_fill_combo(&app->payment_types, payment_combo);
+    dictionary_set_active(&app->payment_types, payment_combo,
+                          dictionary_lookup(&app->payment_types, payment_type));
+
+    // Add fields to grid
+    gtk_grid_attach(GTK_GRID(grid), gtk_label_new("Amount:"), 0, 0, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), amount_entry, 1, 0, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), gtk_label_new("Description:"), 0, 1, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), description_entry, 1, 1, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), gtk_label_new("Category:"), 0, 2, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), category_combo, 1, 2, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), gtk_label_new("Payment Type:"), 0, 3, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), payment_combo, 1, 3, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), gtk_label_new("Date:"), 0, 4, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), date_entry, 1, 4, 1, 1);
+
+    gtk_container_add(GTK_CONTAINER(content_area), grid);
+    gtk_widget_show_all(dialog);
+
+    // Handle response
+    if (gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_ACCEPT) {
+        const char *new_amount = gtk_entry_get_text(GTK_ENTRY(amount_entry));
+        const char *new_description = gtk_entry_get_text(GTK_ENTRY(description_entry));
+        gchar *new_category = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(category_combo));
+        gchar *new_payment_type = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(payment_combo));
+        gint new_category_id = dictionary_lookup(&app->categories, new_category);
+        gint new_payment_type_id = dictionary_lookup(&app->payment_types, new_payment_type);
+        const char *new_date = gtk_entry_get_text(GTK_ENTRY(date_entry));
+        g_free(new_category);
+        g_free(new_payment_type);
+
+        if (strlen(new_amount) > 0 && strlen(new_description) > 0 && 
+            new_category_id > 0 && new_payment_type_id > 0 && is_valid_date(new_date)) {
+            
+            // Update database
+            sqlite3_stmt *stmt = stmt_cache_get(&app->stmts, SQL_UPDATE_EXPENSE);
+            
+            if (stmt != NULL) {
+                sqlite3_bind_double(stmt, 1, atof(new_amount));
+                sqlite3_bind_text(stmt, 2, new_description, -1, SQLITE_STATIC);
+                sqlite3_bind_int(stmt, 3, new_category_id);
+                sqlite3_bind_int(stmt, 4, new_payment_type_id);
+                sqlite3_bind_text(stmt, 5, new_date, -1, SQLITE_STATIC);
+                sqlite3_bind_int(stmt, 6, id);
+                int rc = sqlite3_step(stmt);
+                sqlite3_reset(stmt);
+                
+                if (rc == SQLITE_DONE && !expense_is_archived(app)) {
+                    // Update tree view
+                    ExpenseRow old = {id, description, amount,
+                                      dictionary_lookup(&app->payment_types, payment_type),
+                                      date, category_id};
+                    description_index_add(app->descriptions, old.description, old.category_id,
+                                          old.payment_type_id, -1);
+                    description_index_add(app->descriptions, new_description, new_category_id,
+                                          new_payment_type_id, 1);
+                    expense_edited(app, &old);
+                    
+                    // Show success message
+                    GtkWidget *success_dialog = gtk_message_dialog_new(GTK_WINDOW(app->window),
+                        GTK_DIALOG_MODAL,
+                        GTK_MESSAGE_INFO,
+                        GTK_BUTTONS_OK,
+                        "Expense updated successfully!");
+                    gtk_dialog_run(GTK_DIALOG(success_dialog));
+                    gtk_widget_destroy(success_dialog);
+                    
+                    // Update displays
+                    update_budget_progress(app);
+                    update_charts(app);
+                }
+            }
+        }
+    }
+
+    // Cleanup
+    g_free(description);
+    g_free(category);
+    g_free(payment_type);
+    g_free(date);
+    gtk_widget_destroy(dialog);
+}
+
+// Lazy, SQLite-backed tree model
+
+struct _RowBlock {
+    int index;                  // Block number in the ExpenseIndex
+    int n_rows;
+    GList *lru_link;            // This block's link in ExpenseModel.lru
+    ExpenseRow rows[];
+};
+
+struct _ExpenseModel {
+    GObject parent_instance;
+    DbWorker *worker;           // Fetches the row blocks
+    StmtCache *stmts;           // UI connection, for placing rows changed by a delta
+    const Dictionary *categories;    // Names for the category ids of the rows
+    const Dictionary *payment_types; // Names for the payment type ids
+    ExpenseIndex *index;
+    guint serial;               // Bumped by every delta; fetches begun before are dropped
+    gint stamp;
+    gint retired;               // Set once replaced; pending fetches are skipped
+    GHashTable *blocks;         // Block number -> RowBlock
+    GHashTable *pending;        // Block numbers being fetched
+    GQueue lru;                 // Cached blocks, most recently used at the head
+    RowBlock *last_block;       // Shortcut for consecutive lookups in one block
+};
+
+static void expense_model_tree_model_init(GtkTreeModelIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE(ExpenseModel, expense_model, G_TYPE_OBJECT,
+    G_IMPLEMENT_INTERFACE(GTK_TYPE_TREE_MODEL, expense_model_tree_model_init))
+
+static void clear_seek_key(gpointer data) {
+    SeekKey *key = data;
+    g_free(key->text);
+    g_free(key->date);
+}
+
+// The column an order sorts by ahead of the date, NULL for date order
+static const char *expense_order_column(const ExpenseOrder *order) {
+    switch (order->column) {
+    case EXPENSE_SORT_DESCRIPTION:
+        return "description";
+    case EXPENSE_SORT_AMOUNT:
+        return "amount";
+    case EXPENSE_SORT_PAYMENT_TYPE:
+        return "payment_type_id";
+    case EXPENSE_SORT_CATEGORY:
+        return "category_id";
+    default:
+        return NULL;
+    }
+}
+
+// Appends " ORDER BY" for an order, every term in its direction
+static void append_order_by(GString *sql, const ExpenseOrder *order) {
+    const char *column = expense_order_column(order);
+    const char *direction = order->ascending ? "" : " DESC";
+
+    g_string_append(sql, " ORDER BY ");
+    if (column != NULL) {
+        g_string_append_printf(sql, "%s%s, ", column, direction);
+    }
+    g_string_append_printf(sql, "date%s, id%s", direction, direction);
+}
+
+// Appends a row value term keeping the rows that come after a key in the
+// list order, or before it. Being a range on the order's index, it seeks
+// straight to the key.
+static void append_seek_term(GString *sql, const ExpenseOrder *order, gboolean after) {
+    const char *column = expense_order_column(order);
+    const char *op = after != order->ascending ? "<" : ">";
+
+    if (column != NULL) {
+        g_string_append_printf(sql, "(%s, date, id) %s (?, ?, ?)", column, op);
+    } else {
+        g_string_append_printf(sql, "(date, id) %s (?, ?)", op);
+    }
+}
+
+// Binds the key a term from append_seek_term compares with
+static void bind_seek_key(sqlite3_stmt *stmt, int *param, const ExpenseOrder *order, const SeekKey *key) {
+    if (order->column == EXPENSE_SORT_DESCRIPTION) {
+        sqlite3_bind_text(stmt, (*param)++, key->text, -1, SQLITE_STATIC);
+    } else if (order->column != EXPENSE_SORT_DATE) {
+        sqlite3_bind_double(stmt, (*param)++, key->number);
+    }
+    sqlite3_bind_text(stmt, (*param)++, key->date, -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, (*param)++, key->id);
+}
+
+// A row's position in the list order. The key borrows the row's strings.
+static SeekKey expense_row_key(const ExpenseOrder *order, const ExpenseRow *row) {
+    SeekKey key = {row->description, 0, row->date, row->id};
+
+    switch (order->column) {
+    case EXPENSE_SORT_AMOUNT:
+        key.number = row->amount;
+        break;
+    case EXPENSE_SORT_PAYMENT_TYPE:
+        key.number = row->payment_type_id;
+        break;
+    case EXPENSE_SORT_CATEGORY:
+        key.number = row->category_id;
+        break;
+    }
+    return key;
+}
+
+// Compares two positions the way SQLite orders the rows: negative if a
+// comes first in the list. Text compares bytewise, as SQLite's BINARY
+// collation does.
+static int seek_key_compare(const ExpenseOrder *order, const SeekKey *a, const SeekKey *b) {
+    int cmp = 0;
+
+    if (order->column == EXPENSE_SORT_DESCRIPTION) {
+        cmp = g_strcmp0(a->text, b->text);
+    } else if (order->column != EXPENSE_SORT_DATE) {
+        cmp = (a->number > b->number) - (a->number < b->number);
+    }
+    if (cmp == 0) {
+        cmp = strcmp(a->date, b->date);
+    }
+    if (cmp == 0) {
+        cmp = (a->id > b->id) - (a->id < b->id);
+    }
+    return order->ascending ? cmp : -cmp;
+}
+
+// A NULL order keeps the default, newest first. archives must outlive
+// the index.
+static ExpenseIndex *expense_index_new(const GArray *archives, const ExpenseOrder *order, gint category_id,
+                                       const gchar *from_date, const gchar *to_date, const gchar *fts_query) {
+    ExpenseIndex *index = g_new0(ExpenseIndex, 1);
+    index->archives = archives;
+    if (order != NULL) {
+        index->order = *order;
+    }
+    index->category_id = category_id;
+    index->from_date = g_strdup(from_date);
+    index->to_date = g_strdup(to_date);
+    index->fts_query = g_strdup(fts_query);
+    index->block_keys = g_array_new(FALSE, TRUE, sizeof(SeekKey));
+    g_array_set_clear_func(index->block_keys, clear_seek_key);
+    index->block_starts = g_array_new(FALSE, FALSE, sizeof(int));
+
+    // There is always a first block, starting at the top
+    SeekKey first = {NULL, 0, NULL, 0};
+    int first_start = 0;
+    g_array_append_val(index->block_keys, first);
+    g_array_append_val(index->block_starts, first_start);
+    return index;
+}
+
+static int expense_index_block_start(const ExpenseIndex *index, int block) {
+    return g_array_index(index->block_starts, int, block);
+}
+
+static int expense_index_block_rows(const ExpenseIndex *index, int block) {
+    int end = block + 1 < (int)index->block_starts->len
+        ? expense_index_block_start(index, block + 1) : index->n_rows;
+    return end - expense_index_block_start(index, block);
+}
+
+// Finds the block holding a row: the last one starting at or before it,
+// which skips any blocks that deletes have emptied
+static int expense_index_find_row(const ExpenseIndex *index, int row) {
+    int low = 0, high = (int)index->block_starts->len - 1;
+
+    while (low < high) {
+        int mid = (low + high + 1) / 2;
+        if (expense_index_block_start(index, mid) <= row) {
+            low = mid;
+        } else {
+            high = mid - 1;
+        }
+    }
+    return low;
+}
+
+// Whether a block start key comes before a row's key in the list order;
+// the first block's NULL key comes before every row
+static gboolean seek_key_precedes(const ExpenseOrder *order, const SeekKey *key, const SeekKey *row_key) {
+    return key->date == NULL || seek_key_compare(order, key, row_key) < 0;
+}
+
+// Finds the block a row belongs in, whether or not it is in the list
+// yet: the last one whose start key precedes the row's key
+static int expense_index_find_key(const ExpenseIndex *index, const SeekKey *row_key) {
+    int low = 0, high = (int)index->block_keys->len - 1;
+
+    while (low < high) {
+        int mid = (low + high + 1) / 2;
+        if (seek_key_precedes(&index->order, &g_array_index(index->block_keys, SeekKey, mid), row_key)) {
+            low = mid;
+        } else {
+            high = mid - 1;
+        }
+    }
+    return low;
+}
+
+static void expense_row_clear(ExpenseRow *row) {
+    g_free(row->description);
+    g_free(row->date);
+}
+
+static void row_block_free(gpointer data) {
+    RowBlock *block = data;
+    for (int i = 0; i < block->n_rows; i++) {
+        expense_row_clear(&block->rows[i]);
+    }
+    if (block->lru_link != NULL) {
+        g_list_free_1(block->lru_link);
+    }
+    g_free(block);
+}
+
+static void expense_index_free(gpointer data) {
+    ExpenseIndex *index = data;
+    if (index == NULL) {
+        return;
+    }
+    if (index->first_block != NULL) {
+        row_block_free(index->first_block);
+    }
+    g_free(index->from_date);
+    g_free(index->to_date);
+    g_free(index->fts_query);
+    g_array_free(index->block_keys, TRUE);
+    g_array_free(index->block_starts, TRUE);
+    g_free(index);
+}
+
+static void expense_model_init(ExpenseModel *model) {
+    model->stamp = g_random_int();
+    model->blocks = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, row_block_free);
+    model->pending = g_hash_table_new(g_direct_hash, g_direct_equal);
+    g_queue_init(&model->lru);
+}
+
+static void expense_model_finalize(GObject *object) {
+    ExpenseModel *model = EXPENSE_MODEL(object);
+
+    expense_index_free(model->index);
+    // The hash table frees the blocks and with them the LRU links
+    g_queue_init(&model->lru);
+    g_hash_table_destroy(model->blocks);
+    g_hash_table_destroy(model->pending);
+
+    G_OBJECT_CLASS(expense_model_parent_class)->finalize(object);
+}
+
+static void expense_model_class_init(ExpenseModelClass *klass) {
+    G_OBJECT_CLASS(klass)->finalize = expense_model_finalize;
+}
+
+// Reads the rows of a block query into block, up to max_rows
+static void read_row_block(sqlite3_stmt *stmt, RowBlock *block, int max_rows) {
+    while (block->n_rows < max_rows && sqlite3_step(stmt) == SQLITE_ROW) {
+        ExpenseRow *row = &block->rows[block->n_rows++];
+        row->id = sqlite3_column_int(stmt, 0);
+        row->description = g_strdup((const char *)sqlite3_column_text(stmt, 1));
+        row->amount = sqlite3_column_double(stmt, 2);
+        row->payment_type_id = sqlite3_column_int(stmt, 3);
+        row->date = g_strdup((const char *)sqlite3_column_text(stmt, 4));
+        row->category_id = sqlite3_column_int(stmt, 5);
+    }
+}
+
+// Counts the rows of the filter and records where each block starts. For
+// browsing this is one pass over the index of the list order, or over
+// just the part of it a date range covers, that reads only the key of
+// every EXPENSE_BLOCK_ROWS-th row. A search is capped at
+// SEARCH_RESULT_LIMIT matches, one block, so it reads them right away:
+// the results come with the count instead of a block fetch later. Its
+// first row is only known once the rank window is ranked, and the rest
+// are already sorted by then, so there is nothing left to stream.
+static void build_expense_index(StmtCache *stmts, ExpenseIndex *index) {
+    GString *sql = g_string_new(NULL);
+
+    if (index->fts_query != NULL) {
+        g_string_append(sql, "SELECT e.id, e.description, e.amount, e.payment_type_id, e.date, e.category_id FROM ");
+        append_search_matches(sql, index->archives, index->category_id, index->from_date, index->to_date,
+                              SEARCH_RANK_WINDOW);
+        g_string_append(sql, " ORDER BY e.rank LIMIT ?");
+    } else {
+        const char *column = expense_order_column(&index->order);
+        g_string_append_printf(sql, "SELECT %s, date, id FROM ", column != NULL ? column : "NULL");
+        append_partitions(sql, index->archives, index->from_date, index->to_date);
+        const char *glue = " WHERE ";
+        if (index->category_id > 0) {
+            g_string_append(sql, " WHERE category_id = ?");
+            glue = " AND ";
+        }
+        append_date_range(sql, &glue, "date", index->from_date, index->to_date);
+        append_order_by(sql, &index->order);
+    }
+
+    sqlite3_stmt *stmt = stmt_cache_get(stmts, sql->str);
+    if (stmt != NULL) {
+        int param = 1;
+        if (index->fts_query != NULL) {
+            bind_search_matches(stmt, &param, index->fts_query, index->category_id, index->from_date,
+                                index->to_date, SEARCH_RANK_WINDOW);
+            sqlite3_bind_int(stmt, param++, SEARCH_RESULT_LIMIT);
+
+            RowBlock *block = g_malloc0(sizeof(RowBlock) + SEARCH_RESULT_LIMIT * sizeof(ExpenseRow));
+            read_row_block(stmt, block, SEARCH_RESULT_LIMIT);
+            index->first_block = block;
+            index->n_rows = block->n_rows;
+        } else {
+            if (index->category_id > 0) {
+                sqlite3_bind_int(stmt, param++, index->category_id);
+            }
+            bind_date_range(stmt, &param, index->from_date, index->to_date);
+            while (sqlite3_step(stmt) == SQLITE_ROW) {
+                // The last row of each full block is where the next one starts
+                if (++index->n_rows % EXPENSE_BLOCK_ROWS == 0) {
+                    SeekKey key = {NULL, 0, NULL, 0};
+                    if (index->order.column == EXPENSE_SORT_DESCRIPTION) {
+                        key.text = g_strdup((const char *)sqlite3_column_text(stmt, 0));
+                    } else {
+                        key.number = sqlite3_column_double(stmt, 0);
+                    }
+                    key.date = g_strdup((const char *)sqlite3_column_text(stmt, 1));
+                    key.id = sqlite3_column_int(stmt, 2);
+                    g_array_append_val(index->block_keys, key);
+                }
+            }
+        }
+        sqlite3_reset(stmt);
+    } else {
+        g_print("SQL error: %s\n", sqlite3_errmsg(stmts->db));
+    }
+
+    // Every block starts out full; search results, which are not split by
+    // keys, are cut into blocks the same way
+    int n_blocks = index->fts_query != NULL
+        ? MAX(1, (index->n_rows + EXPENSE_BLOCK_ROWS - 1) / EXPENSE_BLOCK_ROWS)
+        : (int)index->block_keys->len;
+    for (int i = 1; i < n_blocks; i++) {
+        int start = i * EXPENSE_BLOCK_ROWS;
+        g_array_append_val(index->block_starts, start);
+    }
+
+    g_string_free(sql, TRUE);
+}
+
+// A block fetch on the DB worker. It carries its own copy of everything
+// the query needs, since deltas change the model's index meanwhile.
+typedef struct {
+    ExpenseModel *model;
+    int index;                  // Block number
+    guint serial;               // Model serial when the fetch was queued
+    ExpenseOrder order;
+    gint category_id;
+    gchar *from_date;
+    gchar *to_date;
+    gchar *fts_query;
+    const GArray *archives;
+    SeekKey key;                // Start key (browsing only)
+    int n_rows;                 // Rows in the block
+    int offset;                 // First row (search only)
+    int rank_window;            // Newest matches a search ranks, 0 for all
+    RowBlock *block;
+} BlockJob;
+
+// Reads one block of rows. Browsing seeks from the block's start key on
+// the index of the list order (idx_expenses_date, or idx_expenses_category
+// when filtering by category in date order), so any block costs the same
+// as the first instead of skipping rows with OFFSET. Search results are ranked rather than date ordered and
+// capped at SEARCH_RESULT_LIMIT, so there an OFFSET is bounded and cheap.
+static RowBlock *load_row_block(StmtCache *stmts, const BlockJob *fetch) {
+    gboolean by_category = fetch->category_id > 0;
+    gboolean by_search = fetch->fts_query != NULL;
+
+    // Only add the WHERE terms that are active so SQLite can pick the index
+    // for each combination instead of scanning past "? IS NULL OR" guards
+    GString *sql = g_string_new(NULL);
+    if (by_search) {
+        g_string_append(sql, "SELECT e.id, e.description, e.amount, e.payment_type_id, e.date, e.category_id FROM ");
+        append_search_matches(sql, fetch->archives, fetch->category_id, fetch->from_date, fetch->to_date,
+                              fetch->rank_window);
+        g_string_append(sql, " ORDER BY e.rank LIMIT ? OFFSET ?");
+    } else {
+        // The sort columns are all selected, which lets SQLite merge the
+        // partitions' ordered rows
+        g_string_append(sql, "SELECT id, description, amount, payment_type_id, date, category_id FROM ");
+        append_partitions(sql, fetch->archives, fetch->from_date, fetch->to_date);
+        const char *glue = " WHERE ";
+        if (by_category) {
+            g_string_append(sql, " WHERE category_id = ?");
+            glue = " AND ";
+        }
+        append_date_range(sql, &glue, "date", fetch->from_date, fetch->to_date);
+        if (fetch->key.date != NULL) {
+            g_string_append(sql, glue);
+            append_seek_term(sql, &fetch->order, TRUE);
+        }
+        append_order_by(sql, &fetch->order);
+        g_string_append(sql, " LIMIT ?");
+    }
+
+    RowBlock *block = g_malloc0(sizeof(RowBlock) + fetch->n_rows * sizeof(ExpenseRow));
+    block->index = fetch->index;
+
+    sqlite3_stmt *stmt = stmt_cache_get(stmts, sql->str);
+    if (stmt != NULL) {
+        int param = 1;
+        if (by_search) {
+            bind_search_matches(stmt, &param, fetch->fts_query, fetch->category_id, fetch->from_date,
+                                fetch->to_date, fetch->rank_window);
+            sqlite3_bind_int(stmt, param++, fetch->n_rows);
+            sqlite3_bind_int(stmt, param++, fetch->offset);
+        } else {
+            if (by_category) {
+                sqlite3_bind_int(stmt, param++, fetch->category_id);
+            }
+            bind_date_range(stmt, &param, fetch->from_date, fetch->to_date);
+            if (fetch->key.date != NULL) {
+                bind_seek_key(stmt, &param, &fetch->order, &fetch->key);
+            }
+            sqlite3_bind_int(stmt, param++, fetch->n_rows);
+        }
+
+        read_row_block(stmt, block, fetch->n_rows);
+        sqlite3_reset(stmt);
+    } else {
+        g_print("SQL error: %s\n", sqlite3_errmsg(stmts->db));
+    }
+
+    g_string_free(sql, TRUE);
+    return block;
+}
+
+static void block_job_free(gpointer data) {
+    BlockJob *fetch = data;
+    if (fetch->block != NULL) {
+        row_block_free(fetch->block);
+    }
+    g_object_unref(fetch->model);
+    g_free(fetch->from_date);
+    g_free(fetch->to_date);
+    g_free(fetch->fts_query);
+    clear_seek_key(&fetch->key);
+    g_free(fetch);
+}
+
+static void run_block_job(DbWorker *worker, DbJob *job) {
+    BlockJob *fetch = job->data;
+
+    if (!g_atomic_int_get(&fetch->model->retired)) {
+        fetch->block = load_row_block(&worker->stmts, fetch);
+    }
+}
+
+// Tells the view that the rows of a block have (new) data to show
+static void expense_model_block_changed(ExpenseModel *model, int block) {
+    gint64 timer = g_get_monotonic_time();
+    int start = expense_index_block_start(model->index, block);
+    int n_rows = expense_index_block_rows(model->index, block);
+    GtkTreeIter iter;
+
+    iter.stamp = model->stamp;
+    for (int row = start; row < start + n_rows; row++) {
+        GtkTreePath *path = gtk_tree_path_new_from_indices(row, -1);
+        iter.user_data = GINT_TO_POINTER(row);
+        gtk_tree_model_row_changed(GTK_TREE_MODEL(model), path, &iter);
+        gtk_tree_path_free(path);
+    }
+    stats_record_since("expense_model_block_changed", timer);
+}
+
+// Caches a block, evicting the least recently used one if full
+static void expense_model_cache_block(ExpenseModel *model, RowBlock *block) {
+    if (g_hash_table_size(model->blocks) >= EXPENSE_MAX_BLOCKS) {
+        GList *oldest = g_queue_peek_tail_link(&model->lru);
+        RowBlock *victim = oldest->data;
+        g_queue_unlink(&model->lru, oldest);
+        if (model->last_block == victim) {
+            model->last_block = NULL;
+        }
+        g_hash_table_remove(model->blocks, GINT_TO_POINTER(victim->index));
+    }
+    block->lru_link = g_list_alloc();
+    block->lru_link->data = block;
+    g_queue_push_head_link(&model->lru, block->lru_link);
+    g_hash_table_insert(model->blocks, GINT_TO_POINTER(block->index), block);
+}
+
+// Caches a fetched block and tells the view its rows now have data. A
+// block fetched before a delta may be missing the change, so it is
+// dropped and the view asks for its rows again.
+static void block_job_done(AppData *app, DbJob *job) {
+    BlockJob *fetch = job->data;
+    ExpenseModel *model = fetch->model;
+    RowBlock *block = fetch->block;
+
+    g_hash_table_remove(model->pending, GINT_TO_POINTER(fetch->index));
+    if (block == NULL || model->retired) {
+        return;
+    }
+    if (fetch->serial != model->serial) {
+        expense_model_block_changed(model, fetch->index);
+        return;
+    }
+    fetch->block = NULL; // Now owned by the cache
+
+    expense_model_cache_block(model, block);
+    expense_model_block_changed(model, block->index);
+}
+
+static void expense_model_fetch_block(ExpenseModel *model, int block_index) {
+    const ExpenseIndex *index = model->index;
+    BlockJob *fetch = g_new0(BlockJob, 1);
+
+    fetch->model = g_object_ref(model);
+    fetch->index = block_index;
+    fetch->serial = model->serial;
+    fetch->order = index->order;
+    fetch->category_id = index->category_id;
+    fetch->from_date = g_strdup(index->from_date);
+    fetch->to_date = g_strdup(index->to_date);
+    fetch->fts_query = g_strdup(index->fts_query);
+    fetch->archives = index->archives;
+    fetch->rank_window = SEARCH_RANK_WINDOW;
+    fetch->n_rows = expense_index_block_rows(index, block_index);
+    fetch->offset = expense_index_block_start(index, block_index);
+    if (index->fts_query == NULL) {
+        const SeekKey *key = &g_array_index(index->block_keys, SeekKey, block_index);
+        fetch->key.text = g_strdup(key->text);
+        fetch->key.number = key->number;
+        fetch->key.date = g_strdup(key->date);
+        fetch->key.id = key->id;
+    }
+
+    g_hash_table_add(model->pending, GINT_TO_POINTER(block_index));
+    db_worker_submit(model->worker, NULL, DB_JOB_EVERY, run_block_job, block_job_done,
+                     fetch, block_job_free);
+}
+
+// Returns the row at index, or NULL while its block is still being
+// fetched on the DB worker; the view is told through row-changed once it
+// arrives. The pointer stays valid until the next block arrives.
+static const ExpenseRow *expense_model_get_row(ExpenseModel *model, int index) {
+    if (index < 0 || index >= model->index->n_rows) {
+        return NULL;
+    }
+
+    // Consecutive lookups mostly stay within the last block
+    RowBlock *block = model->last_block;
+    int block_index;
+    if (block != NULL && index >= expense_index_block_start(model->index, block->index) &&
+        index - expense_index_block_start(model->index, block->index) < block->n_rows) {
+        block_index = block->index;
+    } else {
+        block_index = expense_index_find_row(model->index, index);
+    }
+
+    if (block == NULL || block->index != block_index) {
+        block = g_hash_table_lookup(model->blocks, GINT_TO_POINTER(block_index));
+        if (block == NULL) {
+            if (!g_hash_table_contains(model->pending, GINT_TO_POINTER(block_index))) {
+                expense_model_fetch_block(model, block_index);
+            }
+            return NULL;
+        }
+
+        // Move to the front of the LRU list
+        g_queue_unlink(&model->lru, block->lru_link);
+        g_queue_push_head_link(&model->lru, block->lru_link);
+        model->last_block = block;
+    }
+
+    int offset = index - expense_index_block_start(model->index, block_index);
+    return offset < block->n_rows ? &block->rows[offset] : NULL;
+}
+
+// Takes ownership of index. stmts is the UI connection's cache, which
+// places the rows changed by deltas. The dictionaries must outlive the model.
+static ExpenseModel *expense_model_new(DbWorker *worker, StmtCache *stmts, const Dictionary *categories,
+                                       const Dictionary *payment_types, ExpenseIndex *index) {
+    ExpenseModel *model = g_object_new(EXPENSE_TYPE_MODEL, NULL);
+    model->worker = worker;
+    model->stmts = stmts;
+    model->categories = categories;
+    model->payment_types = payment_types;
+    model->index = index;
+    if (index->first_block != NULL) {
+        expense_model_cache_block(model, index->first_block);
+        index->first_block = NULL;
+    }
+    return model;
+}
+
+// Row deltas. Added, edited and deleted rows are placed in the list by
+// their key in its order: a binary search over the block start keys finds
+// the block, and an index range count over at most that block's rows the
+// offset within it. The view then gets a single row-inserted, row-deleted
+// or row-changed signal. The block's cached rows are dropped and refetched
+// when next shown. Search results do not take deltas (see can_apply_delta).
+
+// Row index of a row, which need not be in the list yet, or -1 on
+// error. Sets *block to the block it belongs in. The row itself is not
+// counted, wherever an edit has moved it to.
+static int expense_model_locate(ExpenseModel *model, const ExpenseRow *row, int *block) {
+    const ExpenseIndex *index = model->index;
+    SeekKey row_key = expense_row_key(&index->order, row);
+    *block = expense_index_find_key(index, &row_key);
+    const SeekKey *key = &g_array_index(index->block_keys, SeekKey, *block);
+
+    GString *sql = g_string_new("SELECT COUNT(*) FROM ");
+    append_partitions(sql, index->archives, index->from_date, index->to_date);
+    g_string_append(sql, " WHERE ");
+    const char *glue = "";
+    if (index->category_id > 0) {
+        g_string_append(sql, "category_id = ?");
+        glue = " AND ";
+    }
+    append_date_range(sql, &glue, "date", index->from_date, index->to_date);
+    g_string_append(sql, glue);
+    if (key->date != NULL) {
+        append_seek_term(sql, &index->order, TRUE);
+        g_string_append(sql, " AND ");
+    }
+    append_seek_term(sql, &index->order, FALSE);
+    g_string_append(sql, " AND id != ?");
+
+    int position = -1;
+    sqlite3_stmt *stmt = stmt_cache_get(model->stmts, sql->str);
+    if (stmt != NULL) {
+        int param = 1;
+        if (index->category_id > 0) {
+            sqlite3_bind_int(stmt, param++, index->category_id);
+        }
+        bind_date_range(stmt, &param, index->from_date, index->to_date);
+        if (key->date != NULL) {
+            bind_seek_key(stmt, &param, &index->order, key);
+        }
+        bind_seek_key(stmt, &param, &index->order, &row_key);
+        sqlite3_bind_int(stmt, param++, row->id);
+
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            position = expense_index_block_start(index, *block) + sqlite3_column_int(stmt, 0);
+        }
+        sqlite3_reset(stmt);
+    } else {
+        g_print("SQL error: %s\n", sqlite3_errmsg(model->stmts->db));
+    }
+
+    g_string_free(sql, TRUE);
+    return position;
+}
+
+// Forgets a block's cached rows and any fetch in flight
+static void expense_model_drop_block(ExpenseModel *model, int block_index) {
+    RowBlock *block = g_hash_table_lookup(model->blocks, GINT_TO_POINTER(block_index));
+
+    if (block != NULL) {
+        g_queue_unlink(&model->lru, block->lru_link);
+        if (model->last_block == block) {
+            model->last_block = NULL;
+        }
+        g_hash_table_remove(model->blocks, GINT_TO_POINTER(block_index));
+    }
+    model->serial++;
+}
+
+// Grows or shrinks a block by delta rows, shifting the blocks after it
+static void expense_model_resize_block(ExpenseModel *model, int block_index, int delta) {
+    ExpenseIndex *index = model->index;
+
+    for (guint i = block_index + 1; i < index->block_starts->len; i++) {
+        g_array_index(index->block_starts, int, i) += delta;
+    }
+    index->n_rows += delta;
+    expense_model_drop_block(model, block_index);
+}
+
+// Whether a row belongs in the model's view
+static gboolean expense_model_matches(ExpenseModel *model, const ExpenseRow *row) {
+    const ExpenseIndex *index = model->index;
+    return (index->category_id == 0 || index->category_id == row->category_id) &&
+           (index->from_date == NULL || strcmp(row->date, index->from_date) >= 0) &&
+           (index->to_date == NULL || strcmp(row->date, index->to_date) <= 0);
+}
+
+// Shows a row just inserted into expenses. Returns FALSE if the model
+// cannot take the delta and must be reloaded instead.
+static gboolean expense_model_insert(ExpenseModel *model, const ExpenseRow *row) {
+    int block;
+    if (model->index->fts_query != NULL) {
+        return FALSE;
+    }
+    if (!expense_model_matches(model, row)) {
+        return TRUE;
+    }
+
+    int position = expense_model_locate(model, row, &block);
+    if (position < 0) {
+        return FALSE;
+    }
+    expense_model_resize_block(model, block, 1);
+
+    GtkTreeIter iter;
+    GtkTreePath *path = gtk_tree_path_new_from_indices(position, -1);
+    iter.stamp = model->stamp;
+    iter.user_data = GINT_TO_POINTER(position);
+    gtk_tree_model_row_inserted(GTK_TREE_MODEL(model), path, &iter);
+    gtk_tree_path_free(path);
+    return TRUE;
+}
+
+// Removes a row, given its values before it was deleted or edited
+static gboolean expense_model_remove(ExpenseModel *model, const ExpenseRow *row) {
+    int block;
+    if (model->index->fts_query != NULL) {
+        return FALSE;
+    }
+    if (!expense_model_matches(model, row)) {
+        return TRUE;
+    }
+
+    int position = expense_model_locate(model, row, &block);
+    if (position < 0 || position >= model->index->n_rows) {
+        return FALSE;
+    }
+    expense_model_resize_block(model, block, -1);
+
+    GtkTreePath *path = gtk_tree_path_new_from_indices(position, -1);
+    gtk_tree_model_row_deleted(GTK_TREE_MODEL(model), path);
+    gtk_tree_path_free(path);
+    return TRUE;
+}
+
+// Redraws a row whose place in the list is unchanged
+static gboolean expense_model_change(ExpenseModel *model, const ExpenseRow *row) {
+    int block;
+    if (model->index->fts_query != NULL) {
+        return FALSE;
+    }
+    if (!expense_model_matches(model, row)) {
+        return TRUE;
+    }
+
+    int position = expense_model_locate(model, row, &block);
+    if (position < 0 || position >= model->index->n_rows) {
+        return FALSE;
+    }
+    expense_model_drop_block(model, block);
+
+    GtkTreeIter iter;
+    GtkTreePath *path = gtk_tree_path_new_from_indices(position, -1);
+    iter.stamp = model->stamp;
+    iter.user_data = GINT_TO_POINTER(position);
+    gtk_tree_model_row_changed(GTK_TREE_MODEL(model), path, &iter);
+    gtk_tree_path_free(path);
+    return TRUE;
+}
+
+// Shows an edited row, given its values before and after the edit: in
+// place if it keeps its position, else by moving it
+static gboolean expense_model_update(ExpenseModel *model, const ExpenseRow *old, const ExpenseRow *row) {
+    const ExpenseOrder *order = &model->index->order;
+    SeekKey old_key = expense_row_key(order, old);
+    SeekKey key = expense_row_key(order, row);
+
+    if (seek_key_compare(order, &old_key, &key) == 0 &&
+        expense_model_matches(model, old) == expense_model_matches(model, row)) {
+        return expense_model_change(model, row);
+    }
+    return expense_model_remove(model, old) && expense_model_insert(model, row);
+}
+
+// Marks a model that the view no longer shows so that its outstanding
+// block fetches are skipped
+static void expense_model_retire(ExpenseModel *model) {
+    g_atomic_int_set(&model->retired, TRUE);
+}
+
+static int expense_model_get_n_rows(ExpenseModel *model) {
+    return model->index->n_rows;
+}
+
+static GtkTreeModelFlags expense_model_get_flags(GtkTreeModel *tree_model) {
+    return GTK_TREE_MODEL_LIST_ONLY;
+}
+
+static gint expense_model_get_n_columns(GtkTreeModel *tree_model) {
+    return EXPENSE_N_COLUMNS;
+}
+
+static GType expense_model_get_column_type(GtkTreeModel *tree_model, gint column) {
+    switch (column) {
+    case EXPENSE_COL_ID:
+        return G_TYPE_INT;
+    case EXPENSE_COL_AMOUNT:
+        return G_TYPE_DOUBLE;
+    default:
+        return G_TYPE_STRING;
+    }
+}
+
+// Iterators carry the row index in user_data
+static gboolean expense_model_iter_nth_child(GtkTreeModel *tree_model, GtkTreeIter *iter,
+                                             GtkTreeIter *parent, gint n) {
+    ExpenseModel *model = EXPENSE_MODEL(tree_model);
+
+    if (parent != NULL || n < 0 || n >= model->index->n_rows) {
+        return FALSE;
+    }
+    iter->stamp = model->stamp;
+    iter->user_data = GINT_TO_POINTER(n);
+    return TRUE;
+}
+
+static gboolean expense_model_get_iter(GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreePath *path) {
+    if (gtk_tree_path_get_depth(path) != 1) {
+        return FALSE;
+    }
+    return expense_model_iter_nth_child(tree_model, iter, NULL, gtk_tree_path_get_indices(path)[0]);
+}
+
+static GtkTreePath *expense_model_get_path(GtkTreeModel *tree_model, GtkTreeIter *iter) {
+    return gtk_tree_path_new_from_indices(GPOINTER_TO_INT(iter->user_data), -1);
+}
+
+static void expense_model_get_value(GtkTreeModel *tree_model, GtkTreeIter *iter,
+                                    gint column, GValue *value) {
+    ExpenseModel *model = EXPENSE_MODEL(tree_model);
+    const ExpenseRow *row = expense_model_get_row(model, GPOINTER_TO_INT(iter->user_data));
+
+    g_value_init(value, expense_model_get_column_type(tree_model, column));
+    if (row == NULL) {
+        return;
+    }
+
+    switch (column) {
+    case EXPENSE_COL_ID:
+        g_value_set_int(value, row->id);
+        break;
+    case EXPENSE_COL_DESCRIPTION:
+        g_value_set_string(value, row->description);
+        break;
+    case EXPENSE_COL_AMOUNT:
+        g_value_set_double(value, row->amount);
+        break;
+    case EXPENSE_COL_PAYMENT_TYPE:
+        g_value_set_string(value, dictionary_name(model->payment_types, row->payment_type_id));
+        break;
+    case EXPENSE_COL_DATE:
+        g_value_set_string(value, row->date);
+        break;
+    case EXPENSE_COL_CATEGORY:
+        g_value_set_string(value, dictionary_name(model->categories, row->category_id));
+        break;
+    }
+}
+
+static gboolean expense_model_iter_next(GtkTreeModel *tree_model, GtkTreeIter *iter) {
+    return expense_model_iter_nth_child(tree_model, iter, NULL, GPOINTER_TO_INT(iter->user_data) + 1);
+}
+
+static gboolean expense_model_iter_previous(GtkTreeModel *tree_model, GtkTreeIter *iter) {
+    return expense_model_iter_nth_child(tree_model, iter, NULL, GPOINTER_TO_INT(iter->user_data) - 1);
+}
+
+static gboolean expense_model_iter_children(GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreeIter *parent) {
+    return expense_model_iter_nth_child(tree_model, iter, parent, 0);
+}
+
+static gboolean expense_model_iter_has_child(GtkTreeModel *tree_model, GtkTreeIter *iter) {
+    return FALSE;
+}
+
+static gint expense_model_iter_n_children(GtkTreeModel *tree_model, GtkTreeIter *iter) {
+    return iter == NULL ? EXPENSE_MODEL(tree_model)->index->n_rows : 0;
+}
+
+static gboolean expense_model_iter_parent(GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreeIter *child) {
+    return FALSE;
+}
+
+static void expense_model_tree_model_init(GtkTreeModelIface *iface) {
+    iface->get_flags = expense_model_get_flags;
+    iface->get_n_columns = expense_model_get_n_columns;
+    iface->get_column_type = expense_model_get_column_type;
+    iface->get_iter = expense_model_get_iter;
+    iface->get_path = expense_model_get_path;
+    iface->get_value = expense_model_get_value;
+    iface->iter_next = expense_model_iter_next;
+    iface->iter_previous = expense_model_iter_previous;
+    iface->iter_children = expense_model_iter_children;
+    iface->iter_has_child = expense_model_iter_has_child;
+    iface->iter_n_children = expense_model_iter_n_children;
+    iface->iter_nth_child = expense_model_iter_nth_child;
+    iface->iter_parent = expense_model_iter_parent;
+}
+
+// Headless benchmark: `main benchmark [--rows N] [--iterations N]
+// [--seed N] [--db FILE]` fills a new database with a synthetic ledger,
+// times the UI's hot paths on it through the same query code, and prints
+// the results to stdout as one JSON object. The database is removed
+// afterwards unless --keep is given.
+
+// Synthetic ledger shape, by built-in dictionary id - 1: how often each
+// category and payment type occurs in percent, each category's typical
+// amount, and the description words searches hit
+static const int BENCHMARK_CATEGORY_WEIGHTS[] = {35, 20, 12, 18, 15};
+static const int BENCHMARK_PAYMENT_WEIGHTS[] = {30, 30, 25, 15};
+static const double BENCHMARK_MEDIANS[] = {12.0, 8.0, 25.0, 80.0, 30.0};
+static const char *const BENCHMARK_WORDS[][4] = {
+    {"coffee", "groceries", "lunch", "dinner"},         // Food
+    {"bus", "taxi", "fuel", "train"},                   // Transport
+    {"cinema", "concert", "games", "books"},            // Entertainment
+    {"electricity", "rent", "phone", "internet"},       // Bills
+    {"gift", "pharmacy", "haircut", "repairs"}          // Others
+};
+static const char *const BENCHMARK_PLACES[] = {"downtown", "market", "station", "online", "home"};
+
+typedef struct {
+    sqlite3 *db;
+    StmtCache stmts;
+    GRand *rand;
+    int n_rows;
+    int n_iterations;
+    gint max_id;
+    char month[8];              // Current month, for the budget sum
+    char today[11];             // Current date, for the edits
+    ColumnFilter month_filter;  // The same month, for the analytics kernels
+    ExpenseColumns *columns;
+    ExpenseIndex *list;         // Unfiltered index, for seeking to the end
+    const char *csv_file;
+    const char *backup_file;
+    GString *results;           // JSON array elements so far
+} Benchmark;
+
+typedef void (*BenchmarkCase)(Benchmark *bench, int iteration);
+
+// Index into weights, which sum to 100, picked by weight
+static int benchmark_pick(GRand *rand, const int *weights, int n_weights) {
+    int r = g_rand_int_range(rand, 0, 100);
+    for (int i = 0; i < n_weights - 1; i++) {
+        if ((r -= weights[i]) < 0) {
+            return i;
+        }
+    }
+    return n_weights - 1;
+}
+
+// Fills expenses with n_rows rows in the importer's batches, then sets a
+// budget of a little over each month's spend. Returns FALSE on an SQL error.
+static gboolean benchmark_generate(Benchmark *bench) {
+    sqlite3_stmt *stmt;
+    gchar *dates[BENCHMARK_SPAN_DAYS + 1];
+    GDateTime *today = g_date_time_new_now_local();
+    gboolean ok = TRUE;
+
+    if (sqlite3_prepare_v3(bench->db, SQL_IMPORT_EXPENSE, -1, SQLITE_PREPARE_PERSISTENT, &stmt, NULL) != SQLITE_OK) {
+        g_printerr("SQL error: %s\n", sqlite3_errmsg(bench->db));
+        g_date_time_unref(today);
+        return FALSE;
+    }
+    for (int i = 0; i <= BENCHMARK_SPAN_DAYS; i++) {
+        GDateTime *day = g_date_time_add_days(today, -i);
+        dates[i] = g_date_time_format(day, "%Y-%m-%d");
+        g_date_time_unref(day);
+    }
+
+    sqlite3_exec(bench->db, "BEGIN", 0, 0, NULL);
+    for (int i = 0; ok && i < bench->n_rows; i++) {
+        int category = benchmark_pick(bench->rand, BENCHMARK_CATEGORY_WEIGHTS,
+                                      G_N_ELEMENTS(BENCHMARK_CATEGORY_WEIGHTS));
+        int payment_type = benchmark_pick(bench->rand, BENCHMARK_PAYMENT_WEIGHTS,
+                                          G_N_ELEMENTS(BENCHMARK_PAYMENT_WEIGHTS));
+
+        // Amounts are log-normal around the category's median
+        double u1 = g_rand_double(bench->rand);
+        double u2 = g_rand_double(bench->rand);
+        double normal = sqrt(-2 * log(1 - u1)) * cos(2 * G_PI * u2);
+        double amount = round(BENCHMARK_MEDIANS[category] * exp(0.6 * normal) * 100) / 100;
+
+        // Ledgers grow over time, so recent days hold more rows
+        int days_ago = (int)(BENCHMARK_SPAN_DAYS * (1 - sqrt(g_rand_double(bench->rand))));
+
+        gchar *description = g_strdup_printf("%s %s",
+            BENCHMARK_WORDS[category][g_rand_int_range(bench->rand, 0, 4)],
+            BENCHMARK_PLACES[g_rand_int_range(bench->rand, 0, G_N_ELEMENTS(BENCHMARK_PLACES))]);
+
+        sqlite3_bind_double(stmt, 1, amount);
+        sqlite3_bind_text(stmt, 2, description, -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int(stmt, 3, category + 1);
+        sqlite3_bind_int(stmt, 4, payment_type + 1);
+        sqlite3_bind_text(stmt, 5, dates[days_ago], -1, SQLITE_STATIC);
+        ok = sqlite3_step(stmt) == SQLITE_DONE;
+        sqlite3_reset(stmt);
+        g_free(description);
+
+        if (ok && (i + 1) % IMPORT_BATCH_ROWS == 0) {
+            ok = sqlite3_exec(bench->db, "COMMIT; BEGIN", 0, 0, NULL) == SQLITE_OK;
+        }
+    }
+    // Read before the budget rows are inserted, which move the rowid on
+    bench->max_id = (gint)sqlite3_last_insert_rowid(bench->db);
+
+    const char *sql_budget =
+        "INSERT INTO budget (amount, month) "
+        "SELECT round(SUM(total) * 1.1), month FROM month_totals GROUP BY month;"
+        "COMMIT;";
+    if (!ok || sqlite3_exec(bench->db, sql_budget, 0, 0, NULL) != SQLITE_OK) {
+        g_printerr("SQL error: %s\n", sqlite3_errmsg(bench->db));
+        sqlite3_exec(bench->db, "ROLLBACK", 0, 0, NULL);
+        ok = FALSE;
+    }
+
+    sqlite3_finalize(stmt);
+    for (int i = 0; i <= BENCHMARK_SPAN_DAYS; i++) {
+        g_free(dates[i]);
+    }
+    g_date_time_unref(today);
+    return ok;
+}
+
+// Loads a block of index the way the model's fetches do
+static void benchmark_load_block(Benchmark *bench, const ExpenseIndex *index, int block_index) {
+    BlockJob fetch = {0};
+
+    fetch.index = block_index;
+    fetch.order = index->order;
+    fetch.category_id = index->category_id;
+    fetch.from_date = index->from_date;
+    fetch.to_date = index->to_date;
+    fetch.fts_query = index->fts_query;
+    fetch.rank_window = SEARCH_RANK_WINDOW;
+    fetch.n_rows = expense_index_block_rows(index, block_index);
+    fetch.offset = expense_index_block_start(index, block_index);
+    if (index->fts_query == NULL) {
+        fetch.key = g_array_index(index->block_keys, SeekKey, block_index);
+    }
+    row_block_free(load_row_block(&bench->stmts, &fetch));
+}
+
+// Builds a list index as refresh_expense_view does and loads the first
+// block, which is what the view shows first. A search reads it along with
+// the index.
+static void benchmark_open_list(Benchmark *bench, const ExpenseOrder *order, gint category_id,
+                                const gchar *search_text) {
+    gchar *fts_query = search_text != NULL ? make_fts_query(search_text) : NULL;
+    ExpenseIndex *index = expense_index_new(NULL, order, category_id, NULL, NULL, fts_query);
+
+    build_expense_index(&bench->stmts, index);
+    if (index->first_block == NULL) {
+        benchmark_load_block(bench, index, 0);
+    }
+    expense_index_free(index);
+    g_free(fts_query);
+}
+
+static void benchmark_list_load(Benchmark *bench, int iteration) {
+    benchmark_open_list(bench, NULL, 0, NULL);
+}
+
+static void benchmark_list_seek_end(Benchmark *bench, int iteration) {
+    benchmark_load_block(bench, bench->list, bench->list->block_keys->len - 1);
+}
+
+static void benchmark_category_filter(Benchmark *bench, int iteration) {
+    benchmark_open_list(bench, NULL, 1 + iteration % G_N_ELEMENTS(BENCHMARK_CATEGORY_WEIGHTS), NULL);
+}
+
+// Cycles through the header sorts other than date, both directions
+static void benchmark_sorted_list(Benchmark *bench, int iteration) {
+    ExpenseOrder order = {EXPENSE_SORT_DESCRIPTION + iteration % 4, iteration / 4 % 2};
+    benchmark_open_list(bench, &order, 0, NULL);
+}
+
+static void benchmark_search(Benchmark *bench, int iteration) {
+    benchmark_open_list(bench, NULL, 0, "coffee market");
+}
+
+static void benchmark_month_budget(Benchmark *bench, int iteration) {
+    sqlite3_stmt *stmt = stmt_cache_get(&bench->stmts, SQL_MONTH_SPEND);
+
+    if (stmt != NULL) {
+        sqlite3_bind_text(stmt, 1, bench->month, -1, SQLITE_STATIC);
+        sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+    }
+}
+
+static void benchmark_chart_totals(Benchmark *bench, const char *sql) {
+    GArray *totals = g_array_new(FALSE, TRUE, sizeof(double));
+    load_chart_totals(&bench->stmts, sql, NULL, totals);
+    g_array_free(totals, TRUE);
+}
+
+static void benchmark_category_totals(Benchmark *bench, int iteration) {
+    benchmark_chart_totals(bench, SQL_CATEGORY_TOTALS);
+}
+
+static void benchmark_payment_totals(Benchmark *bench, int iteration) {
+    benchmark_chart_totals(bench, SQL_PAYMENT_TOTALS);
+}
+
+static void benchmark_day_series(Benchmark *bench, int iteration) {
+    day_series_free(load_day_series(&bench->stmts));
+}
+
+static void benchmark_columns_load(Benchmark *bench, int iteration) {
+    if (bench->columns != NULL) {
+        expense_columns_free(bench->columns);
+    }
+    bench->columns = expense_columns_load(&bench->stmts);
+}
+
+// volatile keeps the compiler from dropping the unused sum
+static void benchmark_columns_month_budget(Benchmark *bench, int iteration) {
+    volatile double spend = expense_columns_sum(bench->columns, &bench->month_filter);
+    (void)spend;
+}
+
+static void benchmark_columns_month_categories(Benchmark *bench, int iteration) {
+    GArray *totals = g_array_new(FALSE, TRUE, sizeof(double));
+    expense_columns_group(bench->columns, &bench->month_filter, FALSE, totals);
+    g_array_free(totals, TRUE);
+}
+
+static void benchmark_columns_category_totals(Benchmark *bench, int iteration) {
+    const ColumnFilter all = {G_MININT32, G_MAXINT32, 0};
+    GArray *totals = g_array_new(FALSE, TRUE, sizeof(double));
+    expense_columns_group(bench->columns, &all, FALSE, totals);
+    g_array_free(totals, TRUE);
+}
+
+// Edits a random row in its own transaction, as the edit dialog does
+static void benchmark_edit(Benchmark *bench, int iteration) {
+    sqlite3_stmt *stmt = stmt_cache_get(&bench->stmts, SQL_UPDATE_EXPENSE);
+
+    if (stmt != NULL) {
+        sqlite3_bind_double(stmt, 1, g_rand_double_range(bench->rand, 1, 100));
+        sqlite3_bind_text(stmt, 2, "benchmark edit", -1, SQLITE_STATIC);
+        sqlite3_bind_int(stmt, 3, g_rand_int_range(bench->rand, 1, 6));
+        sqlite3_bind_int(stmt, 4, g_rand_int_range(bench->rand, 1, 5));
+        sqlite3_bind_text(stmt, 5, bench->today, -1, SQLITE_STATIC);
+        sqlite3_bind_int(stmt, 6, g_rand_int_range(bench->rand, 1, bench->max_id + 1));
+        sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+    }
+}
+
+// Deletes a different row each time, newest first
+static void benchmark_delete(Benchmark *bench, int iteration) {
+    sqlite3_stmt *stmt = stmt_cache_get(&bench->stmts, SQL_DELETE_EXPENSE);
+
+    if (stmt != NULL) {
+        sqlite3_bind_int(stmt, 1, bench->max_id - iteration);
+        sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+    }
+}
+
+static void benchmark_export(Benchmark *bench, int iteration) {
+    ExportJob export = {0};
+    FILE *fp = fopen(bench->csv_file, "w");
+
+    if (fp != NULL) {
+        setvbuf(fp, NULL, _IOFBF, EXPORT_BUFFER_SIZE);
+        write_export_rows(&export, bench->db, fp);
+        fclose(fp);
+    }
+    g_remove(bench->csv_file);
+}
+
+// A whole backup of the ledger, stepped as the UI steps it
+static void benchmark_backup(Benchmark *bench, int iteration) {
+    BackupJob *backup = backup_begin(bench->db, "main", bench->backup_file);
+
+    if (backup != NULL) {
+        while (backup_step(backup) == SQLITE_OK) {
+        }
+        backup_end(backup);
+        backup_job_free(backup);
+    }
+    g_remove(bench->backup_file);
+}
+
+static int compare_doubles(gconstpointer a, gconstpointer b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Runs one hot path n_iterations times and appends its timings to the
+// results
+static void benchmark_run(Benchmark *bench, const char *name, BenchmarkCase run) {
+    double *samples = g_new(double, bench->n_iterations);
+
+    for (int i = 0; i < bench->n_iterations; i++) {
+        gint64 start = g_get_monotonic_time();
+        run(bench, i);
+        samples[i] = (g_get_monotonic_time() - start) / 1000.0;
+    }
+    qsort(samples, bench->n_iterations, sizeof(double), compare_doubles);
+
+    g_string_append_printf(bench->results,
+        "%s\n    {\"name\": \"%s\", \"iterations\": %d, "
+        "\"min_ms\": %.3f, \"median_ms\": %.3f, \"max_ms\": %.3f}",
+        bench->results->len > 0 ? "," : "", name, bench->n_iterations,
+        samples[0], samples[bench->n_iterations / 2], samples[bench->n_iterations - 1]);
+    g_free(samples);
+}
+
+// Reads an integer option value of at least minimum. Returns FALSE if it
+// is not one.
+static gboolean parse_int_option(const char *value, int minimum, int *result) {
+    char *end;
+    gint64 number = value != NULL ? g_ascii_strtoll(value, &end, 10) : 0;
+
+    if (value == NULL || end == value || *end != '\0' || number < minimum || number > G_MAXINT) {
+        return FALSE;
+    }
+    *result = (int)number;
+    return TRUE;
+}
+
+// Reads a positive integer option value. Returns FALSE if it is not one.
+static gboolean parse_count(const char *value, int *count) {
+    return parse_int_option(value, 1, count);
+}
 
-            // Draw legend
-            cairo_set_source_rgb(cr, 
-                CATEGORY_COLORS[i].r,
-                CATEGORY_COLORS[i].g,
-                CATEGORY_COLORS[i].b);
-            cairo_rectangle(cr, width - 150, legend_y, 15, 15);
-            cairo_fill(cr);
+static int run_benchmark(int argc, char *argv[]) {
+    Benchmark bench = {0};
+    const char *db_file = BENCHMARK_FILE;
+    int seed = 1;
+    gboolean keep = FALSE;
 
-            cairo_set_source_rgb(cr, 0, 0, 0);
-            cairo_move_to(cr, width - 130, legend_y + 12);
-            char legend_text[100];
-            snprintf(legend_text, sizeof(legend_text), "%s (%.1f%%)",
-                    CATEGORY_COLORS[i].label,
-                    (category_totals[i] / total) * 100);
-            cairo_show_text(cr, legend_text);
+    bench.n_rows = BENCHMARK_ROWS;
+    bench.n_iterations = BENCHMARK_ITERATIONS;
+    for (int i = 1; i < argc; i++) {
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        gboolean ok = TRUE;
 
-            legend_y += 25;
-            start_angle += slice;
+        if (strcmp(argv[i], "--rows") == 0) {
+            ok = parse_count(value, &bench.n_rows);
+            i++;
+        } else if (strcmp(argv[i], "--iterations") == 0) {
+            ok = parse_count(value, &bench.n_iterations);
+            i++;
+        } else if (strcmp(argv[i], "--seed") == 0) {
+            // Any non-negative seed will do, 0 included
+            ok = parse_int_option(value, 0, &seed);
+            i++;
+        } else if (strcmp(argv[i], "--db") == 0) {
+            ok = value != NULL;
+            db_file = value;
+            i++;
+        } else if (strcmp(argv[i], "--keep") == 0) {
+            keep = TRUE;
+        } else {
+            ok = FALSE;
+        }
+        if (!ok) {
+            g_printerr("Usage: %s [--rows N] [--iterations N] [--seed N] [--db FILE] [--keep]\n", argv[0]);
+            return 2;
         }
     }
 
-    return TRUE;
-}
+    // The benchmark edits and deletes rows, so it never runs on an
+    // existing database
+    if (g_file_test(db_file, G_FILE_TEST_EXISTS)) {
+        g_printerr("%s already exists; remove it or pass another --db\n", db_file);
+        return 1;
+    }
 
-static gboolean draw_payment_chart(GtkWidget *widget, cairo_t *cr, AppData *app) {
-    GtkAllocation allocation;
-    gtk_widget_get_allocation(widget, &allocation);
-    
-    int width = allocation.width;
-    int height = allocation.height;
-    int size = MIN(width, height);
-    double radius = size * 0.35;
-    double center_x = width / 2;
-    double center_y = height / 2;
+    StorageProfile profile;
+    storage_profile_load(&profile);
+    g_free(profile.database_file);
+    profile.database_file = g_strdup(db_file);
+    bench.db = open_connection(&profile);
+    storage_profile_clear(&profile);
+    if (bench.db == NULL) {
+        return 1;
+    }
+    init_database(bench.db);
+    stmt_cache_init(&bench.stmts, bench.db);
+    bench.rand = g_rand_new_with_seed(seed);
+    bench.results = g_string_new(NULL);
+    gchar *csv_file = g_strconcat(db_file, ".csv", NULL);
+    gchar *backup_file = g_strconcat(db_file, ".backup", NULL);
+    bench.csv_file = csv_file;
+    bench.backup_file = backup_file;
 
-    // Get payment totals
-    double payment_totals[4] = {0};
-    double total = 0;
-    
-    sqlite3_stmt *stmt;
-    const char *sql = "SELECT payment_type, SUM(amount) FROM expenses GROUP BY payment_type";
-    
-    if (sqlite3_prepare_v2(app->db, sql, -1, &stmt, NULL) == SQLITE_OK) {
-        while (sqlite3_step(stmt) == SQLITE_ROW) {
-            const char *payment_type = (const char *)sqlite3_column_text(stmt, 0);
-            double amount = sqlite3_column_double(stmt, 1);
-            
-            for (int i = 0; i < 4; i++) {
-                if (strcmp(payment_type, PAYMENT_COLORS[i].label) == 0) {
-                    payment_totals[i] = amount;
-                    total += amount;
-                    break;
-                }
-            }
+    time_t t = time(NULL);
+    strftime(bench.month, sizeof(bench.month), "%Y-%m", localtime(&t));
+    strftime(bench.today, sizeof(bench.today), "%Y-%m-%d", localtime(&t));
+    month_day_range(bench.month, &bench.month_filter.first_day, &bench.month_filter.last_day);
+
+    gint64 start = g_get_monotonic_time();
+    gboolean generated = benchmark_generate(&bench);
+    double generate_ms = (g_get_monotonic_time() - start) / 1000.0;
+
+    if (generated) {
+        bench.list = expense_index_new(NULL, NULL, 0, NULL, NULL, NULL);
+        build_expense_index(&bench.stmts, bench.list);
+
+        // Reads first, then the writes, which change what later runs see
+        benchmark_run(&bench, "list_load", benchmark_list_load);
+        benchmark_run(&bench, "list_seek_end", benchmark_list_seek_end);
+        benchmark_run(&bench, "category_filter", benchmark_category_filter);
+        benchmark_run(&bench, "sorted_list", benchmark_sorted_list);
+        benchmark_run(&bench, "search", benchmark_search);
+        benchmark_run(&bench, "month_budget", benchmark_month_budget);
+        benchmark_run(&bench, "category_totals", benchmark_category_totals);
+        benchmark_run(&bench, "payment_totals", benchmark_payment_totals);
+        benchmark_run(&bench, "day_series", benchmark_day_series);
+        benchmark_run(&bench, "columns_load", benchmark_columns_load);
+        if (bench.columns != NULL) {
+            benchmark_run(&bench, "columns_month_budget", benchmark_columns_month_budget);
+            benchmark_run(&bench, "columns_month_categories", benchmark_columns_month_categories);
+            benchmark_run(&bench, "columns_category_totals", benchmark_columns_category_totals);
+            expense_columns_free(bench.columns);
         }
-        sqlite3_finalize(stmt);
+        benchmark_run(&bench, "export", benchmark_export);
+        benchmark_run(&bench, "backup", benchmark_backup);
+        benchmark_run(&bench, "edit", benchmark_edit);
+        benchmark_run(&bench, "delete", benchmark_delete);
+        expense_index_free(bench.list);
+
+        g_print("{\n"
+                "  \"sqlite_version\": \"%s\",\n"
+                "  \"rows\": %d,\n"
+                "  \"seed\": %d,\n"
+                "  \"generate_ms\": %.3f,\n"
+                "  \"results\": [%s\n  ]\n"
+                "}\n",
+                sqlite3_libversion(), bench.n_rows, seed, generate_ms, bench.results->str);
     }
 
-    // Draw pie chart
-    double start_angle = -G_PI / 2;
-    double legend_y = 20;
+    g_string_free(bench.results, TRUE);
+    g_free(csv_file);
+    g_free(backup_file);
+    g_rand_free(bench.rand);
+    stmt_cache_clear(&bench.stmts);
+    sqlite3_close(bench.db);
+    if (!keep) {
+        gchar *wal_file = g_strconcat(db_file, "-wal", NULL);
+        gchar *shm_file = g_strconcat(db_file, "-shm", NULL);
+        g_remove(db_file);
+        g_remove(wal_file);
+        g_remove(shm_file);
+        g_free(wal_file);
+        g_free(shm_file);
+    }
+    return generated ? 0 : 1;
+}
 
-    for (int i = 0; i < 4; i++) {
-        if (payment_totals[i] > 0) {
-            double slice = 2 * G_PI * payment_totals[i] / total;
-            
-            // Draw slice
-            cairo_move_to(cr, center_x, center_y);
-            cairo_arc(cr, center_x, center_y, radius, 
-                     start_angle, start_angle + slice);
-            cairo_close_path(cr);
-            
-            cairo_set_source_rgb(cr, 
-                PAYMENT_COLORS[i].r,
-                PAYMENT_COLORS[i].g,
-                PAYMENT_COLORS[i].b);
-            cairo_fill_preserve(cr);
-            cairo_set_source_rgb(cr, 1, 1, 1);
-            cairo_stroke(cr);
+// Headless reports: `main months|categories|payments|budget|list
+// [--format csv|json] [--db FILE] [--month YYYY-MM] [--category NAME]
+// [--search TEXT] [--limit N]` prints one report to stdout, read through
+// the same queries the UI runs. Messages go to stderr so the output
+// stays parseable.
 
-            // Draw legend
-            cairo_set_source_rgb(cr, 
-                PAYMENT_COLORS[i].r,
-                PAYMENT_COLORS[i].g,
-                PAYMENT_COLORS[i].b);
-            cairo_rectangle(cr, width - 150, legend_y, 15, 15);
-            cairo_fill(cr);
+typedef struct {
+    const char *db_file;        // NULL for the storage profile's
+    gboolean json;
+    const char *month;          // YYYY-MM; NULL for all time, or the current month for budget
+    const char *category;
+    const char *search;
+    int limit;                  // Rows a listing stops at, 0 for all
+} ReportOptions;
 
-            cairo_set_source_rgb(cr, 0, 0, 0);
-            cairo_move_to(cr, width - 130, legend_y + 12);
-            char legend_text[100];
-            snprintf(legend_text, sizeof(legend_text), "%s (%.1f%%)",
-                    PAYMENT_COLORS[i].label,
-                    (payment_totals[i] / total) * 100);
-            cairo_show_text(cr, legend_text);
+// One report's output, as CSV with a header or as a JSON array of objects
+typedef struct {
+    const ReportOptions *options;
+    const char *const *columns;
+    const gboolean *numeric;    // Per column: written as a JSON number
+    int n_columns;
+    int n_rows;
+} ReportWriter;
 
-            legend_y += 25;
-            start_angle += slice;
+static void write_json_string(FILE *fp, const char *text) {
+    putc('"', fp);
+    for (const char *c = text; c != NULL && *c != '\0'; c++) {
+        if (*c == '"' || *c == '\\') {
+            fprintf(fp, "\\%c", *c);
+        } else if ((unsigned char)*c < 0x20) {
+            fprintf(fp, "\\u%04x", *c);
+        } else {
+            putc(*c, fp);
         }
     }
+    putc('"', fp);
+}
 
-    return TRUE;
+static void report_begin(ReportWriter *writer) {
+    if (writer->options->json) {
+        putc('[', stdout);
+        return;
+    }
+    for (int i = 0; i < writer->n_columns; i++) {
+        if (i > 0) {
+            putc(',', stdout);
+        }
+        write_csv_field(stdout, writer->columns[i]);
+    }
+    fputs("\r\n", stdout);
 }
 
-static void update_charts(AppData *app) {
-    gtk_widget_queue_draw(app->category_chart);
-    gtk_widget_queue_draw(app->payment_chart);
+static void report_row(ReportWriter *writer, const char *const *values) {
+    if (writer->options->json) {
+        fputs(writer->n_rows > 0 ? ",\n  {" : "\n  {", stdout);
+        for (int i = 0; i < writer->n_columns; i++) {
+            if (i > 0) {
+                fputs(", ", stdout);
+            }
+            write_json_string(stdout, writer->columns[i]);
+            fputs(": ", stdout);
+            if (values[i] == NULL) {
+                fputs("null", stdout);
+            } else if (writer->numeric[i]) {
+                fputs(values[i], stdout);
+            } else {
+                write_json_string(stdout, values[i]);
+            }
+        }
+        putc('}', stdout);
+    } else {
+        for (int i = 0; i < writer->n_columns; i++) {
+            if (i > 0) {
+                putc(',', stdout);
+            }
+            write_csv_field(stdout, values[i]);
+        }
+        fputs("\r\n", stdout);
+    }
+    writer->n_rows++;
 }
 
-static void add_date_filter(AppData *app, GtkWidget *main_box) {
-    GtkWidget *date_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
-    
-    GtkWidget *from_label = gtk_label_new("From:");
-    GtkWidget *to_label = gtk_label_new("To:");
-    
-    GtkWidget *from_date = gtk_calendar_new();
-    GtkWidget *to_date = gtk_calendar_new();
-    
-    gtk_box_pack_start(GTK_BOX(date_box), from_label, FALSE, FALSE, 5);
-    gtk_box_pack_start(GTK_BOX(date_box), from_date, FALSE, FALSE, 5);
-    gtk_box_pack_start(GTK_BOX(date_box), to_label, FALSE, FALSE, 5);
-    gtk_box_pack_start(GTK_BOX(date_box), to_date, FALSE, FALSE, 5);
-    
-    gtk_box_pack_start(GTK_BOX(main_box), date_box, FALSE, FALSE, 5);
+static void report_end(ReportWriter *writer) {
+    if (writer->options->json) {
+        fputs(writer->n_rows > 0 ? "\n]\n" : "]\n", stdout);
+    }
 }
 
-static void on_expense_selected(GtkTreeSelection *selection, AppData *app) {
-    GtkTreeModel *model;
-    GtkTreeIter iter;
+// Every month with expenses: its total and number of expenses
+static void report_months(StmtCache *stmts, const ReportOptions *options) {
+    static const char *const columns[] = {"month", "total", "count"};
+    static const gboolean numeric[] = {FALSE, TRUE, TRUE};
+    ReportWriter writer = {options, columns, numeric, G_N_ELEMENTS(columns), 0};
+    sqlite3_stmt *stmt = stmt_cache_get(stmts, SQL_MONTH_TOTALS);
 
-    // Reset the selected ID
-    app->selected_expense_id = -1;
-    
-    if (gtk_tree_selection_get_selected(selection, &model, &iter)) {
-        // Store the selected iterator
-        app->selected_iter = iter;
-        
-        // Get the ID from the model
-        gint id;
-        gtk_tree_model_get(model, &iter, 0, &id, -1);
-        app->selected_expense_id = id;
-        
-        // Enable buttons
-        gtk_widget_set_sensitive(app->edit_button, TRUE);
-        gtk_widget_set_sensitive(app->delete_button, TRUE);
-        
-        g_print("Selected expense ID: %d\n", id); // Debug print
-    } else {
-        // Disable buttons if nothing is selected
-        gtk_widget_set_sensitive(app->edit_button, FALSE);
-        gtk_widget_set_sensitive(app->delete_button, FALSE);
+    report_begin(&writer);
+    while (stmt != NULL && sqlite3_step(stmt) == SQLITE_ROW) {
+        const char *month = (const char *)sqlite3_column_text(stmt, 0);
+        if (options->month != NULL && strcmp(month, options->month) != 0) {
+            continue;
+        }
+        char total[32], count[16];
+        g_snprintf(total, sizeof(total), "%.2f", sqlite3_column_double(stmt, 1));
+        g_snprintf(count, sizeof(count), "%d", sqlite3_column_int(stmt, 2));
+        const char *values[] = {month, total, count};
+        report_row(&writer, values);
+    }
+    if (stmt != NULL) {
+        sqlite3_reset(stmt);
     }
+    report_end(&writer);
 }
 
-static void delete_expense(GtkButton *button, AppData *app) {
-    if (app->selected_expense_id < 0) {
-        g_print("No expense selected for deletion\n");
-        return;
+// Spending per dictionary entry, all time or in one month, as the charts
+// show it
+static void report_breakdown(StmtCache *stmts, const ReportOptions *options, const char *table,
+                             const char *all_time_sql, const char *month_sql) {
+    static const char *const columns[] = {"name", "total", "share"};
+    static const gboolean numeric[] = {FALSE, TRUE, TRUE};
+    ReportWriter writer = {options, columns, numeric, G_N_ELEMENTS(columns), 0};
+    Dictionary names;
+    GArray *totals = g_array_new(FALSE, TRUE, sizeof(double));
+    double sum = 0;
+
+    dictionary_load(&names, stmts->db, table);
+    load_chart_totals(stmts, options->month != NULL ? month_sql : all_time_sql, options->month, totals);
+    for (guint id = 1; id < totals->len; id++) {
+        sum += g_array_index(totals, double, id);
     }
 
-    GtkWidget *dialog = gtk_message_dialog_new(GTK_WINDOW(app->window),
-        GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
-        GTK_MESSAGE_QUESTION,
-        GTK_BUTTONS_YES_NO,
-        "Are you sure you want to delete this expense?");
+    report_begin(&writer);
+    for (guint id = 1; id < totals->len; id++) {
+        double amount = g_array_index(totals, double, id);
+        const char *name = dictionary_name(&names, id);
+        if (amount > 0 && name != NULL) {
+            char total[32], share[16];
+            g_snprintf(total, sizeof(total), "%.2f", amount);
+            g_snprintf(share, sizeof(share), "%.4f", amount / sum);
+            const char *values[] = {name, total, share};
+            report_row(&writer, values);
+        }
+    }
+    report_end(&writer);
 
-    gint response = gtk_dialog_run(GTK_DIALOG(dialog));
-    gtk_widget_destroy(dialog);
+    g_array_free(totals, TRUE);
+    dictionary_clear(&names);
+}
 
-        if (response == GTK_RESPONSE_YES) {
-            // Edit action
-            show_edit_dialog(app, id, iter);
-        }
-        else if (response == GTK_RESPONSE_NO) {
-            // Delete action
-            GtkWidget *confirm_dialog = gtk_message_dialog_new(GTK_WINDOW(app->window),
-                GTK_DIALOG_MODAL,
-                GTK_MESSAGE_QUESTION,
-                GTK_BUTTONS_YES_NO,
-                "Are you sure you want to delete this expense?");
-
-            if (gtk_dialog_run(GTK_DIALOG(confirm_dialog)) == GTK_RESPONSE_YES) {
-                sqlite3_stmt *stmt;
-                const char *sql = "DELETE FROM expenses WHERE id = ?";
-                
-                if (sqlite3_prepare_v2(app->db, sql, -1, &stmt, NULL) == SQLITE_OK) {
-                    sqlite3_bind_int(stmt, 1, id);
-                    
-                    if (sqlite3_step(stmt) == SQLITE_DONE) {
-                        gtk_list_store_remove(app->expense_store, &iter);
-                        update_budget_progress(app);
-                        update_charts(app);
-
-                        // Show success message
-                        GtkWidget *success_dialog = gtk_message_dialog_new(GTK_WINDOW(app->window),
-                            GTK_DIALOG_MODAL,
-                            GTK_MESSAGE_INFO,
-                            GTK_BUTTONS_OK,
-                            "Expense deleted successfully!");
-                        gtk_dialog_run(GTK_DIALOG(success_dialog));
-                        gtk_widget_destroy(success_dialog);
-                    }
-                    
-                    sqlite3_finalize(stmt);
-                }
-            }
-            
-            gtk_widget_destroy(confirm_dialog);
+// The month's budget against its spend, as the budget bar shows it
+static void report_budget(StmtCache *stmts, const ReportOptions *options, const char *month) {
+    static const char *const columns[] = {"month", "budget", "spent", "remaining", "used"};
+    static const gboolean numeric[] = {FALSE, TRUE, TRUE, TRUE, TRUE};
+    ReportWriter writer = {options, columns, numeric, G_N_ELEMENTS(columns), 0};
+    double budget = 0, spent = 0;
+    gboolean has_budget = FALSE;
+
+    sqlite3_stmt *stmt = stmt_cache_get(stmts, SQL_SELECT_BUDGET);
+    if (stmt != NULL) {
+        sqlite3_bind_text(stmt, 1, month, -1, SQLITE_STATIC);
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            budget = sqlite3_column_double(stmt, 0);
+            has_budget = TRUE;
         }
+        sqlite3_reset(stmt);
     }
-    
-    gtk_tree_path_free(path);
+    stmt = stmt_cache_get(stmts, SQL_MONTH_SPEND);
+    if (stmt != NULL) {
+        sqlite3_bind_text(stmt, 1, month, -1, SQLITE_STATIC);
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            spent = sqlite3_column_double(stmt, 0);
+        }
+        sqlite3_reset(stmt);
+    }
+
+    char budget_text[32], spent_text[32], remaining_text[32], used_text[16];
+    g_snprintf(budget_text, sizeof(budget_text), "%.2f", budget);
+    g_snprintf(spent_text, sizeof(spent_text), "%.2f", spent);
+    g_snprintf(remaining_text, sizeof(remaining_text), "%.2f", budget - spent);
+    g_snprintf(used_text, sizeof(used_text), "%.4f", budget > 0 ? spent / budget : 0);
+    const char *values[] = {
+        month,
+        has_budget ? budget_text : NULL,
+        spent_text,
+        has_budget ? remaining_text : NULL,
+        has_budget ? used_text : NULL
+    };
+
+    report_begin(&writer);
+    report_row(&writer, values);
+    report_end(&writer);
 }
 
-static void show_edit_dialog(AppData *app, gint id, GtkTreeIter iter) {
-    // Create edit dialog
-    GtkWidget *dialog = gtk_dialog_new_with_buttons("Edit Expense",
-        GTK_WINDOW(app->window),
-        GTK_DIALOG_MODAL,
-        "Save", GTK_RESPONSE_ACCEPT,
-        "Cancel", GTK_RESPONSE_CANCEL,
-        NULL);
+// The expenses of a category and/or search in the list's order, read a
+// row block at a time with the list's keyset queries
+static void report_list(StmtCache *stmts, const ReportOptions *options, const GArray *archives,
+                        gint category_id) {
+    static const char *const columns[] = {"id", "date", "amount", "description", "category", "payment_type"};
+    static const gboolean numeric[] = {TRUE, FALSE, TRUE, FALSE, FALSE, FALSE};
+    ReportWriter writer = {options, columns, numeric, G_N_ELEMENTS(columns), 0};
+    Dictionary categories, payment_types;
+    BlockJob fetch = {0};
+    gchar *fts_query = options->search != NULL ? make_fts_query(options->search) : NULL;
+    int remaining = options->limit > 0 ? options->limit : G_MAXINT;
 
-    // Create form grid
-    GtkWidget *content_area = gtk_dialog_get_content_area(GTK_DIALOG(dialog));
-    GtkWidget *grid = gtk_grid_new();
-    gtk_grid_set_row_spacing(GTK_GRID(grid), 5);
-    gtk_grid_set_column_spacing(GTK_GRID(grid), 5);
-    gtk_container_set_border_width(GTK_CONTAINER(grid), 10);
+    dictionary_load(&categories, stmts->db, "categories");
+    dictionary_load(&payment_types, stmts->db, "payment_types");
+    fetch.category_id = category_id;
+    fetch.fts_query = fts_query;
+    fetch.archives = archives;
+    if (options->month != NULL) {
+        // Day 31 bounds every month, as dates compare as text
+        fetch.from_date = g_strconcat(options->month, "-01", NULL);
+        fetch.to_date = g_strconcat(options->month, "-31", NULL);
+    }
 
-    // Create form fields
-    GtkWidget *amount_entry = gtk_entry_new();
-    GtkWidget *description_entry = gtk_entry_new();
-    GtkWidget *category_combo = gtk_combo_box_text_new();
-    GtkWidget *payment_combo = gtk_combo_box_text_new();
-    GtkWidget *date_entry = gtk_entry_new();
+    report_begin(&writer);
+    while (remaining > 0) {
+        fetch.n_rows = MIN(remaining, EXPENSE_BLOCK_ROWS);
+        RowBlock *block = load_row_block(stmts, &fetch);
 
-    // Get current values
-    GtkTreeModel *model = GTK_TREE_MODEL(app->expense_store);
-    gchar *amount, *description, *category, *payment_type, *date;
-    gtk_tree_model_get(model, &iter,
-        1, &amount,
-        2, &description,
-        3, &category,
-        4, &payment_type,
-        5, &date,
-        -1);
+        for (int i = 0; i < block->n_rows; i++) {
+            const ExpenseRow *row = &block->rows[i];
+            char id[16], amount[32];
+            g_snprintf(id, sizeof(id), "%d", row->id);
+            g_snprintf(amount, sizeof(amount), "%.2f", row->amount);
+            const char *values[] = {
+                id, row->date, amount, row->description,
+                dictionary_name(&categories, row->category_id),
+                dictionary_name(&payment_types, row->payment_type_id)
+            };
+            report_row(&writer, values);
+        }
+        remaining -= block->n_rows;
 
-    // Set current values
-    gtk_entry_set_text(GTK_ENTRY(amount_entry), amount);
-    gtk_entry_set_text(GTK_ENTRY(description_entry), description);
-    gtk_entry_set_text(GTK_ENTRY(date_entry), date);
+        // The next block starts after this one's last row
+        gboolean done = block->n_rows < fetch.n_rows;
+        if (!done) {
+            g_free(fetch.key.date);
+            fetch.key.date = g_strdup(block->rows[block->n_rows - 1].date);
+            fetch.key.id = block->rows[block->n_rows - 1].id;
+            fetch.offset += block->n_rows;
+        }
+        row_block_free(block);
+        if (done) {
+            break;
+        }
+    }
+    report_end(&writer);
 
-    // Add categories
-    const char *categories[] = {"Food", "Transport", "Entertainment", "Bills", "Others"};
-    for (int i = 0; i < 5; i++) {
-        gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(category_combo), categories[i]);
-        if (g_strcmp0(categories[i], category) == 0) {
-            gtk_combo_box_set_active(GTK_COMBO_BOX(category_combo), i);
+    g_free(fetch.key.date);
+    g_free(fetch.from_date);
+    g_free(fetch.to_date);
+    g_free(fts_query);
+    dictionary_clear(&categories);
+    dictionary_clear(&payment_types);
+}
+
+static void print_to_stderr(const gchar *text) {
+    fputs(text, stderr);
+}
+
+static int run_report(int argc, char *argv[]) {
+    ReportOptions options = {0};
+    const char *report = argv[0];
+
+    for (int i = 1; i < argc; i++) {
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        gboolean ok = value != NULL;
+
+        if (strcmp(argv[i], "--format") == 0) {
+            ok = ok && (strcmp(value, "csv") == 0 || strcmp(value, "json") == 0);
+            options.json = ok && strcmp(value, "json") == 0;
+        } else if (strcmp(argv[i], "--db") == 0) {
+            options.db_file = value;
+        } else if (strcmp(argv[i], "--month") == 0) {
+            gchar *first_day = g_strconcat(value != NULL ? value : "", "-01", NULL);
+            ok = ok && strlen(value) == 7 && is_valid_date(first_day);
+            g_free(first_day);
+            options.month = value;
+        } else if (strcmp(argv[i], "--category") == 0) {
+            options.category = value;
+        } else if (strcmp(argv[i], "--search") == 0) {
+            options.search = value;
+        } else if (strcmp(argv[i], "--limit") == 0) {
+            ok = parse_count(value, &options.limit);
+        } else {
+            ok = FALSE;
+        }
+        if (!ok) {
+            g_printerr("Usage: %s [--format csv|json] [--db FILE] [--month YYYY-MM] "
+                       "[--category NAME] [--search TEXT] [--limit N]\n", report);
+            return 2;
         }
+        i++;
     }
 
-    // Add payment types
-    const char *payment_types[] = {"Cash", "Credit Card", "Debit Card", "UPI"};
-    for (int i = 0; i < 4; i++) {
-        gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(payment_combo), payment_types[i]);
-        if (g_strcmp0(payment_types[i], payment_type) == 0) {
-            gtk_combo_box_set_active(GTK_COMBO_BOX(payment_combo), i);
+    // SQL errors are reported with g_print; keep them out of the report
+    g_set_print_handler(print_to_stderr);
+
+    StorageProfile profile;
+    storage_profile_load(&profile);
+    if (options.db_file != NULL) {
+        g_free(profile.database_file);
+        profile.database_file = g_strdup(options.db_file);
+    }
+    if (!g_file_test(profile.database_file, G_FILE_TEST_EXISTS)) {
+        g_printerr("%s does not exist\n", profile.database_file);
+        storage_profile_clear(&profile);
+        return 1;
+    }
+
+    // A report only reads; upgrading an older file is left to the app. The
+    // check runs on a read-only handle, before the connection's PRAGMAs.
+    sqlite3 *db = NULL;
+    gboolean current = sqlite3_open_v2(profile.database_file, &db, SQLITE_OPEN_READONLY, NULL) == SQLITE_OK &&
+                       database_is_current(db);
+    sqlite3_close(db);
+    if (!current) {
+        g_printerr("%s uses an older layout; open it in the app once to upgrade it\n",
+                   profile.database_file);
+        storage_profile_clear(&profile);
+        return 1;
+    }
+    db = find_archives(&profile) ? open_connection(&profile) : NULL;
+    if (db == NULL) {
+        storage_profile_clear(&profile);
+        return 1;
+    }
+    StmtCache stmts;
+    stmt_cache_init(&stmts, db);
+    int status = 0;
+
+    if (strcmp(report, "months") == 0) {
+        report_months(&stmts, &options);
+    } else if (strcmp(report, "categories") == 0) {
+        report_breakdown(&stmts, &options, "categories", SQL_CATEGORY_TOTALS, SQL_MONTH_CATEGORY_TOTALS);
+    } else if (strcmp(report, "payments") == 0) {
+        report_breakdown(&stmts, &options, "payment_types", SQL_PAYMENT_TOTALS, SQL_MONTH_PAYMENT_TOTALS);
+    } else if (strcmp(report, "budget") == 0) {
+        char month[8];
+        time_t t = time(NULL);
+        strftime(month, sizeof(month), "%Y-%m", localtime(&t));
+        report_budget(&stmts, &options, options.month != NULL ? options.month : month);
+    } else {
+        gint category_id = 0;
+        if (options.category != NULL) {
+            Dictionary categories;
+            dictionary_load(&categories, db, "categories");
+            category_id = dictionary_lookup(&categories, options.category);
+            dictionary_clear(&categories);
+            if (category_id == 0) {
+                g_printerr("Unknown category: %s\n", options.category);
+                status = 1;
+            }
+        }
+        if (status == 0) {
+            report_list(&stmts, &options, profile.archive_years, category_id);
         }
     }
 
-    // Add fields to grid
-    gtk_grid_attach(GTK_GRID(grid), gtk_label_new("Amount:"), 0, 0, 1, 1);
-    gtk_grid_attach(GTK_GRID(grid), amount_entry, 1, 0, 1, 1);
-    gtk_grid_attach(GTK_GRID(grid), gtk_label_new("Description:"), 0, 1, 1, 1);
-    gtk_grid_attach(GTK_GRID(grid), description_entry, 1, 1, 1, 1);
-    gtk_grid_attach(GTK_GRID(grid), gtk_label_new("Category:"), 0, 2, 1, 1);
-    gtk_grid_attach(GTK_GRID(grid), category_combo, 1, 2, 1, 1);
-    gtk_grid_attach(GTK_GRID(grid), gtk_label_new("Payment Type:"), 0, 3, 1, 1);
-    gtk_grid_attach(GTK_GRID(grid), payment_combo, 1, 3, 1, 1);
-    gtk_grid_attach(GTK_GRID(grid), gtk_label_new("Date:"), 0, 4, 1, 1);
-    gtk_grid_attach(GTK_GRID(grid), date_entry, 1, 4, 1, 1);
+    stmt_cache_clear(&stmts);
+    sqlite3_close(db);
+    storage_profile_clear(&profile);
+    return status;
+}
 
-    gtk_container_add(GTK_CONTAINER(content_area), grid);
-    gtk_widget_show_all(dialog);
+// Archives the closed years as the app does at startup, for a database
+// whose profile leaves archiving off or to archive ahead of a start
+static int run_archive(int argc, char *argv[]) {
+    const char *db_file = NULL;
+    int keep_years = 0;
 
-    // Handle response
-    if (gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_ACCEPT) {
-        const char *new_amount = gtk_entry_get_text(GTK_ENTRY(amount_entry));
-        const char *new_description = gtk_entry_get_text(GTK_ENTRY(description_entry));
-        const char *new_category = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(category_combo));
-        const char *new_payment_type = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(payment_combo));
-        const char *new_date = gtk_entry_get_text(GTK_ENTRY(date_entry));
+    for (int i = 1; i < argc; i++) {
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        gboolean ok = value != NULL;
 
-        if (strlen(new_amount) > 0 && strlen(new_description) > 0 && 
-            new_category != NULL && new_payment_type != NULL && strlen(new_date) > 0) {
-            
-            // Update database
-            sqlite3_stmt *stmt;
-            const char *sql = "UPDATE expenses SET amount = ?, description = ?, "
-                            "category = ?, payment_type = ?, date = ? WHERE id = ?";
-            
-            if (sqlite3_prepare_v2(app->db, sql, -1, &stmt, NULL) == SQLITE_OK) {
-                sqlite3_bind_double(stmt, 1, atof(new_amount));
-                sqlite3_bind_text(stmt, 2, new_description, -1, SQLITE_STATIC);
-                sqlite3_bind_text(stmt, 3, new_category, -1, SQLITE_STATIC);
-                sqlite3_bind_text(stmt, 4, new_payment_type, -1, SQLITE_STATIC);
-                sqlite3_bind_text(stmt, 5, new_date, -1, SQLITE_STATIC);
-                sqlite3_bind_int(stmt, 6, id);
-                
-                if (sqlite3_step(stmt) == SQLITE_DONE) {
-                    // Update tree view
-                    gtk_list_store_set(app->expense_store, &iter,
-                        1, new_amount,
-                        2, new_description,
-                        3, new_category,
-                        4, new_payment_type,
-                        5, new_date,
-                        -1);
-                    
-                    // Show success message
-                    GtkWidget *success_dialog = gtk_message_dialog_new(GTK_WINDOW(app->window),
-                        GTK_DIALOG_MODAL,
-                        GTK_MESSAGE_INFO,
-                        GTK_BUTTONS_OK,
-                        "Expense updated successfully!");
-                    gtk_dialog_run(GTK_DIALOG(success_dialog));
-                    gtk_widget_destroy(success_dialog);
-                    
-                    // Update displays
-                    update_budget_progress(app);
-                    update_charts(app);
-                }
-                
-                sqlite3_finalize(stmt);
+        if (strcmp(argv[i], "--db") == 0) {
+            db_file = value;
+        } else if (strcmp(argv[i], "--keep-years") == 0) {
+            ok = parse_count(value, &keep_years);
+        } else {
+            ok = FALSE;
+        }
+        if (!ok) {
+            g_printerr("Usage: %s [--db FILE] [--keep-years N]\n", argv[0]);
+            return 2;
+        }
+        i++;
+    }
+
+    StorageProfile profile;
+    storage_profile_load(&profile);
+    if (db_file != NULL) {
+        g_free(profile.database_file);
+        profile.database_file = g_strdup(db_file);
+    }
+    if (keep_years > 0) {
+        profile.archive_keep_years = keep_years;
+    }
+
+    int status = 1;
+    if (profile.archive_keep_years == 0) {
+        g_printerr("Pass --keep-years or set archive_keep_years\n");
+        status = 2;
+    } else if (!g_file_test(profile.database_file, G_FILE_TEST_EXISTS)) {
+        g_printerr("%s does not exist\n", profile.database_file);
+    } else if (find_archives(&profile)) {
+        sqlite3 *db = open_connection(&profile);
+        if (db != NULL) {
+            init_database(db);
+            int moved = archive_closed_years(db, &profile);
+            if (moved >= 0) {
+                g_print("%d expenses archived\n", moved);
+                status = 0;
             }
-            
-            g_free((gchar *)new_category);
-            g_free((gchar *)new_payment_type);
+            sqlite3_close(db);
         }
     }
 
-    // Cleanup
-    g_free(amount);
-    g_free(description);
-    g_free(category);
-    g_free(payment_type);
-    g_free(date);
-    gtk_widget_destroy(dialog);
+    storage_profile_clear(&profile);
+    return status;
 }